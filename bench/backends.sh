@@ -0,0 +1,28 @@
+#!/bin/sh
+# Runs the same loads on one worker with epoll and with io_uring, for the
+# syscalls/request of the two event backends.
+#
+#   bench/backends.sh [-w webserv] [-f config]
+#
+# Uploads go to /upload/bench.bin, which is removed afterwards.
+
+BENCH_DIR=$(dirname "$0")
+OPTS=
+while [ $# -gt 0 ]; do
+	case "$1" in
+		-w|-f) OPTS="$OPTS $1 $2"; shift 2 ;;
+		*) echo "usage: $0 [-w webserv] [-f config]" >&2; exit 2 ;;
+	esac
+done
+
+for backend in epoll io_uring; do
+	for load in "-n 500 -c 8 /" \
+		"-n 200 -c 4 -d 16 /" \
+		"-n 1 -c 300 -k /" \
+		"-n 25 -c 2 -m PUT -b 1000000 -k -e 201 /upload/bench.bin"; do
+		echo "== $backend: $load"
+		# shellcheck disable=SC2086
+		sh "$BENCH_DIR/run.sh" $OPTS -g 'worker_threads 1;' -g "event_backend $backend;" -- $load
+	done
+done
+rm -f var/www/uploads/bench.bin
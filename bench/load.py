@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+"""Small HTTP/1.1 load generator for the webserv benchmarks.
+
+Every connection sends its requests over one keep-alive socket, `depth`
+at a time (depth > 1 pipelines them), and checks the status of each
+response. Prints throughput and latency per batch. Responses without a
+Content-Length (uploads, error pages) need --close, which opens a new
+connection per request and reads each response up to EOF.
+
+    bench/load.py -n 2000 -c 4 /index.html
+    bench/load.py -n 50 -k -m PUT -b 1000000 /upload/bench.bin
+    bench/load.py -n 2000 -d 16 /index.html
+"""
+import argparse
+import socket
+import sys
+import threading
+import time
+
+
+def read_response(sock, buf):
+    """Returns (status line, rest of buf) once a whole response is in buf."""
+    while True:
+        end = buf.find(b"\r\n\r\n")
+        if end >= 0:
+            head = buf[:end].decode("latin-1").split("\r\n")
+            length = 0
+            for line in head[1:]:
+                name, _, value = line.partition(":")
+                if name.strip().lower() == "content-length":
+                    length = int(value)
+            if len(buf) >= end + 4 + length:
+                return head[0], buf[end + 4 + length:]
+        data = sock.recv(1 << 20)
+        if not data:
+            raise IOError("connection closed by the server")
+        buf += data
+
+
+def read_to_eof(sock):
+    buf = b""
+    while True:
+        data = sock.recv(1 << 20)
+        if not data:
+            return buf.split(b"\r\n", 1)[0].decode("latin-1")
+        buf += data
+
+
+def close_client(args, count, request, latencies, errors):
+    for _ in range(count):
+        start = time.time()
+        sock = socket.create_connection((args.addr, args.port))
+        try:
+            sock.sendall(request)
+            status = read_to_eof(sock)
+            if status.split(" ")[1:2] != [str(args.expect)]:
+                errors.append(status)
+        except (IOError, OSError) as e:
+            errors.append(str(e))
+        finally:
+            sock.close()
+        latencies.append(time.time() - start)
+
+
+def client(args, count, request, latencies, errors):
+    if args.close:
+        return close_client(args, count, request, latencies, errors)
+    sock = socket.create_connection((args.addr, args.port))
+    sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    buf = b""
+    done = 0
+    try:
+        while done < count:
+            depth = min(args.depth, count - done)
+            start = time.time()
+            sock.sendall(request * depth)
+            for _ in range(depth):
+                status, buf = read_response(sock, buf)
+                if status.split(" ")[1] != str(args.expect):
+                    errors.append(status)
+            latencies.append(time.time() - start)
+            done += depth
+    except (IOError, OSError) as e:
+        errors.append(str(e))
+    finally:
+        sock.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("path")
+    parser.add_argument("-a", "--addr", default="127.0.0.1")
+    parser.add_argument("-p", "--port", type=int, default=8080)
+    parser.add_argument("-H", "--host", default=None, help="Host header (addr:port)")
+    parser.add_argument("-m", "--method", default="GET")
+    parser.add_argument("-b", "--body", type=int, default=0, help="request body bytes")
+    parser.add_argument("-n", "--requests", type=int, default=1000, help="per connection")
+    parser.add_argument("-c", "--connections", type=int, default=1)
+    parser.add_argument("-d", "--depth", type=int, default=1, help="pipeline depth")
+    parser.add_argument("--chunked", action="store_true",
+                        help="send the body as one chunk of Transfer-Encoding: chunked")
+    parser.add_argument("-k", "--close", action="store_true",
+                        help="one connection per request, Connection: close")
+    parser.add_argument("-e", "--expect", type=int, default=None, help="expected status")
+    args = parser.parse_args()
+    if args.expect is None:
+        args.expect = 201 if args.method == "PUT" else 200
+
+    host = args.host or "%s:%d" % (args.addr, args.port)
+    request = "%s %s HTTP/1.1\r\nHost: %s\r\n" % (args.method, args.path, host)
+    if args.close:
+        request += "Connection: close\r\n"
+    body = b"x" * args.body
+    if args.chunked:
+        request += "Transfer-Encoding: chunked\r\n"
+        body = (b"%x\r\n" % args.body + body + b"\r\n" if body else b"") + b"0\r\n\r\n"
+    elif args.body or args.method in ("PUT", "POST"):
+        request += "Content-Length: %d\r\n" % args.body
+    request = request.encode() + b"\r\n" + body
+
+    latencies = []
+    errors = []
+    threads = [threading.Thread(target=client,
+                                args=(args, args.requests, request, latencies, errors))
+               for _ in range(args.connections)]
+    start = time.time()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    elapsed = time.time() - start
+
+    total = args.requests * args.connections
+    if not latencies:
+        print("no response, first error: %s" % (errors[0] if errors else "none"))
+        return 1
+    latencies.sort()
+    pick = lambda q: latencies[min(len(latencies) - 1, int(q * len(latencies)))] * 1000
+    print("%d requests, %d connections, depth %d: %.0f req/s, batch p50 %.2f ms, p99 %.2f ms"
+          % (total, args.connections, args.depth, total / elapsed, pick(0.5), pick(0.99)))
+    if errors:
+        print("%d errors, first: %s" % (len(errors), errors[0]))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
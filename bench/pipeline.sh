@@ -0,0 +1,23 @@
+#!/bin/sh
+# One connection sending 8000 requests for /index.html, one at a time and
+# pipelined 16 deep, on the legacy reactor and on two workers.
+#
+#   bench/pipeline.sh [-w webserv] [-f config]
+
+BENCH_DIR=$(dirname "$0")
+OPTS=
+while [ $# -gt 0 ]; do
+	case "$1" in
+		-w|-f) OPTS="$OPTS $1 $2"; shift 2 ;;
+		*) echo "usage: $0 [-w webserv] [-f config]" >&2; exit 2 ;;
+	esac
+done
+
+# No worker_threads directive: the legacy reactor
+for workers in "" "worker_threads 2;"; do
+	for depth in 1 16; do
+		echo "== ${workers:-legacy reactor}, depth $depth"
+		# shellcheck disable=SC2086
+		sh "$BENCH_DIR/run.sh" $OPTS -g "$workers" -- -n 8000 -c 1 -d $depth /index.html
+	done
+done
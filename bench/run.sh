@@ -0,0 +1,60 @@
+#!/bin/sh
+# Runs one benchmark against a fresh server and prints its event loop stats.
+#
+#   bench/run.sh [-g 'global directive;'] [-s 'server directive;'] \
+#       [-l 'listen parameters'] [-w webserv] [-f config] -- <bench/load.py arguments>
+#
+# -g lines go to the top of the config (worker_threads, epoll_mode, ...),
+# -s lines into the first server block (tcp_nodelay, tcp_nopush, ...),
+# -l parameters onto its first listen line (deferred, backlog=N, ...).
+# All of them may be repeated. The server gets SIGTERM afterwards, which makes
+# every worker log its "EventLoop stats" line with syscalls/request.
+
+WEBSERV=./webserv
+CONFIG=default.conf
+GLOBAL=
+SERVER=
+LISTEN=
+while [ $# -gt 0 ] && [ "$1" != "--" ]; do
+	case "$1" in
+		-w) WEBSERV=$2; shift 2 ;;
+		-f) CONFIG=$2; shift 2 ;;
+		-g) GLOBAL="$GLOBAL$2
+"; shift 2 ;;
+		-s) SERVER="$SERVER		$2
+"; shift 2 ;;
+		-l) LISTEN="$LISTEN $2"; shift 2 ;;
+		*) echo "usage: $0 [-g directive] [-s directive] [-l listen params] [-w webserv] [-f config] -- load args" >&2
+		   exit 2 ;;
+	esac
+done
+[ "$1" = "--" ] && shift
+
+BENCH_DIR=$(dirname "$0")
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+# Server directives go right after the first listen line
+{
+	printf '%s' "$GLOBAL"
+	awk -v extra="$SERVER" -v params="$LISTEN" '
+		!done && /^[ \t]*listen / { sub(/;/, params ";"); print; printf "%s", extra; done = 1; next }
+		{ print }' "$CONFIG"
+} > "$TMP/bench.conf"
+
+"$WEBSERV" "$TMP/bench.conf" > "$TMP/server.log" 2>&1 &
+PID=$!
+i=0
+while ! grep -q "running" "$TMP/server.log" 2>/dev/null && [ $i -lt 50 ]; do
+	sleep 0.1
+	i=$((i + 1))
+done
+sleep 0.2
+
+python3 "$BENCH_DIR/load.py" "$@"
+STATUS=$?
+
+kill -TERM $PID
+wait $PID 2>/dev/null
+grep -o "EventLoop stats.*" "$TMP/server.log"
+exit $STATUS
@@ -0,0 +1,202 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   scan.cpp                                           :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: lwoiton <lwoiton@student.42prague.com>     +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/12/24 16:40:27 by lwoiton           #+#    #+#             */
+/*   Updated: 2024/12/24 16:40:27 by lwoiton          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "HTTPUtils.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <time.h>
+
+/*
+ * The HTTPUtils scan kernels side by side.
+ *
+ *   scan check   every kernel the CPU has against a plain byte loop, on
+ *                random inputs full of CR, LF and colons
+ *   scan bench   ns per header block (600 B and 8 KB), parsed the way
+ *                HTTPRequest does: findEOL() and findNextColon() per line,
+ *                findHeaderEnd() over the block
+ */
+
+static const char*	g_kernels[] = { "scalar", "sse2", "avx2" };
+static const size_t	KERNEL_COUNT = sizeof(g_kernels) / sizeof(g_kernels[0]);
+static const size_t	NPOS = std::string::npos;
+
+// xorshift32, so every run checks the same inputs
+static unsigned	g_seed = 2463534242u;
+
+static unsigned	nextRandom()
+{
+	g_seed ^= g_seed << 13;
+	g_seed ^= g_seed >> 17;
+	g_seed ^= g_seed << 5;
+	return g_seed;
+}
+
+// Reference implementations, one byte at a time
+static size_t	refFind(const std::string& data, size_t start, const std::string& str)
+{
+	return data.find(str, start);
+}
+
+static size_t	refColon(const std::string& data, size_t start)
+{
+	for (size_t i = start; i < data.size(); ++i) {
+		if (data[i] == '\r' || data[i] == '\n')
+			return NPOS;
+		if (data[i] == ':')
+			return i;
+	}
+	return NPOS;
+}
+
+static std::string	randomInput()
+{
+	static const char	alphabet[] = "\r\n:-ab ";
+	std::string			data(nextRandom() % 300, '\0');
+
+	for (size_t i = 0; i < data.size(); ++i) {
+		unsigned r = nextRandom();
+		data[i] = (r & 3) ? alphabet[(r >> 2) % 7] : static_cast<char>(r >> 8);
+	}
+	return data;
+}
+
+static bool	report(const char* kernel, const char* function, const std::string& data,
+				size_t start, size_t got, size_t expected)
+{
+	if (got == expected)
+		return true;
+	std::printf("%s: %s(size %lu, start %lu) = %ld, expected %ld\n", kernel, function,
+		static_cast<unsigned long>(data.size()), static_cast<unsigned long>(start),
+		static_cast<long>(got), static_cast<long>(expected));
+	return false;
+}
+
+static int	check()
+{
+	static const char*	needles[] = { "\r\n", "\r\n\r\n", "--ab", "a", ":" };
+	const size_t		inputs = 200000;
+	int					failed = 0;
+
+	for (size_t k = 0; k < KERNEL_COUNT; ++k) {
+		if (!HTTPUtils::useScanKernel(g_kernels[k])) {
+			std::printf("%-6s  not supported by this CPU\n", g_kernels[k]);
+			continue;
+		}
+		g_seed = 2463534242u;
+		size_t errors = 0;
+		for (size_t n = 0; n < inputs && errors < 10; ++n) {
+			std::string	data = randomInput();
+			const char*	p = data.data();
+			size_t		start = nextRandom() % (data.size() + 3);
+			const char*	needle = needles[n % 5];
+			bool		ok = true;
+
+			ok &= report(g_kernels[k], "findHeaderEnd", data, start,
+				HTTPUtils::findHeaderEnd(p, data.size(), start), refFind(data, start, "\r\n\r\n"));
+			ok &= report(g_kernels[k], "findEOL", data, start,
+				HTTPUtils::findEOL(p, data.size(), start), refFind(data, start, "\r\n"));
+			ok &= report(g_kernels[k], "findNextColon", data, start,
+				HTTPUtils::findNextColon(p, data.size(), start), refColon(data, start));
+			ok &= report(g_kernels[k], "findString", data, start,
+				HTTPUtils::findString(p, data.size(), needle, start), refFind(data, start, needle));
+			if (!ok)
+				errors++;
+		}
+		std::printf("%-6s  %lu inputs, %lu failed\n", g_kernels[k],
+			static_cast<unsigned long>(inputs), static_cast<unsigned long>(errors));
+		failed |= errors != 0;
+	}
+	return failed;
+}
+
+// A browser request padded with cookies to about size bytes
+static std::string	headerBlock(size_t size)
+{
+	std::string	block =
+		"GET /images/logo.png HTTP/1.1\r\n"
+		"Host: www.example.com\r\n"
+		"User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:133.0) Gecko/20100101 Firefox/133.0\r\n"
+		"Accept: image/avif,image/webp,image/png,image/svg+xml,image/*;q=0.8,*/*;q=0.5\r\n"
+		"Accept-Language: en-US,en;q=0.5\r\n"
+		"Accept-Encoding: gzip, deflate, br, zstd\r\n"
+		"Referer: https://www.example.com/index.html\r\n"
+		"Connection: keep-alive\r\n";
+
+	while (block.size() + 4 < size) {
+		std::string	cookie = "Cookie: session=";
+		while (cookie.size() < 200 && block.size() + cookie.size() + 4 < size)
+			cookie += static_cast<char>('a' + nextRandom() % 26);
+		block += cookie + "\r\n";
+	}
+	return block + "\r\n";
+}
+
+static size_t	parseBlock(const std::string& block)
+{
+	const char*	p = block.data();
+	size_t		size = block.size();
+	size_t		found = 0;
+
+	for (size_t line = 0; line < size; ) {
+		size_t eol = HTTPUtils::findEOL(p, size, line);
+		if (eol == NPOS || eol == line)
+			break;
+		found += HTTPUtils::findNextColon(p, eol, line);
+		line = eol + 2;
+	}
+	return found + HTTPUtils::findHeaderEnd(p, size);
+}
+
+static double	nsPerBlock(const std::string& block, size_t rounds)
+{
+	struct timespec		begin;
+	struct timespec		end;
+	volatile size_t		sink = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for (size_t i = 0; i < rounds; ++i)
+		sink += parseBlock(block);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	(void)sink;
+	return ((end.tv_sec - begin.tv_sec) * 1e9 + (end.tv_nsec - begin.tv_nsec)) / rounds;
+}
+
+static int	bench()
+{
+	std::string	small = headerBlock(600);
+	std::string	large = headerBlock(8192);
+
+	for (size_t k = 0; k < KERNEL_COUNT; ++k) {
+		if (!HTTPUtils::useScanKernel(g_kernels[k]))
+			continue;
+		nsPerBlock(large, 1000);	// Warm up
+		std::printf("%-6s  %4lu B: %7.0f ns  %5lu B: %7.0f ns\n", g_kernels[k],
+			static_cast<unsigned long>(small.size()), nsPerBlock(small, 200000),
+			static_cast<unsigned long>(large.size()), nsPerBlock(large, 20000));
+	}
+	return 0;
+}
+
+int	main(int argc, char** argv)
+{
+	std::string	mode = argc > 1 ? argv[1] : "bench";
+
+	if (mode == "check")
+		return check();
+	if (mode == "bench")
+		return bench();
+	std::fprintf(stderr, "usage: %s [check|bench]\n", argv[0]);
+	return 2;
+}
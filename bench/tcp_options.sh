@@ -0,0 +1,45 @@
+#!/bin/sh
+# Runs the same loads once per TCP tuning option, against the defaults
+# (tcp_nodelay off, tcp_nopush off, backlog=4096, no deferred accept, no
+# fastopen, autotuned buffers). One worker, so every run also prints its
+# syscalls/request.
+#
+#   bench/tcp_options.sh [-w webserv] [-f config]
+#
+# load.py does not send TCP Fast Open cookies, so fastopen only shows what
+# the option costs a client that does not use it.
+
+BENCH_DIR=$(dirname "$0")
+OPTS=
+while [ $# -gt 0 ]; do
+	case "$1" in
+		-w|-f) OPTS="$OPTS $1 $2"; shift 2 ;;
+		*) echo "usage: $0 [-w webserv] [-f config]" >&2; exit 2 ;;
+	esac
+done
+
+# One variant per line: run.sh option and its argument, "-" for the defaults
+VARIANTS='-
+-s tcp_nodelay on;
+-s tcp_nopush on;
+-l deferred
+-l fastopen=256
+-l sndbuf=64k rcvbuf=64k
+-l sndbuf=1m rcvbuf=1m
+-l backlog=16'
+
+echo "$VARIANTS" | while read -r flag value; do
+	for load in "-n 500 -c 8 /" \
+		"-n 500 -c 8 /uploads.html" \
+		"-n 200 -c 4 -d 16 /" \
+		"-n 1 -c 300 -k /"; do
+		echo "== ${value:-defaults}: $load"
+		if [ "$flag" = "-" ]; then
+			set --
+		else
+			set -- "$flag" "$value"
+		fi
+		# shellcheck disable=SC2086
+		sh "$BENCH_DIR/run.sh" $OPTS -g 'worker_threads 1;' "$@" -- $load < /dev/null
+	done
+done
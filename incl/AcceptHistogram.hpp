@@ -0,0 +1,44 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   AcceptHistogram.hpp                                :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: lwoiton <lwoiton@student.42prague.com>     +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/12/22 14:02:37 by lwoiton           #+#    #+#             */
+/*   Updated: 2024/12/22 14:02:37 by lwoiton          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#pragma once
+#ifndef ACCEPTHISTOGRAM_HPP
+# define ACCEPTHISTOGRAM_HPP
+
+# include <cstddef>
+# include <string>
+
+/**
+ * @class AcceptHistogram
+ * @brief Connections accepted per listener wakeup, in power-of-two buckets.
+ *
+ * Buckets are 0, 1, 2-3, 4-7, ... and the last one is open-ended. Mostly
+ * 1s means accept batching buys nothing; a heavy tail at the top means
+ * accept_batch is the limit during connection storms.
+ */
+class AcceptHistogram
+{
+	public:
+		static const int	BUCKETS = 9;	// Up to 128+
+
+							AcceptHistogram();
+		void				record(size_t accepted);
+		size_t				getWakeups() const;
+		size_t				getAccepted() const;
+		std::string			toString() const;
+	private:
+		size_t				_counts[BUCKETS];
+		size_t				_wakeups;
+		size_t				_accepted;
+};
+
+#endif // ACCEPTHISTOGRAM_HPP
@@ -0,0 +1,64 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   BodySource.hpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: lwoiton <lwoiton@student.42prague.com>     +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/12/24 17:05:12 by lwoiton           #+#    #+#             */
+/*   Updated: 2024/12/24 17:05:12 by lwoiton          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#pragma once
+#ifndef BODYSOURCE_HPP
+# define BODYSOURCE_HPP
+
+# include <cstddef>
+# include <sys/types.h>
+
+/**
+ * @class BodySource
+ * @brief Producer of a response body whose length is not known up front.
+ *
+ * OutputQueue pulls from the source only after the socket has taken
+ * the previous window. So a slow client stops the producer, and the body
+ * never piles up in memory. read() follows read(2): bytes produced, 0 at
+ * the end, -1 with errno EAGAIN when nothing is ready yet. The owner
+ * then waits for getFd() to become readable.
+ */
+class BodySource
+{
+	public:
+		virtual				~BodySource();
+		virtual ssize_t		read(char* buffer, size_t len) = 0;
+		// Descriptor to poll after EAGAIN, -1 if read() never blocks
+		virtual int			getFd() const;
+};
+
+/**
+ * @class PipeSource
+ * @brief The non-blocking read end of a pipe fed by a child process,
+ * like the stdout of a CGI script. The child is reaped at the end of the
+ * output. If the body is dropped before that, the child is killed.
+ */
+class PipeSource : public BodySource
+{
+	public:
+		// Takes ownership of fd, pid may be -1
+							PipeSource(int fd, pid_t pid);
+		virtual				~PipeSource();
+		virtual ssize_t		read(char* buffer, size_t len);
+		virtual int			getFd() const;
+
+	private:
+		int					_fd;
+		pid_t				_pid;
+
+		void				_reap(bool force);
+
+							PipeSource(const PipeSource&);
+		PipeSource&			operator=(const PipeSource&);
+};
+
+#endif // BODYSOURCE_HPP
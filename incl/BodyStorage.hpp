@@ -0,0 +1,108 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   BodyStorage.hpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: lwoiton <lwoiton@student.42prague.com>     +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/12/24 18:05:12 by lwoiton           #+#    #+#             */
+/*   Updated: 2024/12/24 18:05:12 by lwoiton          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#pragma once
+#ifndef BODYSTORAGE_HPP
+# define BODYSTORAGE_HPP
+
+# include <cstddef>
+# include <string>
+# include <vector>
+# include <sys/types.h>
+
+# include "FileWriter.hpp"
+
+/**
+ * @class BodyStorage
+ * @brief A request body that moves to a cheaper tier as it grows.
+ *
+ * Bodies up to client_body_buffer_size stay in memory. Above that the
+ * body moves to a memfd, which is still RAM but can be handed to another
+ * process as a descriptor. Past client_body_memfd_size it goes to an
+ * unnamed O_TMPFILE in client_body_temp_path, so nothing is left behind
+ * on a crash. A body whose length is known up front is placed in its
+ * final tier right away by expect().
+ *
+ * Consumers only use the reader side: size(), read() at an offset and
+ * sendTo(), which uses sendfile() for the file tiers. getFd() gives the
+ * file tiers to a child process directly. I/O failures throw HTTPError 500.
+ *
+ * Writes to the spool file go through a FileWriter, so with a DiskPool they
+ * are done by a pool thread. The body is only complete for the reader once
+ * getDiskWait() is NULL again.
+ */
+class BodyStorage
+{
+	public:
+		enum Tier
+		{
+			MEMORY,
+			MEMFD,
+			SPOOL
+		};
+
+							BodyStorage();
+							~BodyStorage();
+
+		// From the config, before any thread starts
+		static void			configure(size_t memoryLimit, size_t memfdLimit,
+								const std::string& spoolDir);
+
+		// Writer side
+		void				expect(size_t length);
+		void				append(const char* data, size_t len);
+		// len writable bytes, commit() what was actually filled
+		char*				prepare(size_t len);
+		void				commit(size_t len);
+		void				clear();
+		DiskTask*			getDiskWait() const;
+		bool				isBacklogged() const;
+		// False for a task that is not ours, see FileWriter
+		bool				diskDone(DiskTask* task);
+
+		// Reader side
+		size_t				size() const;
+		bool				empty() const;
+		Tier				getTier() const;
+		// Copies up to len bytes from offset, returns the count
+		size_t				read(size_t offset, char* buffer, size_t len) const;
+		// Writes from offset to fd and advances it. Returns what write()
+		// would: bytes written, or -1 with errno set (EAGAIN included).
+		ssize_t				sendTo(int fd, size_t& offset) const;
+		// -1 while the body is in memory
+		int					getFd() const;
+		// The whole body, for small forms
+		std::string			str() const;
+
+	private:
+		std::vector<char>	_memory;	// MEMORY tier, staging for prepare() otherwise
+		int					_fd;
+		size_t				_size;
+		size_t				_prepared;
+		size_t				_expected;	// Announced length, picks the tier
+		Tier				_tier;
+		FileWriter			_writer;	// For the SPOOL tier
+
+		static size_t		_memoryLimit;
+		static size_t		_memfdLimit;
+		static std::string	_spoolDir;
+
+		void				_reserve(size_t total);
+		void				_moveTo(Tier tier);
+		int					_open(Tier& tier) const;
+		void				_write(Tier tier, const char* data, size_t len, size_t offset);
+
+							BodyStorage(const BodyStorage&);
+		BodyStorage&		operator=(const BodyStorage&);
+};
+
+#endif // BODYSTORAGE_HPP
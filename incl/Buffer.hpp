@@ -0,0 +1,74 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Buffer.hpp                                         :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: lwoiton <lwoiton@student.42prague.com>     +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/12/23 15:07:52 by lwoiton           #+#    #+#             */
+/*   Updated: 2024/12/23 15:07:52 by lwoiton          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#pragma once
+#ifndef BUFFER_HPP
+# define BUFFER_HPP
+
+# include <cstddef>
+# include <vector>
+
+/**
+ * @class Buffer
+ * @brief Byte buffer with a read cursor, for socket input.
+ *
+ * Readers consume() from the front by moving a cursor, so taking bytes
+ * off the front does not memmove the rest of the buffer. Writers append(),
+ * or recv() straight into prepare() and then commit(). The unread bytes
+ * are moved to the front only when the tail has no room left and at
+ * least as many bytes were consumed as remain. This keeps the copying
+ * linear in the total traffic.
+ *
+ * Storage comes from the thread's BufferPool: one pooled block while the
+ * data fits, a larger allocation beyond that. The storage goes back to
+ * the pool whenever the buffer runs empty, so an idle keep-alive
+ * connection holds no buffer memory. prepare() and append() fail when
+ * the pool's budget is used up, unless they are told to go over it.
+ *
+ * data() is valid until the next append(), prepare(), consume() or clear().
+ */
+class Buffer
+{
+	public:
+							Buffer();
+							~Buffer();
+
+		size_t				size() const { return _end - _start; }
+		bool				empty() const { return _end == _start; }
+		const char*			data() const { return _data ? _data + _start : NULL; }
+		char				operator[](size_t i) const { return _data[_start + i]; }
+
+		// False when the memory budget is used up, nothing is appended then.
+		// overBudget is for bytes that cannot be left where they are.
+		bool				append(const char* data, size_t len, bool overBudget = false);
+		bool				append(const std::vector<char>& data);
+		// At least len writable bytes after the data, NULL when the memory
+		// budget is used up; commit() what was used
+		char*				prepare(size_t len, bool overBudget = false);
+		void				commit(size_t len);
+		void				consume(size_t len);
+		void				clear();
+		size_t				capacity() const { return _capacity; }
+
+	private:
+		char*				_data;
+		size_t				_capacity;
+		size_t				_start;		// First unread byte
+		size_t				_end;		// One past the last byte
+
+		void				_release();
+
+							Buffer(const Buffer&);
+		Buffer&				operator=(const Buffer&);
+};
+
+#endif // BUFFER_HPP
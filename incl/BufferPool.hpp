@@ -0,0 +1,103 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   BufferPool.hpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: lwoiton <lwoiton@student.42prague.com>     +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/12/24 11:18:45 by lwoiton           #+#    #+#             */
+/*   Updated: 2024/12/24 11:18:45 by lwoiton          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#pragma once
+#ifndef BUFFERPOOL_HPP
+# define BUFFERPOOL_HPP
+
+# include <cstddef>
+# include <vector>
+
+/**
+ * @class BufferPool
+ * @brief Slab allocator for connection I/O buffers, under one memory budget.
+ *
+ * Buffers come in fixed BLOCK_BYTES blocks, carved out of SLAB_BYTES slabs.
+ * Free blocks are kept on a per-thread free list, so acquire() and
+ * release() are a vector push or pop with no lock and no malloc. Slabs
+ * are aligned to their size and start with a header block, so masking a
+ * block's address finds its slab's header in constant time. Blocks go
+ * back to the pool of the thread that acquired them.
+ *
+ * A slab whose blocks are all back is kept as this thread's spare, so a
+ * connection cycling through keep-alive does not malloc and free a whole
+ * slab each time. A second empty slab is freed and uncharged, and so is
+ * the spare while the budget has no room for another slab. Buffers that
+ * outgrow one block, for example very long header sections, are
+ * allocated one by one.
+ *
+ * Slabs and large buffers are charged to a budget for the whole process
+ * (io_buffer_budget), kept with atomic operations. Once it is used up,
+ * acquire() and allocate() return NULL. Connections then stop reading
+ * until memory is returned, instead of growing until the OOM killer
+ * steps in.
+ */
+class BufferPool
+{
+	public:
+		static const size_t	BLOCK_BYTES = 16 * 1024;
+		static const size_t	SLAB_BLOCKS = 64;		// Header included
+		static const size_t	SLAB_BYTES = SLAB_BLOCKS * BLOCK_BYTES;	// 1 MB, a power of two
+
+		// The calling thread's pool, created on first use
+		static BufferPool&	local();
+		static void			destroyLocal();
+		// 0 disables the budget
+		static void			setBudget(size_t bytes);
+		static size_t		getBudget();
+		static size_t		getCharged();	// Bytes of slabs and large buffers
+		// False once a new slab would not fit in the budget any more
+		static bool			hasRoom();
+
+		// BLOCK_BYTES bytes, or NULL when the budget is used up. overBudget
+		// charges the memory regardless, for data that has nowhere else to go.
+		char*				acquire(bool overBudget = false);
+		void				release(char* block);
+		// For buffers bigger than a block, NULL when the budget is used up
+		char*				allocate(size_t size, bool overBudget = false);
+		void				deallocate(char* data, size_t size);
+
+		size_t				getFreeBlocks() const;
+		size_t				getDenied() const;	// Requests refused by the budget
+
+							~BufferPool();
+
+	private:
+		static __thread BufferPool*	_local;
+		static size_t				_budget;
+		static volatile size_t		_charged;
+
+		// In the first block of every slab
+		struct Slab
+		{
+			size_t	freeBlocks;
+			size_t	index;		// In _slabs
+		};
+
+		std::vector<Slab*>	_slabs;
+		std::vector<char*>	_free;
+		size_t				_emptySlabs;	// With all blocks free, at most one kept
+		size_t				_denied;
+
+		static bool			_charge(size_t bytes, bool overBudget);
+		static void			_uncharge(size_t bytes);
+
+		static Slab*		_slabOf(const char* block);
+		bool				_newSlab(bool overBudget);
+		void				_freeSlab(Slab* slab);
+
+							BufferPool();
+							BufferPool(const BufferPool&);
+		BufferPool&			operator=(const BufferPool&);
+};
+
+#endif // BUFFERPOOL_HPP
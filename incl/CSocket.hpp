@@ -21,15 +21,18 @@
 class CSocket : public Socket
 {
 	public:
-		explicit			CSocket(int fd, const struct sockaddr_in& addr);
+		// isNonBlocking: fd came from accept4(SOCK_NONBLOCK), skip the fcntl
+							CSocket(int fd, const struct sockaddr_in& addr, bool isNonBlocking = false);
 							~CSocket();
 		
 		const std::string&	getIP() const;
 		uint16_t			getPort() const;
+		uint32_t			getAddr() const;	// sin_addr.s_addr
 		std::string 		toString() const;
 	private:
 		std::string			_ip;
 		uint16_t			_port;
+		uint32_t			_addr;
 };
 
 
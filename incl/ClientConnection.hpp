@@ -19,20 +19,32 @@
 # include <cstdint>
 # include <sstream>
 # include <algorithm>
+# include <netinet/in.h>
 
 # include "IOHandler.hpp"
-# include "CGIPipe.hpp"
+# include "TimerWheel.hpp"
+# include "Config.hpp"
 # include "HTTPRequest.hpp"
 # include "HTTPResponse.hpp"
 # include "Logger.hpp"
-# include "TempFile.hpp"
 # include "CGIProcessor.hpp"
+# include "Buffer.hpp"
+# include "OutputQueue.hpp"
 
-class ClientConnection : public IOHandler
+class RequestProcessor;
+class CGIPipe;
+class ConnectionLimiter;
+
+class ClientConnection : public IOHandler, public Timer
 {
 	public:
-		// Constructor takes socket fd and client info
-		ClientConnection(int fd, const std::string& ip, uint16_t port);
+		// Constructor takes a non-blocking socket fd, the peer address, the
+		// server block it was accepted for and the processor of the owning
+		// reactor. The connection was admitted by limiter and releases its
+		// place there when destroyed.
+		ClientConnection(int fd, const struct sockaddr_in& addr,
+			const Config::ServerConfig& config, RequestProcessor& processor,
+			ConnectionLimiter& limiter);
 		~ClientConnection();
 
 		// IOHandler interface implementation
@@ -41,6 +53,11 @@ class ClientConnection : public IOHandler
 		virtual bool wantsToRead() const;
 		virtual bool wantsToWrite() const;
 		virtual int getFd() const;
+		virtual void onDrain();
+		virtual DiskTask* getDiskWait() const;
+		virtual void onDiskDone(DiskTask* task);
+		virtual Poller::Completion getCompletion() const;
+		virtual bool handleReceived(const char* data, size_t len);
 
 		// Get client info for logging
 		const std::string& getIP() const;
@@ -60,26 +77,45 @@ class ClientConnection : public IOHandler
 			//Add TempFile for CGI output later
 		};	
 		CGI&		getCGI();
-		// Queue the response for sending
+		// Queue the response for sending, behind those not sent yet
 		void		queueResponse();
 	private:
+		static const size_t	READ_SIZE = 4096;	// Bytes asked for per read()
+		static const size_t	BODY_READ_SIZE = 64 * 1024;	// Per read() into a request body
+
 		enum State {
 			READING_REQUEST,
 			PROCESSING_CGI,
 			SENDING_RESPONSE,
 		};
+		// Which of the configured timeouts is armed
+		enum TimeoutPhase {
+			NO_TIMEOUT,
+			HEADER_TIMEOUT,
+			BODY_TIMEOUT,
+			SEND_TIMEOUT,
+			KEEPALIVE_TIMEOUT
+		};
 		// Socket info
 		int             _fd;
 		std::string     _clientIP;
 		uint16_t        _clientPort;
+		uint32_t        _clientAddr;    // sin_addr.s_addr, the limiter key
+		ConnectionLimiter&	_limiter;
 
 		// State management
 		State           _state;
 		bool            _keepAlive;
+		bool            _idle;          // Between two keep-alive requests
+
+		// Timeouts
+		const Config::ServerConfig&	_config;
+		TimeoutPhase    _timeoutPhase;
 		
 		// Buffers
-		std::vector<char> _readBuffer;
-		std::vector<char> _writeBuffer;
+		Buffer			_readBuffer;	// May hold pipelined requests
+		OutputQueue		_output;
+		size_t			_queued;		// Responses in _output, config.pipelineDepth at most
 
 		// Request processing state
 		HTTPRequest	 	_request;
@@ -88,6 +124,7 @@ class ClientConnection : public IOHandler
 		bool            _chunkedTransfer;
 
 		// Response processing state
+		RequestProcessor&	_processor;
 		HTTPResponse	_response;
 		size_t          _bytesWritten;
 		
@@ -95,7 +132,14 @@ class ClientConnection : public IOHandler
 		void	setupCGI();
 		
 		// Helper methods;
+		void	serveRequests();
+		void	rejectRequest(const HTTPError& error);
+		void	processRequest();
+		ssize_t	readBody(size_t left, size_t& asked);
 		void	reset();
+		void	updateTimeout(bool progress);
+	protected:
+		virtual void	onTimeout();
 
 		// Prevent copying
 		ClientConnection(const ClientConnection&);
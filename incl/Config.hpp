@@ -53,20 +53,65 @@ class Config
             size_t                             clientMaxBodySize;
             std::map<int, std::string>         errorPages;
             std::vector<Route>                 routes;
+            // Timeouts in milliseconds, 0 disables the timer
+            size_t                             keepaliveTimeout;    // Idle between requests
+            size_t                             clientHeaderTimeout; // Whole request line + headers
+            size_t                             clientBodyTimeout;   // Between two body reads
+            size_t                             sendTimeout;         // Between two writes
+            size_t                             acceptBatch;         // Connections accepted per wakeup
+            size_t                             pipelineDepth;       // Responses queued ahead of the socket
+            // TCP tuning, from the listen parameters and tcp_* directives
+            int                                backlog;             // listen() queue length
+            bool                               deferAccept;         // TCP_DEFER_ACCEPT: wake on data
+            int                                fastOpen;            // TCP_FASTOPEN queue, 0 disables
+            size_t                             sndBuf;              // SO_SNDBUF, 0 keeps autotuning
+            size_t                             rcvBuf;              // SO_RCVBUF, 0 keeps autotuning
+            bool                               tcpNodelay;          // TCP_NODELAY on connections
+            bool                               tcpNopush;           // TCP_CORK around each response
 
-            ServerConfig() : port(80), clientMaxBodySize(1024 * 1024) {}  // Default 1MB
+            ServerConfig() : port(80), clientMaxBodySize(1024 * 1024)  // Default 1MB
+                , keepaliveTimeout(75000), clientHeaderTimeout(60000)
+                , clientBodyTimeout(60000), sendTimeout(60000), acceptBatch(64), pipelineDepth(16)
+                , backlog(4096), deferAccept(false), fastOpen(0), sndBuf(0), rcvBuf(0)
+                , tcpNodelay(false), tcpNopush(false) {}
         };
 
                                         explicit Config(const std::string &configPath);
                                         ~Config();
         
         const std::vector<ServerConfig> &getServers() const;
+        size_t                          getWorkerThreads() const;
+        bool                            isEdgeTriggered() const;
+        bool                            useIoUring() const;
+        size_t                          getShutdownTimeout() const;
+        size_t                          getMaxConnections() const;
+        size_t                          getMaxConnectionsPerIp() const;
+        size_t                          getIoBufferBudget() const;     // 0: unlimited
+        size_t                          getClientBodyBufferSize() const;
+        size_t                          getClientBodyMemfdSize() const;
+        const std::string               &getClientBodyTempPath() const;
+        size_t                          getDiskThreads() const;
         
     private:
         std::vector<ServerConfig>      _servers;
+        size_t                         _workerThreads;
+        bool                           _edgeTriggered;
+        bool                           _ioUring;
+        size_t                         _shutdownTimeout;
+        size_t                         _maxConnections;
+        size_t                         _maxConnectionsPerIp;
+        size_t                         _ioBufferBudget;
+        size_t                         _clientBodyBufferSize;
+        size_t                         _clientBodyMemfdSize;
+        std::string                    _clientBodyTempPath;
+        size_t                         _diskThreads;
         void                           _parseConfig(const std::string &configPath);
         void                           _parseServer(std::ifstream &file);
         void                           _parseRoute(std::ifstream &file, ServerConfig &server);
+        size_t                         _parseDuration(const std::string &value) const;
+        size_t                         _parseSize(const std::string &value) const;
+        void                           _parseListenParam(const std::string &param, ServerConfig &server) const;
+        bool                           _parseSwitch(std::ifstream &file, const std::string &directive);
         std::string                    _getNextToken(std::ifstream &file);
         void                           _expectToken(std::ifstream &file, const std::string &expected);
         bool                           _isValidHost(const std::string &host) const;
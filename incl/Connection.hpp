@@ -19,11 +19,14 @@
 # include <stdint.h>
 
 # include "IOHandler.hpp"
+# include "TimerWheel.hpp"
 # include "CSocket.hpp"
 # include "HTTPRequest.hpp"
 # include "HTTPResponse.hpp"
+# include "Buffer.hpp"
+# include "OutputQueue.hpp"
 
-class Connection : public IOHandler
+class Connection : public IOHandler, public Timer
 {
     public:
 		enum State
@@ -36,7 +39,7 @@ class Connection : public IOHandler
 				FILE_OPERATION_PENDING,
 				WRITING_COMPLETE
 			};
-        explicit					Connection(CSocket *socket);
+									Connection(CSocket *socket, const Config::ServerConfig& config);
                                     ~Connection();
 		
     	virtual bool       			handleRead();
@@ -45,23 +48,59 @@ class Connection : public IOHandler
 		virtual bool				wantsToWrite() const;
         bool                        hasCompletedRequest() const;
         bool                        hasCompletedResponse() const;
-        void                        queueResponse(const HTTPResponse& response);
+        // Takes the body of response over, see HTTPResponse::queueTo().
+        // Responses are sent in the order they were queued; nothing is
+        // read after one that closes the connection.
+        void                        queueResponse(HTTPResponse& response, bool close);
+        // Room for one more response behind those not sent yet
+        bool                        canQueueResponse() const;
+        bool                        isClosing() const;
+        // Moves on to the request pipelined behind the answered one and
+        // parses what of it is buffered already
+        void                        nextRequest();
         int                  		getFd() const;
 		const std::string&			getIP() const;
 		uint16_t					getPort() const;
+		uint32_t					getAddr() const;
 		std::string					getSocketInfoString() const;
 		State						getState() const;
 		HTTPRequest& 				getCurrentRequest();
 		bool						shouldKeepAlive() const;
-		void						reset();
+		// No byte of a request read and nothing left to send
+		bool						isIdle() const;
+		// Body source the last write had to wait for, see OutputQueue
+		int							getWaitFd() const;
+		virtual DiskTask*			getDiskWait() const;
+		virtual void				onDiskDone(DiskTask* task);
+		// Everything queued is sent
+		void						responsesSent();
+		// Re-arms the timer for the current phase, see ClientConnection
+		void						updateTimeout(TimerWheel& timers);
+	protected:
+		virtual void				onTimeout();
     private:
+		enum TimeoutPhase
+			{
+				NO_TIMEOUT,
+				HEADER_TIMEOUT,
+				BODY_TIMEOUT,
+				SEND_TIMEOUT,
+				KEEPALIVE_TIMEOUT
+			};
 		CSocket						*_socket;
 		static const size_t			BUFFER_SIZE = 4096;
+		static const size_t			BODY_READ_SIZE = 64 * 1024;	// Per recv() into a request body
 		State						_state;
-        std::vector<char>			_readBuffer;
-        std::vector<char>			_writeBuffer;
+        Buffer						_readBuffer;	// May hold pipelined requests
+        OutputQueue					_output;
+		size_t						_queued;	// Responses in _output, config.pipelineDepth at most
+		bool						_closing;	// A response with "Connection: close" is queued
         HTTPRequest					_currentRequest;
 		HTTPResponse				_currentResponse;
+		const Config::ServerConfig&	_config;
+		TimeoutPhase				_timeoutPhase;
+		bool						_idle;		// Between two keep-alive requests
+		bool						_progress;	// Bytes moved since the last updateTimeout()
 
 									Connection(const Connection&);
         Connection&					operator=(const Connection&);
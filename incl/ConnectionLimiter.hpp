@@ -0,0 +1,81 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ConnectionLimiter.hpp                              :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: lwoiton <lwoiton@student.42prague.com>     +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/12/23 10:41:19 by lwoiton           #+#    #+#             */
+/*   Updated: 2024/12/23 10:41:19 by lwoiton          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#pragma once
+#ifndef CONNECTIONLIMITER_HPP
+# define CONNECTIONLIMITER_HPP
+
+# include <cstddef>
+# include <string>
+# include <vector>
+# include <stdint.h>
+# include <pthread.h>
+
+/**
+ * @class ConnectionLimiter
+ * @brief Admission control for accepted connections: max_connections and
+ * max_connections_per_ip.
+ *
+ * Open connections are counted per client IPv4 address in an
+ * open-addressing hash table with linear probing. An entry is removed
+ * when its count drops to zero, using backward-shift deletion, so there
+ * are no tombstones. admit() and release() are O(1) on average and do
+ * not allocate unless the table grows.
+ *
+ * One instance is shared by all reactors and a mutex guards it. A
+ * rejected connection is closed right after accept(), before any buffer
+ * or handler is allocated for it.
+ */
+class ConnectionLimiter
+{
+	public:
+		// 0 disables a limit
+							ConnectionLimiter(size_t maxTotal, size_t maxPerIp);
+							~ConnectionLimiter();
+
+		// addr is sin_addr.s_addr. On true the caller must release() it later.
+		bool				admit(uint32_t addr);
+		void				release(uint32_t addr);
+
+		size_t				getActive();
+		size_t				getAdmitted();
+		size_t				getRejectedTotal();
+		size_t				getRejectedPerIp();
+		std::string			toString();
+
+	private:
+		struct Slot
+		{
+			uint32_t		addr;
+			uint32_t		count;		// 0 marks a free slot
+		};
+
+		size_t				_maxTotal;
+		size_t				_maxPerIp;
+		std::vector<Slot>	_slots;		// Power-of-two size
+		size_t				_used;		// Slots with count > 0
+		size_t				_active;
+		size_t				_admitted;
+		size_t				_rejectedTotal;
+		size_t				_rejectedPerIp;
+		pthread_mutex_t		_lock;
+
+		size_t				_home(uint32_t addr) const;
+		Slot&				_find(uint32_t addr);
+		void				_erase(size_t index);
+		void				_grow();
+
+							ConnectionLimiter(const ConnectionLimiter&);
+		ConnectionLimiter&	operator=(const ConnectionLimiter&);
+};
+
+#endif // CONNECTIONLIMITER_HPP
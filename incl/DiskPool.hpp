@@ -0,0 +1,137 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   DiskPool.hpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: lwoiton <lwoiton@student.42prague.com>     +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/12/24 19:21:47 by lwoiton           #+#    #+#             */
+/*   Updated: 2024/12/24 19:21:47 by lwoiton          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#pragma once
+#ifndef DISKPOOL_HPP
+# define DISKPOOL_HPP
+
+# include <cstddef>
+# include <deque>
+# include <vector>
+# include <pthread.h>
+# include <stdint.h>
+
+class DiskCompletions;
+
+/**
+ * @class DiskTask
+ * @brief One piece of blocking file work, done by a DiskPool thread.
+ *
+ * run() makes the blocking calls (open, stat, read, write, fsync...) in a
+ * pool thread. It must only touch the task's own data and must not throw. The finished task
+ * goes back to the reactor that submitted it. That reactor finds its
+ * owner by the FdTable tag set with setOwner(), or taken from
+ * DiskCompletions::setSubmitter() on submit, hands the task over if
+ * the owner still exists, and deletes it.
+ */
+class DiskTask
+{
+	public:
+							DiskTask();
+		virtual				~DiskTask();
+		virtual void		run() = 0;
+		void				setOwner(uint64_t tag);
+		uint64_t			getOwner() const;
+		// Next in the list returned by DiskCompletions::take()
+		DiskTask*			getNext() const;
+
+	private:
+		friend class DiskPool;
+		friend class DiskCompletions;
+
+		DiskTask*			_next;
+		DiskCompletions*	_completions;
+		uint64_t			_owner;
+
+							DiskTask(const DiskTask&);
+		DiskTask&			operator=(const DiskTask&);
+};
+
+/**
+ * @class DiskCompletions
+ * @brief The finished tasks of one reactor thread, and an eventfd to wake it.
+ *
+ * The pool threads push onto a lock-free list (compare-and-swap on the
+ * head, any number of producers). Only the push onto an empty list writes
+ * the eventfd, so a burst of completions costs one wakeup. The reactor
+ * polls getFd() and takes the whole list at once.
+ */
+class DiskCompletions
+{
+	public:
+		// The calling thread's instance, created on first use
+		static DiskCompletions&	local();
+		// Waits for the tasks this thread still has in flight
+		static void			destroyLocal();
+
+		int					getFd() const;
+		// From a pool thread
+		void				post(DiskTask* task);
+		// The finished tasks in completion order, linked by getNext().
+		// The caller deletes them.
+		DiskTask*			take();
+		size_t				getInFlight() const;
+		// Owner of the tasks submitted from this thread until the next
+		// call: the reactor sets it around every handler call, so a
+		// handler with several tasks in flight gets all of them back
+		void				setSubmitter(uint64_t tag);
+
+							~DiskCompletions();
+
+	private:
+		friend class DiskPool;
+
+		static __thread DiskCompletions*	_local;
+
+		int					_fd;
+		DiskTask* volatile	_head;
+		size_t				_inFlight;	// Submitted and not taken yet
+		uint64_t			_submitter;
+
+							DiskCompletions();
+							DiskCompletions(const DiskCompletions&);
+		DiskCompletions&	operator=(const DiskCompletions&);
+};
+
+/**
+ * @class DiskPool
+ * @brief A fixed set of threads for the file calls that block.
+ *
+ * Regular files are always "ready" for epoll, and reading a cold page
+ * blocks the whole reactor and every client on it. Tasks go to the
+ * disk_threads threads through one locked queue. The threads are started
+ * once, after the signal mask is set up, so they inherit it. stop() lets
+ * them finish the queue before joining them.
+ */
+class DiskPool
+{
+	public:
+		static void			start(size_t threads);
+		static void			stop();
+		static bool			isRunning();
+		// Takes ownership. The task completes on the calling thread's
+		// DiskCompletions. Without threads it runs right away.
+		static void			submit(DiskTask* task);
+
+	private:
+		static std::vector<pthread_t>	_threads;
+		static std::deque<DiskTask*>	_queue;
+		static pthread_mutex_t			_lock;
+		static pthread_cond_t			_ready;
+		static bool						_stopping;
+
+		static void*		_threadMain(void* arg);
+
+							DiskPool();
+};
+
+#endif // DISKPOOL_HPP
@@ -18,7 +18,7 @@ class Environment {
     Environment(int n);
     ~Environment();
 
-    void	createEnv(HTTPRequest &req, std::string _path_to_script);
+    void	createEnv(const HTTPRequest &req, std::string _path_to_script);
     void AddEnvVar(int index, const char *key, const char *value);
     std::string parseQueryString(std::string _uri);
     void printEnv() const;
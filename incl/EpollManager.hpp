@@ -19,6 +19,7 @@
 # include <unistd.h>
 # include <stdexcept>
 # include <cerrno>
+# include <stdint.h>
 
 class EpollManager
 {
@@ -26,9 +27,10 @@ class EpollManager
                                         EpollManager();
                                         ~EpollManager();
 
-        void                            addSocket(int fd, uint32_t events);
+        // tag is stored in epoll_event.data.u64 and handed back by waitEvents()
+        void                            addSocket(int fd, uint32_t events, uint64_t tag);
         void                            removeSocket(int fd);
-        void                            modifySocket(int fd, uint32_t events);
+        void                            modifySocket(int fd, uint32_t events, uint64_t tag);
         std::vector<struct epoll_event> waitEvents(int timeout = -1);
 
     private:
@@ -0,0 +1,44 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   EpollPoller.hpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: lwoiton <lwoiton@student.42prague.com>     +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/12/22 17:40:12 by lwoiton           #+#    #+#             */
+/*   Updated: 2024/12/22 17:40:12 by lwoiton          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#pragma once
+#ifndef EPOLLPOLLER_HPP
+# define EPOLLPOLLER_HPP
+
+# include <sys/epoll.h>
+
+# include "Poller.hpp"
+
+// Default backend: one epoll_ctl per registration change, one epoll_wait per turn
+class EpollPoller : public Poller
+{
+	public:
+							EpollPoller();
+							~EpollPoller();
+		virtual void		add(int fd, uint32_t events, uint64_t tag);
+		virtual void		modify(int fd, uint32_t events, uint64_t tag);
+		virtual void		remove(int fd);
+		virtual int			wait(Event* events, int maxEvents, int timeoutMs);
+		virtual const char*	getName() const;
+		virtual size_t		getSyscalls() const;
+	private:
+		static const int	MAX_EVENTS = 64;
+		int					_epollFd;
+		size_t				_syscalls;
+
+		void				control(int op, int fd, uint32_t events, uint64_t tag);
+
+							EpollPoller(const EpollPoller&);
+		EpollPoller&		operator=(const EpollPoller&);
+};
+
+#endif // EPOLLPOLLER_HPP
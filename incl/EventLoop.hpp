@@ -15,52 +15,159 @@
 # define EVENTLOOP_HPP
 
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <map>
+#include <vector>
 #include <stdexcept>
 #include <iostream>
 
-#include "IOHandler.hpp"
 #include "Logger.hpp"
+#include "FdTable.hpp"
+#include "TimerWheel.hpp"
+#include "AcceptHistogram.hpp"
+#include "Poller.hpp"
 
+class IOHandler;
 
 /**
  * @file EventLoop.hpp
  * @brief Event loop implementation using epoll for handling I/O events.
  *
  * This class implements an event loop using the epoll system call to manage I/O events.
- * It follows the singleton design pattern to ensure that only one instance of the event loop exists.
- * This is particularly useful in server applications like nginx, where a single event loop can efficiently
- * handle multiple connections.
+ * The readiness backend sits behind the Poller interface: EpollPoller by default, or
+ * UringPoller after useIoUring() (event_backend io_uring), which batches registration
+ * changes and the wait into a single io_uring_enter.
+ * There is exactly one EventLoop per reactor thread: getInstance() returns the loop owned
+ * by the calling thread and creates it on first use. Every worker thread therefore gets its
+ * own epoll instance and handler table, like nginx worker processes, and no locking is
+ * needed on the hot path.
  *
- * The singleton pattern is used here to:
- * - Ensure that only one instance of the EventLoop exists throughout the application.
- * - Provide a global point of access to the EventLoop instance.
- * - Control concurrent access to the EventLoop instance.
+ * The per-thread instance is used here to:
+ * - Keep a single point of access to "the" EventLoop from inside the handlers.
+ * - Let several reactors run in parallel without sharing epoll or handler state.
  *
  * The EventLoop class manages a collection of IOHandler objects, each representing a file descriptor
- * and its associated events. It provides methods to register, remove, and update handlers, and to run
- * the event loop.
+ * and its associated events. Handlers live in an FdTable, so dispatching an event is an array
+ * index plus a generation check that drops events queued for an fd that was closed in the
+ * meantime. It provides methods to register, remove, and update handlers, and to run the
+ * event loop. stop() and drain() are the only methods that may be called from another thread;
+ * they wake the loop through an eventfd. drain() calls onDrain() on every handler once, and
+ * run() returns when the last handler is gone.
  *
- * @note This class is not copyable or assignable to enforce the singleton pattern.
+ * In edge-triggered mode (epoll_mode edge) handlers drain their fd until EAGAIN, but at most
+ * DRAIN_BUDGET bytes per turn. A handler that stops on the budget marks itself with
+ * setPendingIO() and is dispatched again on the next iteration without waiting for a new edge.
+ *
+ * removeHandler() only unhooks the handler from the fd table, so later events for it in the
+ * same batch are dropped, and queues it. The queue is torn down in one go at the end of the
+ * loop iteration, after the timers ran; until then the handler and its fd stay valid.
+ *
+ * A handler whose read found the BufferPool budget used up marks itself with setStarved().
+ * The loop then drops EPOLLIN from its mask and parks it; every iteration, once the pool has
+ * room for another slab, the parked handlers get EPOLLIN back. While any handler is parked
+ * the wait is capped at STARVED_POLL_MS, as returned memory does not wake the loop.
+ *
+ * On a backend that supportsCompletions() (io_uring on Linux 6.0+), handlers that ask for
+ * it through getCompletion() do not get EPOLLIN: the poller accepts or receives for them,
+ * and the loop hands the result to handleAccepted() or handleReceived(), then returns the
+ * receive buffer to the kernel. Dropping EPOLLIN from the mask ends the multishot operation.
+ *
+ * With a DiskPool running, the loop also polls its thread's DiskCompletions eventfd
+ * (DISK_TAG). Tasks a handler submits while the loop calls it are stamped with the
+ * handler's tag (DiskCompletions::setSubmitter()), and on completion handed to onDiskDone()
+ * if the tag still resolves. A handler gone in the meantime never sees it.
+ *
+ * Connection timeouts are kept in a TimerWheel. Its next deadline bounds the wait
+ * timeout, and due timers are fired after each batch of events.
+ *
+ * @note This class is not copyable or assignable.
  *
  * @class EventLoop
- * @brief Singleton class for managing I/O events using epoll.
+ * @brief Per-thread reactor managing I/O events using epoll.
  */
 class EventLoop
 {
 	public:
+		// Syscall accounting, used to compare level- and edge-triggered mode
+		struct Stats
+		{
+			size_t	waitCalls;
+			size_t	ctlCalls;		// Registration changes handed to the backend
+			size_t	ctlSkipped;		// MODs avoided because the mask did not change
+			size_t	readCalls;
+			size_t	writeCalls;
+			size_t	requests;
+			size_t	staleEvents;	// Events dropped by the generation check
+			size_t	timeouts;		// Timers fired
+			size_t	closed;			// Handlers torn down
+			size_t	closeBatches;	// Iterations that had something to tear down
+			size_t	maxCloseBatch;
+			uint64_t	teardownNs;	// Time spent in flushClosed()
+			size_t	starved;		// Reads paused on the buffer budget
+			size_t	diskTasks;		// DiskPool tasks completed
+			size_t	acceptCalls;	// accept4() and getpeername() by the listeners
+			size_t	completions;	// Accepts and receives done by the backend
+			AcceptHistogram	accepts;	// Filled by the listeners
+
+			Stats() : waitCalls(0), ctlCalls(0), ctlSkipped(0)
+				, readCalls(0), writeCalls(0), requests(0), staleEvents(0), timeouts(0)
+				, closed(0), closeBatches(0), maxCloseBatch(0), teardownNs(0), starved(0)
+				, diskTasks(0), acceptCalls(0), completions(0) {}
+		};
+		static const size_t	DRAIN_BUDGET = 256 * 1024; // Bytes per handler and turn
+		static const int	STARVED_POLL_MS = 10;	// Wait cap while reads are paused
+
 							~EventLoop();
 		static EventLoop*	getInstance();
+		static void			destroyInstance();
 		void				registerHandler(IOHandler* handler);
+		// Deferred: the handler is destroyed at the end of the current iteration
 		void				removeHandler(IOHandler* handler);
+		// Unregisters the fd right away; the caller still owns handler
+		void				detachHandler(IOHandler* handler);
 		void				run();
+		void				stop();
+		void				drain();
+		void				setEdgeTriggered(bool enabled);
+		// Switches to the io_uring backend; false (staying on epoll) if the
+		// kernel does not offer it. Call before registering handlers.
+		bool				useIoUring();
+		bool				isEdgeTriggered() const;
+		Stats&				getStats();
+		TimerWheel&			getTimers();
+		void				logStats() const;
 	private:
-		static EventLoop*			_instance;
-		int							_epollFd;
-		bool						_running;
-		std::map<int, IOHandler*>	_handlers;
+		static __thread EventLoop*	_instance;
+		Poller*						_poller;
+		int							_wakeFd;
+		int							_diskFd;	// -1 without a DiskPool
+		volatile bool				_running;
+		volatile bool				_drainRequested;
+		bool						_draining;
+		bool						_edgeTriggered;
+		static const uint64_t		WAKE_TAG = ~0ULL; // Never produced by FdTable (kind 0)
+		static const uint64_t		DISK_TAG = ~1ULL; // DiskCompletions eventfd
+		FdTable<IOHandler>			_handlers;	// Indexed by fd, tags are handed to the Poller
+		std::vector<IOHandler*>		_pending;	// Stopped on the budget, retried next iteration
+		std::vector<IOHandler*>		_retrying;	// The batch of _pending being retried
+		std::vector<IOHandler*>		_closing;	// Removed during this iteration
+		std::vector<IOHandler*>		_starved;	// Reads paused until the BufferPool has room
+		Stats						_stats;
+		TimerWheel					_timers;
+		uint32_t					interestMask(IOHandler* handler) const;
+		void						dispatch(IOHandler* handler, uint32_t events);
+		void						complete(IOHandler* handler, const Poller::Event& event);
+		void						dropCompletion(const Poller::Event& event);
+		void						trackStarved(IOHandler* handler);
+		void						setSubmitter(IOHandler* handler);
 		void						updateHandlerEvents(IOHandler* handler);
-									EventLoop(); // Prevent instantiation for singleton pattern
+		void						unhook(IOHandler* handler);
+		void						drainWakeFd();
+		void						completeDiskTasks();
+		void						flushClosed();
+		void						resumeStarved();
+		void						beginDrain();
+									EventLoop(); // Only created through getInstance()
 									EventLoop(const EventLoop& src); // Prevent copy-construction
 									EventLoop& operator=(const EventLoop& src); // Prevent assignment
 };
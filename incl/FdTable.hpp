@@ -0,0 +1,118 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   FdTable.hpp                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: lwoiton <lwoiton@student.42prague.com>     +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/12/21 16:40:12 by lwoiton           #+#    #+#             */
+/*   Updated: 2024/12/21 16:40:12 by lwoiton          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+
+#pragma once
+#ifndef FDTABLE_HPP
+# define FDTABLE_HPP
+
+# include <vector>
+# include <cstddef>
+# include <stdint.h>
+
+/**
+ * @class FdTable
+ * @brief Dense table of objects indexed by file descriptor.
+ *
+ * Lookups are a vector index instead of a std::map walk. Every insert bumps
+ * the slot's generation, and insert() returns a tag meant for
+ * epoll_event.data.u64:
+ *
+ *     | kind (8 bits) | generation (24 bits) | fd (32 bits) |
+ *
+ * lookup(tag) only succeeds while the slot still holds the object the tag
+ * was issued for, so an event that was already queued for a closed fd is
+ * recognised as stale after the kernel hands the fd number out again.
+ * The kind byte separates tables that share one epoll instance.
+ */
+template <typename T>
+class FdTable
+{
+	public:
+		explicit FdTable(uint8_t kind = 0) : _kind(kind), _count(0) {}
+
+		uint64_t	insert(int fd, T* item)
+		{
+			if (static_cast<size_t>(fd) >= _slots.size())
+				_slots.resize(fd + 1 + (fd >> 1)); // Grow geometrically
+			Slot& slot = _slots[fd];
+			if (!slot.item)
+				_count++;
+			slot.item = item;
+			slot.generation = (slot.generation + 1) & GENERATION_MASK;
+			return makeTag(fd, slot.generation);
+		}
+
+		void		erase(int fd)
+		{
+			if (fd < 0 || static_cast<size_t>(fd) >= _slots.size() || !_slots[fd].item)
+				return;
+			_slots[fd].item = NULL;
+			_count--;
+		}
+
+		T*			get(int fd) const
+		{
+			if (fd < 0 || static_cast<size_t>(fd) >= _slots.size())
+				return NULL;
+			return _slots[fd].item;
+		}
+
+		// NULL when the tag is stale or belongs to another table
+		T*			lookup(uint64_t tag) const
+		{
+			int fd = fdOf(tag);
+			if (static_cast<uint8_t>(tag >> 56) != _kind)
+				return NULL;
+			T* item = get(fd);
+			if (!item || _slots[fd].generation != ((tag >> 32) & GENERATION_MASK))
+				return NULL;
+			return item;
+		}
+
+		uint64_t	tagOf(int fd) const
+		{
+			return makeTag(fd, _slots[fd].generation);
+		}
+
+		static int	fdOf(uint64_t tag)
+		{
+			return static_cast<int>(static_cast<uint32_t>(tag));
+		}
+
+		size_t		size() const { return _count; }
+		size_t		capacity() const { return _slots.size(); }
+
+	private:
+		static const uint32_t	GENERATION_MASK = 0xFFFFFF;
+
+		struct Slot
+		{
+			T*			item;
+			uint32_t	generation;
+
+			Slot() : item(NULL), generation(0) {}
+		};
+
+		uint8_t				_kind;
+		size_t				_count;
+		std::vector<Slot>	_slots;
+
+		uint64_t	makeTag(int fd, uint32_t generation) const
+		{
+			return (static_cast<uint64_t>(_kind) << 56)
+				| (static_cast<uint64_t>(generation) << 32)
+				| static_cast<uint32_t>(fd);
+		}
+};
+
+#endif // FDTABLE_HPP
@@ -34,6 +34,7 @@ public:
     virtual int getFd() const;
 
 private:
+    int _fd;
     ClientConnection& _parent;
     size_t _bytesRead;
     size_t _fileSize;
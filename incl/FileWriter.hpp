@@ -0,0 +1,77 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   FileWriter.hpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: lwoiton <lwoiton@student.42prague.com>     +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/12/24 16:05:12 by lwoiton           #+#    #+#             */
+/*   Updated: 2024/12/24 16:05:12 by lwoiton          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef FILEWRITER_HPP
+# define FILEWRITER_HPP
+
+# include <cstddef>
+# include <vector>
+# include <sys/types.h>
+
+class DiskTask;
+class FileWrite;
+
+/**
+ * @class FileWriter
+ * @brief Writes received request bytes to disk through the DiskPool.
+ *
+ * A file on disk is always writable for epoll, so a write that waits for
+ * the disk stalls the whole reactor. With a DiskPool running, a pool thread
+ * does the write. write() copies the bytes, and copy() moves them from a
+ * pipe (splice) or another file (sendfile). Every write names its offset,
+ * so the order the writes finish in does not matter.
+ *
+ * Only one task is in flight at a time, named by getDiskWait(). As with
+ * OutputQueue, the owner hands the finished task back to diskDone().
+ * Bytes given to write() in the meantime are staged, and diskDone()
+ * submits them as the next task. isBacklogged() tells the owner to stop reading
+ * its socket: STAGE_LIMIT bytes are staged, or a copy() is in flight.
+ *
+ * Without a DiskPool every write happens right away. A failed write
+ * throws HTTPError 500, from diskDone() when a pool thread did it. Files
+ * a task still writes to must be closed with closeFd(): the task then
+ * closes them itself once it is deleted.
+ */
+class FileWriter
+{
+	public:
+		static const size_t	STAGE_LIMIT = 256 * 1024;
+
+							FileWriter();
+							~FileWriter();
+
+		void				write(int fd, off_t offset, const char* data, size_t len);
+		// srcOffset -1: srcFd is a pipe
+		void				copy(int fd, off_t offset, int srcFd, off_t srcOffset, size_t len);
+		void				closeFd(int fd);
+		// Drops the staged bytes and the task in flight, whose completion
+		// is then ignored
+		void				reset();
+
+		DiskTask*			getDiskWait() const;
+		bool				isBacklogged() const;
+		// False for a task that is not ours
+		bool				diskDone(DiskTask* task);
+
+	private:
+		FileWrite*			_task;		// In flight, deleted by the reactor
+		int					_stagedFd;
+		off_t				_stagedOffset;
+		std::vector<char>	_staged;
+
+		void				_submit(FileWrite* task);
+
+							FileWriter(const FileWriter&);
+		FileWriter&			operator=(const FileWriter&);
+};
+
+#endif // FILEWRITER_HPP
@@ -24,7 +24,9 @@
 #include <algorithm>
 #include "Config.hpp"
 #include "HTTPUtils.hpp"
-#include "TempFile.hpp"
+#include "Buffer.hpp"
+#include "UploadSink.hpp"
+#include "BodyStorage.hpp"
 
 class HTTPRequest
 {
@@ -46,6 +48,31 @@ class HTTPRequest
 			BODY,
 			COMPLETE
 		};
+		/**
+		 * @brief Header fields the server itself looks at, each with a slot
+		 *        in the request so reading them is an array access
+		 */
+		enum HeaderId
+		{
+			HDR_HOST,
+			HDR_CONNECTION,
+			HDR_KEEP_ALIVE,
+			HDR_CONTENT_LENGTH,
+			HDR_CONTENT_TYPE,
+			HDR_TRANSFER_ENCODING,
+			HDR_TRAILER,
+			HDR_TE,
+			HDR_EXPECT,
+			HDR_CACHE_CONTROL,
+			HDR_MAX_FORWARDS,
+			HDR_AUTHORIZATION,
+			HDR_COOKIE,
+			HDR_USER_AGENT,
+			HDR_ACCEPT,
+			HDR_RANGE,
+			HDR_COUNT,
+			HDR_OTHER = HDR_COUNT
+		};
 		/**
 		 * @brief Represents a part in multipart/form-data as defined in RFC 7578 Section 4.1
 		 */
@@ -87,7 +114,18 @@ class HTTPRequest
 
 			FileInfo() : exists(false), isDirectory(false) {}
 		};
-		void					parse(std::vector<char> &data);
+		/**
+		 * @brief A header field as offsets into the request's header block,
+		 *        the value without surrounding OWS. nameLength 0 is unset.
+		 */
+		struct HeaderField {
+			size_t	name;
+			size_t	nameLength;
+			size_t	value;
+			size_t	valueLength;
+		};
+		// Consumes what it parsed from data, a partial line or chunk stays
+		void					parse(Buffer &data);
 		void					determineBodyType(void);
 		void					setRouteMatch(const Config::Route* route, const std::string& remaining);
 		void					setFileInfo(const std::string& path, const std::string& mimeType);
@@ -100,8 +138,15 @@ class HTTPRequest
 		const std::string		&getVersion() const;
 		const URL				&getURL() const;
 		const std::string 		&getUri() const;
-		const std::string		&getHeader(const std::string &key) const;
-		const std::vector<char>	&getBody() const;
+		// Copied out of the header block on each call, empty when absent.
+		// Names match case-insensitively.
+		std::string				getHeader(HeaderId id) const;
+		std::string				getHeader(const std::string &key) const;
+		bool					hasHeader(HeaderId id) const;
+		bool					hasHeader(const std::string &key) const;
+		// HDR_OTHER for names without a slot
+		static HeaderId			classifyHeader(const char* name, size_t length);
+		const BodyStorage		&getBody() const;
 		const Config::Route		*getMatchedRoute() const;
 		const std::string		&getRemainingPath() const;
 		const FileInfo			&getFileInfo() const;
@@ -112,35 +157,78 @@ class HTTPRequest
 		void					print(bool includeBodies = true, bool allHeaders = true, const std::set<std::string>& allowedMimeTypes = std::set<std::string>()) const;
 		void 					printState() const;
 		void					appendToBody(const std::vector<char>& data);
-		int 					getTempFileFd();
-		bool					hasFileOperationsPending() const;
-		void					handleWrite();
+		// Direct body receive: once the headers of a Content-Length request
+		// are parsed and nothing is buffered, the connection reads the body
+		// straight into it. getBodyRemaining() is 0 when that does not apply.
+		size_t					getBodyRemaining() const;
+		// len writable bytes at the end of the body, commitBody() what was read
+		char*					prepareBody(size_t len);
+		// Also called after the sink received body bytes
+		void					commitBody(size_t len);
+		// Headers of a Content-Length request are parsed and no sink was
+		// offered yet: the connection may hand over an UploadSink now
+		bool					wantsBodySink() const;
+		// Takes ownership, NULL keeps the body in memory. What was already
+		// received is moved into the sink.
+		void					setBodySink(UploadSink* sink);
+		UploadSink*				getBodySink() const;
+		// A pool thread still writes body bytes to disk. The request is not
+		// served until diskDone() got it back, and no more body is read
+		// while the writes are backlogged.
+		DiskTask*				getDiskWait() const;
+		bool					isBodyBacklogged() const;
+		// False for a task that is not the body's, HTTPError 500 when the
+		// write failed
+		bool					diskDone(DiskTask* task);
 	private:
-		static const size_t					MEMORY_THRESHOLD = 1024 * 1024; // 1MB
 		RequestState						_state;
 		BodyType							_bodyType;
 		size_t								_bodyLength;
-		long								_chunkLength;
+		// Chunked body decoder, see parseChunkedBody()
+		enum ChunkState
+		{
+			CHUNK_SIZE,
+			CHUNK_SIZE_WS,
+			CHUNK_EXT,
+			CHUNK_SIZE_LF,
+			CHUNK_DATA,
+			CHUNK_DATA_CR,
+			CHUNK_DATA_LF,
+			CHUNK_TRAILER
+		};
+		ChunkState							_chunkState;
+		size_t								_chunkRemaining;	// Size digits so far, then data bytes left
+		size_t								_chunkDigits;
 		std::string							_method;
 		std::string							_uri;
 		URL*								_url;
 		std::string							_version;
-		std::map<std::string, std::string>	_headers;
+		std::vector<char>					_headerBlock;	// Raw header section, kept across reset()
+		HeaderField							_knownHeaders[HDR_COUNT];
+		std::vector<HeaderField>			_headers;		// Fields without a HeaderId
+		size_t								_scanned;		// Bytes of data already searched for a line end
 		std::string							_authorityPath;
-		std::vector<char>					_body;
+		BodyStorage							_body;
+		UploadSink*							_bodySink;		// Raw upload spliced to a file
+		bool								_bodySinkOffered;
 		MultipartState						*_multipartState;
 		RouteMatch							_routeMatch;
 		FileInfo							_fileInfo;
-		TempFile*							_tempFile;
-		bool								_usingTempFile;
-		std::vector<char>					_pendingWrite;  // Buffer for data waiting to be written
-		size_t								_writeOffset;  // Track position in pending write buffer
-		void								parseRequestLine(std::vector<char> &data);
-		void								parseHeaders(std::vector<char>& data, bool isTrailer = false);
-		void								parseBody(std::vector<char>& data);
-		void								parseContentLengthBody(std::vector<char> &data);
-		void								parseChunkedBody(std::vector<char> &data);
-		void								parseMultipartBody(std::vector<char> &data);
+		void								parseRequestLine(Buffer &data);
+		bool								parseHeaders(Buffer& data, bool isTrailer = false);
+		void								parseFields(size_t index, size_t end, bool isTrailer);
+		void								storeField(const HeaderField& field);
+		std::string							fieldValue(const HeaderField& field) const;
+		bool								fieldIs(const HeaderField& field, const char* name, size_t length) const;
+		const HeaderField*					findField(const char* name, size_t length) const;
+		void								clearKnownHeaders();
+		void								setHeader(const std::string& name, const std::string& value);
+		void								removeHeader(const std::string& name);
+		void								parseBody(Buffer& data);
+		void								parseContentLengthBody(Buffer &data);
+		void								parseChunkedBody(Buffer &data);
+		void								finishChunkedBody();
+		void								parseMultipartBody(Buffer &data);
 		void								parseMultipartHeaders(std::vector<char>& headerData, MultipartPart& part);
 };
 
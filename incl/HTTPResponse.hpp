@@ -14,10 +14,11 @@
 #ifndef HTTPRESPONSE_HPP
 # define HTTPRESPONSE_HPP
 
-#include "TempFile.hpp"
 #include "Logger.hpp"
 #include "HTTPError.hpp"
 #include "Utils.hpp"
+#include "OutputQueue.hpp"
+#include "BodySource.hpp"
 #include <sstream>
 #include <string>
 #include <vector>
@@ -28,6 +29,11 @@ class HTTPResponse
 {
 	public:
 		HTTPResponse();
+		// A file body is dup()ed, every copy owns its own descriptor. A
+		// streamed body cannot be duplicated: like std::auto_ptr, the copy
+		// takes it over and other is left without a body.
+		HTTPResponse(const HTTPResponse &other);
+		HTTPResponse &operator=(const HTTPResponse &other);
 		~HTTPResponse();
 		enum ResponseState {
 			CREATING,
@@ -39,30 +45,43 @@ class HTTPResponse
 		void		setHeader(const std::string &key, const std::string &value);
 		void		deleteHeader(const std::string& key);
 		void		setBody(const std::vector<char> &body);
+		void		setBody(const std::string &body);
+		// Takes the contents of body without copying, body gets the old one
+		void		swapBody(std::vector<char> &body);
+		// Body is size bytes of the open file fd, sent with sendfile()
+		// and never read into memory. Takes ownership of fd.
+		void		setBodyFile(int fd, size_t size);
+		bool		hasBodyFile() const;
+		// Body of unknown length, produced while it is sent and sent with
+		// chunked transfer coding. Takes ownership of source.
+		void		setBodySource(BodySource* source);
+		bool		hasBodySource() const;
 		std::vector<char>& getBody() const;
 		void		appendToBody(const char* data, size_t len);
 		std::string getHttpDate();
-		std::vector<char>	serialize() const;
+		std::vector<char>	serialize() const;	// Memory bodies only
+		std::string	serializeHeaders() const;
+		// Queues the header block and hands the body over without copying it;
+		// the response keeps its headers and body size, its body is emptied
+		void		queueTo(OutputQueue &out);
+		void		swap(HTTPResponse &other);
 		size_t		getBodySize() const;
 		void		reset();
 		int			getStatus() const;
 		void		print() const;
-		std::vector<char>					getNextChunk();
 	private:
 		static const size_t					MEMORY_THRESHOLD = 1024 * 1024; // 1MB
-    	static const size_t					CHUNK_SIZE; // 8KB chunks for transfer
 		ResponseState						_state;
-    	TempFile*							_tempFile;
-    	bool								_usingTempFile;
-    	size_t								_readOffset;
-    	std::vector<char>					_sendBuffer;
 		int									_statusCode;
 		std::map<std::string, std::string>	_headers;
 		std::vector<char>					_body;
+		int									_bodyFd;	// File body, or -1
 		size_t								_bodySize;
+		mutable BodySource*					_bodySource;	// Streamed body, or NULL
+		void								dropBodyFile();
+		void								dropBodySource();
 		std::string							getStatusText() const;
 		void								setEssentialHeaders();
-		bool								hasMoreData() const;
 };
 
 #endif // HTTPRESPONSE_HPP
\ No newline at end of file
@@ -26,12 +26,23 @@ namespace HTTPUtils
 {
     bool		isToken(unsigned char c);
     bool		isOWS(unsigned char c);
+    // The (data, size) forms scan any byte range, e.g. a Buffer. They use
+    // SSE2 or AVX2 when the CPU has it, see scanKernel().
+    size_t		findHeaderEnd(const char* data, size_t size, size_t start = 0);
     size_t		findHeaderEnd(const std::vector<char>& data);
+    size_t		findNextColon(const char* data, size_t size, size_t start);
     size_t		findNextColon(const std::vector<char>& data, size_t start);
     std::string	trimOWS(const std::string& value);
+    size_t		findEOL(const char* data, size_t size, size_t start = 0);
     size_t		findEOL(const std::vector<char>& data, size_t start = 0);
 	bool 		hasToken(const std::string& field_value, const std::string& token);
 	bool		removeToken(std::string& field_value, const std::string& token);
+	size_t		findString(const char* data, size_t size, const std::string& str, size_t start = 0);
 	size_t		findString(const std::vector<char>& data, const std::string& str, size_t start = 0);
+	// "avx2", "sse2" or "scalar"
+	const char*	scanKernel();
+	// Switches to another kernel, for bench/scan only. False when the CPU
+	// does not have it.
+	bool		useScanKernel(const std::string& name);
 }
 #endif // HTTPTUtils_HPP
\ No newline at end of file
@@ -17,13 +17,19 @@
 # include <stdexcept>
 # include <unistd.h>
 # include <fcntl.h>
+# include <stdint.h>
 
 # include "EventLoop.hpp"
 
+class DiskTask;
+
 class IOHandler
 {
+	friend class EventLoop;
+
 	protected:
-		explicit		IOHandler(int fd);
+		// isNonBlocking: fd already has O_NONBLOCK (e.g. from accept4), skip the fcntl
+		explicit		IOHandler(int fd, bool isNonBlocking = false);
 		void			setNonBlocking(int fd);
 	public:
 		virtual			~IOHandler() = 0;
@@ -32,7 +38,34 @@ class IOHandler
 		virtual bool	wantsToRead() const = 0;
 		virtual bool	wantsToWrite() const = 0;
 		virtual int		getFd() const = 0;
+		bool			hasPendingIO() const;
+		// Out of buffer memory, see BufferPool: not polled for input until
+		// the pool has room again
+		bool			isStarved() const;
+		// The loop is draining: stop taking new work, finish what is in flight
+		virtual void	onDrain();
+		// DiskPool task the last write is waiting for, see OutputQueue
+		virtual DiskTask*	getDiskWait() const;
+		virtual void	onDiskDone(DiskTask* task);
+		// Completion-style input (see Poller): a handler that names a kind
+		// here gets its accepted fds or received bytes handed in instead of
+		// handleRead() calls, when the backend supports it
+		virtual Poller::Completion	getCompletion() const;
+		// fd is the new socket, or -errno; the handler owns it
+		virtual void	handleAccepted(int fd);
+		// data is only valid during the call; false closes the handler
+		virtual bool	handleReceived(const char* data, size_t len);
+	protected:
+		// Set by a handler that stopped draining its fd on the fairness
+		// budget in edge-triggered mode; the loop gives it another turn
+		void			setPendingIO(bool pending);
+		void			setStarved(bool starved);
 	private:
+		bool			_pendingIO;
+		bool			_starved;
+		uint32_t		_interest;	// Mask last given to the Poller, owned by EventLoop
+		bool			_completes;	// Registered for completions, owned by EventLoop
+		bool			_closing;	// Queued for teardown by EventLoop::removeHandler
 		IOHandler(const IOHandler& src);
 		IOHandler& operator=(const IOHandler& src);
 };
@@ -32,13 +32,18 @@ class LSocket : public Socket
         ~LSocket();
 
         void    	setup(const std::string &host, int port);
-        void    	startListen(int backlog = SOMAXCONN);  // Renamed from listen
+        // Takes over a listening socket inherited in a binary upgrade
+        void    	adopt(int fd);
+        void    	startListen(int backlog);  // Renamed from listen; backlog from the listen directive
+        // NULL once the backlog is empty, or after a connection had to be
+        // dropped because the process ran out of descriptors
         CSocket*    acceptClient();
 
     private:
         static const uint16_t    MIN_PORT = 1024;
         static const uint16_t    MAX_PORT = 65535;
         struct sockaddr_in       _addr;
+        int                      _reserveFd;  // Given up on EMFILE, see shedConnection()
         
         bool    isValidPort(int port) const;
 };
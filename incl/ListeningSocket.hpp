@@ -24,38 +24,63 @@
 # include "IOHandler.hpp"
 # include "ClientConnection.hpp"
 # include "EventLoop.hpp"
+# include "Config.hpp"
+
+class RequestProcessor;
+class ConnectionLimiter;
 
 class ListeningSocket : public IOHandler 
 {
 	public:
-		// Constructor that takes configuration
-		ListeningSocket(const std::string& host, int port);
+		// Takes ownership of a listening socket made by openSocket(), or
+		// inherited from the process we replaced in a binary upgrade. Every
+		// accepted connection has to be admitted by limiter first.
+		ListeningSocket(int fd, const Config::ServerConfig& config,
+			RequestProcessor& processor, ConnectionLimiter& limiter);
 		~ListeningSocket();
 
+		// Creates, binds and listens, non-blocking and close-on-exec. With
+		// reusePort every reactor binds its own socket to the same address
+		// (SO_REUSEPORT) and the kernel load-balances connections between them.
+		static int	openSocket(const Config::ServerConfig& config, bool reusePort);
+		// The tuning options of config for a bound, not yet listening socket:
+		// buffer sizes, TCP_NODELAY (inherited by accepted sockets on Linux),
+		// TCP_DEFER_ACCEPT and TCP_FASTOPEN. Shared with the single reactor.
+		static void	setTcpOptions(int fd, const Config::ServerConfig& config);
+
 		// IOHandler interface implementation
 		virtual bool handleRead();
 		virtual bool handleWrite();
 		virtual bool wantsToRead() const;
 		virtual bool wantsToWrite() const;
 		virtual int getFd() const;
+		// Draining: stop accepting
+		virtual void onDrain();
+		// With io_uring the backend accepts (multishot), one fd per call
+		virtual Poller::Completion getCompletion() const;
+		virtual void handleAccepted(int fd);
 
 		// Get socket info for logging
 		std::string getInfo() const;
 
 	private:
+		const Config::ServerConfig&	_config;
+		RequestProcessor&			_processor;
+		ConnectionLimiter&			_limiter;
 		std::string _host;
 		int         _port;
 		int         _fd;
+		int         _reserveFd;  // Given up on EMFILE, see shedConnection()
 
 		// Prevent copying
 		ListeningSocket(const ListeningSocket&);
 		ListeningSocket& operator=(const ListeningSocket&);
 
 		// Helper methods
-		void setupSocket();
-		void setSocketOptions();
-		void bindSocket();
-		void startListening();
+		bool admit(int clientFd, const struct sockaddr_in& clientAddr);
+		static void setSocketOptions(int fd, bool reusePort);
+		static void bindSocket(int fd, const Config::ServerConfig& config);
+		static void startListening(int fd, int backlog);
 };
 
 #endif // LISTENINGSOCKET_HPP
\ No newline at end of file
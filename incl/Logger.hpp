@@ -37,6 +37,7 @@
 #include <ctime>
 #include <sstream>
 #include <iomanip>
+#include <pthread.h>
 
 enum LogLevel {
     DEBUG,
@@ -51,6 +52,7 @@ private:
     std::ofstream logFile;
     LogLevel currentLevel;
     std::string currentDate;
+    pthread_mutex_t mutex;  // Reactor threads log concurrently
 
     Logger();
     Logger(const Logger&);
@@ -0,0 +1,132 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   OutputQueue.hpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: lwoiton <lwoiton@student.42prague.com>     +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/12/23 19:26:04 by lwoiton           #+#    #+#             */
+/*   Updated: 2024/12/23 19:26:04 by lwoiton          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#pragma once
+#ifndef OUTPUTQUEUE_HPP
+# define OUTPUTQUEUE_HPP
+
+# include <cstddef>
+# include <deque>
+# include <string>
+# include <vector>
+# include <sys/types.h>
+
+class BodySource;
+class DiskTask;
+class FilePrefetch;
+
+/**
+ * @class OutputQueue
+ * @brief Segments waiting to be sent on a socket, gathered into one
+ * sendmsg() per call (a writev() that cannot raise SIGPIPE).
+ *
+ * A response is queued as its header block plus the body. The body
+ * vector is swapped in, not copied, so it reaches the kernel with no
+ * copy on our side. writeTo() gathers up to MAX_IOV segments, starting
+ * at the partly sent front segment, and drops whatever was fully sent.
+ *
+ * A file segment is a range of an open file. When it reaches the front
+ * it goes out with sendfile(), at most SENDFILE_CHUNK bytes per call, so
+ * a download never passes through user space whatever its size. The
+ * memory segments gathered before it are sent with MSG_MORE, so the
+ * header block and the start of the file can share a packet.
+ *
+ * With a DiskPool running, sendfile() is only called on a range that is
+ * in the page cache. A range whose first and last byte cannot be read
+ * with RWF_NOWAIT is read by a pool thread first. Until it is done,
+ * writeTo() fails with EAGAIN and getDiskWait() names the task, which
+ * the owner hands back to diskDone().
+ *
+ * A stream segment is a BodySource of unknown length, optionally framed
+ * with chunked transfer coding. It is pulled in windows of at most
+ * STREAM_WINDOW bytes, and only once the previous window has been sent,
+ * so a streamed response holds at most one window whatever the client's
+ * speed. When the source has nothing ready, writeTo() fails with EAGAIN
+ * and getWaitFd() names the descriptor to wait on.
+ */
+class OutputQueue
+{
+	public:
+		static const int	MAX_IOV = 64;
+		static const size_t	SENDFILE_CHUNK = 1024 * 1024;
+		static const size_t	STREAM_CHUNK = 8192;				// Per read from a source
+		static const size_t	STREAM_WINDOW = 4 * STREAM_CHUNK;	// Buffered per stream
+
+							OutputQueue();
+							~OutputQueue();
+
+		// Copies data: for small pieces like the header block
+		void				push(const std::string& data);
+		// Takes the contents of data without copying, data is left empty
+		void				push(std::vector<char>& data);
+		// Takes ownership of fd and sends length bytes from offset
+		void				pushFile(int fd, off_t offset, size_t length);
+		// Takes ownership of source and streams it until its end
+		void				pushSource(BodySource* source, bool chunked);
+		// One sendmsg() or sendfile(). Returns what it returned, errno is
+		// left as it set it. A file that got shorter is an EIO.
+		ssize_t				writeTo(int fd);
+		// TCP_CORK around multi-call responses (tcp_nopush)
+		void				setCork(bool enabled);
+		// The socket has TCP_NODELAY on already (tcp_nodelay)
+		void				setNodelay(bool enabled);
+		// More than one response is queued: cork them together until the
+		// queue is empty
+		void				setPipelined();
+		bool				empty() const;
+		size_t				size() const;	// Bytes left to send, streams not counted
+		// Source fd the last writeTo() stopped on, or -1
+		int					getWaitFd() const;
+		// Prefetch the front file segment waits for, or NULL
+		DiskTask*			getDiskWait() const;
+		void				diskDone(DiskTask* task);
+		void				clear();
+
+	private:
+		struct Segment
+		{
+			std::vector<char>	data;
+			int					fd;		// -1: a memory segment
+			off_t				offset;	// Next byte of the file to send
+			size_t				length;	// File bytes left
+			size_t				cached;	// Bytes from offset known to be in the page cache
+			BodySource*			source;	// Stream segment: data is the current window
+			bool				chunked;
+			bool				ended;	// The source is exhausted
+
+			Segment() : fd(-1), offset(0), length(0), cached(0), source(NULL), chunked(false), ended(false) {}
+		};
+
+		std::deque<Segment>	_segments;	// None of them empty
+		size_t				_offset;	// Bytes of the front memory segment already sent
+		size_t				_size;
+		bool				_cork;
+		bool				_corked;	// TCP_CORK is set on the socket
+		bool				_pipelined;	// Set until the queue runs empty
+		bool				_nodelay;
+		int					_waitFd;
+		FilePrefetch*		_prefetch;	// In flight for the front file segment
+
+		ssize_t				_sendMemory(int fd);
+		ssize_t				_sendFile(int fd);
+		bool				_prefetchFile(Segment& segment);
+		ssize_t				_sendSource(int fd);
+		bool				_fillWindow(Segment& segment);
+		bool				_needsCork() const;
+		static bool			_setCork(int fd, bool on);
+		void				_popFront();
+
+							OutputQueue(const OutputQueue&);
+		OutputQueue&		operator=(const OutputQueue&);
+};
+
+#endif // OUTPUTQUEUE_HPP
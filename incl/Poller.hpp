@@ -0,0 +1,78 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Poller.hpp                                         :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: lwoiton <lwoiton@student.42prague.com>     +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/12/22 17:40:12 by lwoiton           #+#    #+#             */
+/*   Updated: 2024/12/22 17:40:12 by lwoiton          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#pragma once
+#ifndef POLLER_HPP
+# define POLLER_HPP
+
+# include <cstddef>
+# include <stdint.h>
+
+/**
+ * @class Poller
+ * @brief Readiness backend of the EventLoop.
+ *
+ * Masks use the EPOLL* bits (EPOLLIN, EPOLLOUT, EPOLLET, ...), which have
+ * the same values as their POLL* counterparts. Every registration carries
+ * an opaque tag that is handed back with its events. wait() follows
+ * epoll_wait: it returns the number of events, or -1 with errno set.
+ *
+ * A backend that supportsCompletions() can also do the input itself. A
+ * registration made with ACCEPT_COMPLETION or RECV_COMPLETION then has its
+ * EPOLLIN served by a multishot accept or recv. Instead of EPOLLIN, the
+ * fd's tag comes back with ACCEPTED events (result: the new fd or -errno)
+ * or RECEIVED events (result: the byte count, 0 on EOF, or -errno). The
+ * bytes sit in getBuffer(buffer) until releaseBuffer() is called.
+ */
+class Poller
+{
+	public:
+		enum Completion
+		{
+			NO_COMPLETION,
+			ACCEPT_COMPLETION,
+			RECV_COMPLETION
+		};
+		enum EventKind
+		{
+			READY,		// events holds the EPOLL* bits
+			ACCEPTED,
+			RECEIVED
+		};
+		struct Event
+		{
+			uint64_t	tag;
+			uint32_t	events;
+			uint8_t		kind;
+			uint16_t	buffer;	// RECEIVED with result > 0
+			int32_t		result;
+		};
+
+		virtual				~Poller() {}
+		virtual void		add(int fd, uint32_t events, uint64_t tag) = 0;
+		virtual void		addCompletion(int fd, uint32_t events, uint64_t tag, Completion completion)
+		{
+			(void)completion;
+			add(fd, events, tag);
+		}
+		virtual void		modify(int fd, uint32_t events, uint64_t tag) = 0;
+		virtual void		remove(int fd) = 0;
+		virtual int			wait(Event* events, int maxEvents, int timeoutMs) = 0;
+		virtual const char*	getName() const = 0;
+		// System calls made by the backend itself, for the loop statistics
+		virtual size_t		getSyscalls() const = 0;
+		virtual bool		supportsCompletions() const { return false; }
+		virtual const char*	getBuffer(uint16_t id) const { (void)id; return NULL; }
+		virtual void		releaseBuffer(uint16_t id) { (void)id; }
+};
+
+#endif // POLLER_HPP
@@ -38,6 +38,8 @@ class RequestProcessor
 		HTTPResponse								handleDirectory(const std::string& dirPath, const Config::Route& route) const;
 		HTTPResponse								serveFile(const std::string& filePath, const std::string& mimeType) const;
 		HTTPResponse								handleFileUpload(HTTPRequest &req, const Config::Route* route);
+		HTTPResponse								handleRawUpload(HTTPRequest &req);
+		std::string									rawUploadPath(const HTTPRequest &req) const;
 //		HTTPResponse								handleListFiles(HTTPRequest &req, const Config::Route* route);
 		HTTPResponse								handleFileList(const HTTPRequest& req);
 
@@ -47,6 +49,8 @@ class RequestProcessor
 													RequestProcessor(const std::vector<Config::ServerConfig> &servers);
 													~RequestProcessor();
 		HTTPResponse								processRequest(HTTPRequest &req);
+		// Splice target for a raw upload whose headers were just parsed, or NULL
+		UploadSink*									openBodySink(HTTPRequest &req);
 		void printRoutingTable() const;
 };
 
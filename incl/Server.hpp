@@ -22,15 +22,28 @@
 # include "DataBase.hpp"
 # include "RequestProcessor.hpp"
 # include "CGIProcessor.hpp"
+# include "Worker.hpp"
+# include "FdTable.hpp"
+# include "TimerWheel.hpp"
+# include "AcceptHistogram.hpp"
+# include "ConnectionLimiter.hpp"
 # include <map>
 # include <memory>
 
-# define BACKLOG 4096
-
+/**
+ * Signals are taken from a signalfd, never from async handlers:
+ * - SIGINT: stop right away.
+ * - SIGTERM, SIGQUIT: drain. Listeners close, idle connections close, the
+ *   ones in flight finish their response; shutdown_timeout caps the wait.
+ * - SIGUSR2: binary upgrade. argv[0] is exec'ed in a child that inherits
+ *   the listening sockets (WEBSERV_LISTEN_FDS) and takes them over without
+ *   an accept gap. Once it is listening it sends SIGTERM to this process,
+ *   which then drains. If the new binary fails, the old one keeps serving.
+ */
 class Server
 {
     public:
-									Server(const std::string &configPath);
+									Server(const std::string &configPath, char* const* argv = NULL);
         virtual                     ~Server();
 
         virtual void                run();
@@ -39,15 +52,56 @@ class Server
     private:
         std::auto_ptr<Config>		_config;
         std::auto_ptr<EpollManager>	_epoll;
-        std::map<int, LSocket*>		_listenSockets;
-        std::map<int, Connection*>	_connections;
+        FdTable<LSocket>			_listenSockets;	// kind 1
+        FdTable<Connection>			_connections;	// kind 2
+        FdTable<const Config::ServerConfig>	_listenConfigs;	// Server block per listen fd
+        FdTable<Connection>         _bodySources;   // kind 3, by the source fd a connection waits on
+        TimerWheel                  _timers;
+        AcceptHistogram             _acceptHistogram;
+        ConnectionLimiter           _limiter;       // Shared with the workers
         RequestProcessor            _reqProc;
         bool                        _isRunning;
+        std::vector<Worker*>        _workers;
+
+        static const uint64_t       SIGNAL_TAG = ~0ULL;  // signalfd in the legacy epoll set
+        static const uint64_t       DISK_TAG = ~1ULL;    // DiskCompletions eventfd
+
+        struct ListenFd
+        {
+            int                     fd;
+            std::string             address;    // host:port
+        };
+        char* const*                _argv;          // Re-exec'ed on SIGUSR2, NULL disables upgrades
+        int                         _signalFd;
+        pid_t                       _upgradePid;    // New binary not yet confirmed, or 0
+        bool                        _draining;
+        uint64_t                    _drainDeadline; // TimerWheel::now() based
+        std::multimap<std::string, int>	_inherited;	// From the process we replaced
+        std::vector<ListenFd>       _listenFds;     // Handed on in an upgrade
+        std::vector<uint64_t>       _starved;       // Connection tags paused on the buffer budget
 
+        void                        _setupSignals();
+        void                        _loadInheritedListeners();
+        int                         _takeInherited(const std::string& address);
+        void                        _notifyParent();
+        void                        _handleSignals();
+        void                        _beginDrain();
+        void                        _upgrade();
+        void                        _reapUpgrade();
+        static std::string          _addressOf(const Config::ServerConfig& server);
+        void                        _addListener(LSocket* socket, const Config::ServerConfig& server);
+        void                        _closeUnusedInherited();
         void                        _setupListeners();
+        void                        _runWorkers();
         void                        _handleEvents();
         void                        _acceptConnection(LSocket* socket);
         void                        _handleConnection(Connection* conn, uint32_t events);
+        void                        _serveRequests(Connection* conn);
+        void                        _watchConnection(Connection* conn);
+        void                        _resumeStarved();
+        void                        _waitForBodySource(Connection* conn);
+        void                        _completeDiskTasks();
+        void                        _resumeBodySource(int sourceFd);
         void                        _cleanupConnection(int fd);
                                     
                                     Server();
@@ -0,0 +1,99 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   TimerWheel.hpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: lwoiton <lwoiton@student.42prague.com>     +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/12/22 10:14:05 by lwoiton           #+#    #+#             */
+/*   Updated: 2024/12/22 10:14:05 by lwoiton          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#pragma once
+#ifndef TIMERWHEEL_HPP
+# define TIMERWHEEL_HPP
+
+# include <cstddef>
+# include <stdint.h>
+
+class TimerWheel;
+
+/**
+ * @class Timer
+ * @brief Intrusive timer node, meant to be inherited by the object it times.
+ *
+ * The links live inside the object, so arming, re-arming and cancelling
+ * never allocate. Destroying an armed timer unlinks it from its wheel.
+ */
+class Timer
+{
+	friend class TimerWheel;
+
+	public:
+						Timer();
+		virtual			~Timer();
+		bool			isArmed() const;
+	protected:
+		// Called by TimerWheel::advance() after the timer was unlinked.
+		// The object may delete itself from here.
+		virtual void	onTimeout() = 0;
+	private:
+		Timer*			_prev;
+		Timer*			_next;
+		Timer**			_bucket;	// List head of the slot we are linked into
+		uint64_t		_expires;	// Absolute tick
+		TimerWheel*		_wheel;		// NULL while disarmed
+
+						Timer(const Timer&);
+		Timer&			operator=(const Timer&);
+};
+
+/**
+ * @class TimerWheel
+ * @brief Hierarchical timing wheel (LEVELS x SLOTS buckets of TICK_MS).
+ *
+ * Level 0 holds timers due within the next SLOTS ticks, each higher level
+ * covers SLOTS times the range of the one below. Scheduling is an index
+ * computation and a list insert; timers are moved down a level when the
+ * lower wheel wraps. Deadlines are rounded up to the next tick, and the
+ * longest schedulable delay is clamped to the range of the top level.
+ *
+ * The owning loop passes nextTimeout() to epoll_wait and calls advance()
+ * after every wakeup.
+ */
+class TimerWheel
+{
+	public:
+		static const uint64_t	TICK_MS = 100;
+
+						TimerWheel();
+						~TimerWheel();
+		void			schedule(Timer& timer, uint64_t delayMs);
+		void			cancel(Timer& timer);
+		// Milliseconds until the wheel next needs to run, -1 if nothing is armed
+		int				nextTimeout(uint64_t nowMs) const;
+		// Fires every timer due at nowMs, returns how many fired
+		size_t			advance(uint64_t nowMs);
+		size_t			size() const;
+		// CLOCK_MONOTONIC in milliseconds
+		static uint64_t	now();
+	private:
+		static const int		LEVELS = 4;
+		static const int		SLOT_BITS = 6;
+		static const int		SLOTS = 1 << SLOT_BITS;
+		static const uint64_t	SLOT_MASK = SLOTS - 1;
+
+		Timer*			_slots[LEVELS][SLOTS];
+		uint64_t		_tick;		// Last tick processed
+		size_t			_count;
+
+		void			link(Timer& timer);
+		void			unlink(Timer& timer);
+		void			cascade(int level);
+
+						TimerWheel(const TimerWheel&);
+		TimerWheel&		operator=(const TimerWheel&);
+};
+
+#endif // TIMERWHEEL_HPP
@@ -0,0 +1,79 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   UploadSink.hpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: lwoiton <lwoiton@student.42prague.com>     +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/12/24 16:12:40 by lwoiton           #+#    #+#             */
+/*   Updated: 2024/12/24 16:12:40 by lwoiton          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#pragma once
+#ifndef UPLOADSINK_HPP
+# define UPLOADSINK_HPP
+
+# include <cstddef>
+# include <string>
+# include <sys/types.h>
+
+# include "FileWriter.hpp"
+
+/**
+ * @class UploadSink
+ * @brief Writes a raw request body to a file with splice(), socket to
+ * pipe to file, so the upload never passes through user space.
+ *
+ * The body goes to a hidden temporary file next to the target. finish()
+ * renames it into place once the body is complete. A sink destroyed
+ * before that removes the temporary file, so an aborted upload leaves
+ * neither a truncated target nor any leftovers.
+ *
+ * receive() is non-blocking on the socket side. The pipe is emptied into
+ * the file by a FileWriter: with a DiskPool a pool thread does it, and no
+ * receive() may follow while isBacklogged(). Bytes already
+ * in user space go in through write(). The upload is only complete once
+ * nothing is in flight any more.
+ */
+class UploadSink
+{
+	public:
+		// Creates the temporary file for path, throws on failure
+							UploadSink(const std::string& path, size_t length);
+							~UploadSink();
+
+		// At most max bytes from the socket into the file. Returns what
+		// read() would: 0 on EOF, -1 with errno set (EAGAIN included).
+		ssize_t				receive(int sockFd, size_t max);
+		// Body bytes that were already read into user space
+		void				write(const char* data, size_t len);
+		DiskTask*			getDiskWait() const;
+		bool				isBacklogged() const;
+		// False for a task that is not ours, see FileWriter
+		bool				diskDone(DiskTask* task);
+		size_t				getReceived() const;
+		size_t				getRemaining() const;
+		const std::string&	getPath() const;
+		// Moves the complete file into place, throws on failure
+		void				finish();
+
+	private:
+		std::string			_path;
+		std::string			_tmpPath;
+		int					_fd;
+		int					_pipe[2];
+		size_t				_pipeSize;
+		size_t				_length;
+		size_t				_received;
+		bool				_finished;
+		FileWriter			_writer;
+
+		static size_t		_counter;	// For unique temporary names
+
+
+							UploadSink(const UploadSink&);
+		UploadSink&			operator=(const UploadSink&);
+};
+
+#endif // UPLOADSINK_HPP
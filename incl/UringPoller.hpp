@@ -0,0 +1,142 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   UringPoller.hpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: lwoiton <lwoiton@student.42prague.com>     +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/12/22 17:40:12 by lwoiton           #+#    #+#             */
+/*   Updated: 2024/12/22 17:40:12 by lwoiton          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#pragma once
+#ifndef URINGPOLLER_HPP
+# define URINGPOLLER_HPP
+
+# include <vector>
+# include <linux/io_uring.h>
+
+# include "Poller.hpp"
+
+/**
+ * @class UringPoller
+ * @brief io_uring backend, talking to the kernel through the raw syscalls.
+ *
+ * Registrations become IORING_OP_POLL_ADD requests that are only queued
+ * in the submission ring; they reach the kernel together with the wait,
+ * so a turn of the loop costs one io_uring_enter instead of a series of
+ * epoll_ctl calls followed by epoll_wait.
+ *
+ * Level-triggered registrations use one-shot polls that are re-armed
+ * before the next wait. With EPOLLET the poll is multishot and only
+ * re-armed when the kernel ends it. Every poll carries a per-fd sequence
+ * number in its user_data, so completions of a poll that was replaced or
+ * removed meanwhile are dropped here.
+ *
+ * Completion registrations (see Poller) keep a multishot accept or recv
+ * in flight while EPOLLIN is in their mask; the poll, if any, only waits
+ * for EPOLLOUT. Received data lands in a ring of RECV_BUFFERS provided
+ * buffers registered with the kernel (2 MB per loop, outside the
+ * io_buffer_budget), so no recv() or accept4() is made.
+ * These operations carry a per-fd generation that only changes on add()
+ * and remove(). A recv cancelled because EPOLLIN left the mask still
+ * delivers the bytes it took, while one of a closed fd is dropped. Needs
+ * Linux 6.0 (multishot recv); older kernels keep readiness polls.
+ *
+ * Needs IORING_FEAT_EXT_ARG (Linux 5.11) for waits with a timeout; the
+ * constructor throws if io_uring is missing or disabled.
+ */
+class UringPoller : public Poller
+{
+	public:
+							UringPoller(unsigned entries = 256);
+							~UringPoller();
+		virtual void		add(int fd, uint32_t events, uint64_t tag);
+		virtual void		addCompletion(int fd, uint32_t events, uint64_t tag, Completion completion);
+		virtual void		modify(int fd, uint32_t events, uint64_t tag);
+		virtual void		remove(int fd);
+		virtual int			wait(Event* events, int maxEvents, int timeoutMs);
+		virtual const char*	getName() const;
+		virtual size_t		getSyscalls() const;
+		virtual bool		supportsCompletions() const;
+		virtual const char*	getBuffer(uint16_t id) const;
+		virtual void		releaseBuffer(uint16_t id);
+	private:
+		struct FdState
+		{
+			uint64_t	tag;
+			uint32_t	events;
+			uint32_t	seq;		// Matches the user_data of the live poll
+			uint32_t	gen;		// Matches the user_data of the accept or recv
+			Completion	completion;
+			bool		active;		// Registered with the poller
+			bool		armed;		// A poll request is in flight
+			bool		opArmed;	// The accept or recv has not ended yet
+			bool		opCancelling;
+
+			FdState() : tag(0), events(0), seq(0), gen(0), completion(NO_COMPLETION)
+				, active(false), armed(false), opArmed(false), opCancelling(false) {}
+		};
+		// Top two bits of user_data, below them 30 bits of seq or gen and the fd
+		enum Op
+		{
+			OP_POLL,
+			OP_ACCEPT,
+			OP_RECV
+		};
+		// One mmap'ed ring shared with the kernel
+		struct Ring
+		{
+			void*		base;
+			size_t		size;
+		};
+		static const uint64_t	CANCEL_DATA = ~0ULL;	// user_data of cancel requests
+		static const uint32_t	SEQ_MASK = 0x3fffffff;
+		static const unsigned	RECV_BUFFERS = 128;		// Power of two
+		static const size_t		RECV_BUFFER_SIZE = 16 * 1024;
+		static const uint16_t	BUFFER_GROUP = 0;
+
+		int						_ringFd;
+		Ring					_sqRing;
+		Ring					_cqRing;
+		Ring					_sqes;
+		unsigned*				_sqHead;
+		unsigned*				_sqTail;
+		unsigned*				_sqMask;
+		unsigned*				_sqArray;
+		unsigned				_sqEntries;
+		struct io_uring_sqe*	_sqeBase;
+		unsigned*				_cqHead;
+		unsigned*				_cqTail;
+		unsigned*				_cqMask;
+		struct io_uring_cqe*	_cqes;
+		unsigned				_toSubmit;		// Queued since the last io_uring_enter
+		size_t					_syscalls;
+		std::vector<FdState>	_fds;
+		std::vector<int>		_rearm;			// Polls and operations that ended
+		struct io_uring_buf_ring*	_bufRing;	// NULL without completions
+		size_t					_bufRingSize;
+		char*					_buffers;
+		uint16_t				_bufTail;
+
+		FdState&				state(int fd);
+		struct io_uring_sqe*	nextSqe();
+		static uint64_t			userData(Op op, uint32_t seq, int fd);
+		uint32_t				pollMask(const FdState& fdState) const;
+		void					armPoll(int fd);
+		void					cancelPoll(int fd);
+		void					setupBuffers();
+		void					updateOp(int fd);
+		void					armOp(int fd);
+		void					cancelOp(int fd);
+		void					dropOp(int fd);
+		bool					takeCompletion(const struct io_uring_cqe& cqe, Event& event);
+		int						enter(unsigned toSubmit, unsigned minComplete, int timeoutMs);
+		void					unmap();
+
+								UringPoller(const UringPoller&);
+		UringPoller&			operator=(const UringPoller&);
+};
+
+#endif // URINGPOLLER_HPP
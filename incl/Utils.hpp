@@ -36,4 +36,8 @@ std::string toString(T value) {
 }
 void setNonBlocking(int fd);
 void setPipeBufferSize(int pipefd);
+int openReserveFd();
+bool shedConnection(int listenFd, int& reserveFd);
+void resetSignalMask();
+void setAbortiveClose(int fd);
 #endif // UTILS_HPP
\ No newline at end of file
@@ -0,0 +1,77 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Worker.hpp                                         :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: lwoiton <lwoiton@student.42prague.com>     +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/12/21 10:12:03 by lwoiton           #+#    #+#             */
+/*   Updated: 2024/12/21 10:12:03 by lwoiton          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+
+#pragma once
+#ifndef WORKER_HPP
+# define WORKER_HPP
+
+# include <pthread.h>
+# include <vector>
+
+# include "Config.hpp"
+# include "EventLoop.hpp"
+# include "ConnectionLimiter.hpp"
+
+/**
+ * @class Worker
+ * @brief One reactor thread: its own EventLoop, listeners and RequestProcessor.
+ *
+ * Every worker gets its own listening socket for each `listen` directive,
+ * bound with SO_REUSEPORT, so the kernel spreads new connections across the
+ * workers and a connection stays on the core that accepted it. The sockets
+ * are opened (or inherited in a binary upgrade) by the Server and handed over
+ * with addListener() before start(). Apart from the read-only Config, the
+ * workers only share the ConnectionLimiter.
+ */
+class Worker
+{
+	public:
+							Worker(size_t id, const Config& config, ConnectionLimiter& limiter);
+							~Worker();
+
+		void				addListener(int fd, const Config::ServerConfig& server);
+		void				start();
+		void				stop();
+		// Stop accepting and exit once the open connections are done
+		void				drain();
+		void				join();
+		size_t				getId() const;
+		bool				isFinished();
+
+	private:
+		struct Listener
+		{
+			int							fd;
+			const Config::ServerConfig*	server;
+		};
+
+		size_t				_id;
+		const Config&		_config;
+		ConnectionLimiter&	_limiter;
+		std::vector<Listener>	_listeners;
+		pthread_t			_thread;
+		bool				_started;
+		bool				_stopRequested;
+		bool				_drainRequested;
+		bool				_finished;
+		EventLoop*			_loop;		// Published by the worker thread while it runs
+		pthread_mutex_t		_lock;		// Guards _loop, the requests and _finished
+
+		static void*		_threadMain(void* arg);
+		void				_run();
+
+							Worker(const Worker&);
+		Worker&				operator=(const Worker&);
+};
+
+#endif // WORKER_HPP
@@ -0,0 +1,65 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   AcceptHistogram.cpp                                :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: lwoiton <lwoiton@student.42prague.com>     +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/12/22 14:02:37 by lwoiton           #+#    #+#             */
+/*   Updated: 2024/12/22 14:02:37 by lwoiton          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "AcceptHistogram.hpp"
+#include <sstream>
+
+AcceptHistogram::AcceptHistogram()
+	: _wakeups(0)
+	, _accepted(0)
+{
+	for (int i = 0; i < BUCKETS; i++)
+		_counts[i] = 0;
+}
+
+void	AcceptHistogram::record(size_t accepted)
+{
+	int bucket = 0;
+
+	while (accepted >> bucket && bucket < BUCKETS - 1)
+		bucket++;
+	_counts[bucket]++;
+	_wakeups++;
+	_accepted += accepted;
+}
+
+size_t	AcceptHistogram::getWakeups() const
+{
+	return _wakeups;
+}
+
+size_t	AcceptHistogram::getAccepted() const
+{
+	return _accepted;
+}
+
+// "0:3 1:120 2-3:17 4-7:2 ..." skipping empty buckets
+std::string	AcceptHistogram::toString() const
+{
+	std::stringstream ss;
+
+	for (int i = 0; i < BUCKETS; i++)
+	{
+		if (_counts[i] == 0)
+			continue;
+		if (ss.tellp() > 0)
+			ss << " ";
+		if (i <= 1)
+			ss << i;
+		else if (i == BUCKETS - 1)
+			ss << (1 << (i - 1)) << "+";
+		else
+			ss << (1 << (i - 1)) << "-" << (1 << i) - 1;
+		ss << ":" << _counts[i];
+	}
+	return ss.str();
+}
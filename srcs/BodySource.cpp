@@ -0,0 +1,72 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   BodySource.cpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: lwoiton <lwoiton@student.42prague.com>     +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/12/24 17:05:12 by lwoiton           #+#    #+#             */
+/*   Updated: 2024/12/24 17:05:12 by lwoiton          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "BodySource.hpp"
+#include <cerrno>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+BodySource::~BodySource()
+{
+}
+
+int	BodySource::getFd() const
+{
+	return -1;
+}
+
+PipeSource::PipeSource(int fd, pid_t pid)
+	: _fd(fd)
+	, _pid(pid)
+{
+}
+
+PipeSource::~PipeSource()
+{
+	if (_fd != -1)
+		close(_fd);
+	_reap(true);
+}
+
+ssize_t	PipeSource::read(char* buffer, size_t len)
+{
+	ssize_t n;
+
+	do
+		n = ::read(_fd, buffer, len);
+	while (n == -1 && errno == EINTR);
+	if (n == 0)
+		_reap(false);
+	return n;
+}
+
+int	PipeSource::getFd() const
+{
+	return _fd;
+}
+
+// The child closed its output, it is normally gone or about to be. With
+// force it is killed first, since nobody will read what it writes.
+void	PipeSource::_reap(bool force)
+{
+	if (_pid <= 0)
+		return;
+	if (waitpid(_pid, NULL, WNOHANG) == 0)
+	{
+		if (!force)
+			return;
+		kill(_pid, SIGKILL);
+		waitpid(_pid, NULL, 0);
+	}
+	_pid = -1;
+}
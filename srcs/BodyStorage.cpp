@@ -0,0 +1,282 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   BodyStorage.cpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: lwoiton <lwoiton@student.42prague.com>     +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/12/24 18:05:12 by lwoiton           #+#    #+#             */
+/*   Updated: 2024/12/24 18:05:12 by lwoiton          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "BodyStorage.hpp"
+#include "HTTPError.hpp"
+#include "Logger.hpp"
+#include "Utils.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+
+size_t		BodyStorage::_memoryLimit = 16 * 1024;
+size_t		BodyStorage::_memfdLimit = 1024 * 1024;
+std::string	BodyStorage::_spoolDir = "/tmp";
+
+BodyStorage::BodyStorage()
+	: _fd(-1)
+	, _size(0)
+	, _prepared(0)
+	, _expected(0)
+	, _tier(MEMORY)
+{
+}
+
+BodyStorage::~BodyStorage()
+{
+	_writer.closeFd(_fd);
+}
+
+void	BodyStorage::configure(size_t memoryLimit, size_t memfdLimit, const std::string& spoolDir)
+{
+	_memoryLimit = memoryLimit;
+	_memfdLimit = memfdLimit;
+	_spoolDir = spoolDir;
+	if (access(spoolDir.c_str(), W_OK | X_OK) == -1)
+		LOG_WARNING("client_body_temp_path " + spoolDir + " is not writable: " + strerror(errno));
+}
+
+// A known length goes to its final tier with the first byte, a body
+// that never arrives here (a spliced upload) costs nothing
+void	BodyStorage::expect(size_t length)
+{
+	_expected = length;
+	if (length <= _memoryLimit)
+		_memory.reserve(length);
+}
+
+void	BodyStorage::append(const char* data, size_t len)
+{
+	if (len == 0)
+		return;
+	_reserve(_size + len);
+	if (_tier == MEMORY)
+		_memory.insert(_memory.end(), data, data + len);
+	else
+		_write(_tier, data, len, _size);
+	_size += len;
+}
+
+char*	BodyStorage::prepare(size_t len)
+{
+	_reserve(_size + len);
+	_prepared = len;
+	if (_tier == MEMORY)
+	{
+		_memory.resize(_size + len);
+		return &_memory[_size];
+	}
+	_memory.resize(len);
+	return &_memory[0];
+}
+
+// Drops the prepared bytes that were not filled
+void	BodyStorage::commit(size_t len)
+{
+	len = std::min(len, _prepared);
+	_prepared = 0;
+	if (_tier == MEMORY)
+		_memory.resize(_size + len);
+	else if (len > 0)
+		_write(_tier, &_memory[0], len, _size);
+	_size += len;
+}
+
+void	BodyStorage::clear()
+{
+	_writer.closeFd(_fd);
+	_writer.reset();
+	_fd = -1;
+	_size = 0;
+	_prepared = 0;
+	_expected = 0;
+	_tier = MEMORY;
+	// A keep-alive connection should not hold on to a large body
+	if (_memory.capacity() > _memoryLimit)
+		std::vector<char>().swap(_memory);
+	else
+		_memory.clear();
+}
+
+DiskTask*	BodyStorage::getDiskWait() const
+{
+	return _writer.getDiskWait();
+}
+
+bool	BodyStorage::isBacklogged() const
+{
+	return _writer.isBacklogged();
+}
+
+bool	BodyStorage::diskDone(DiskTask* task)
+{
+	return _writer.diskDone(task);
+}
+
+size_t	BodyStorage::size() const
+{
+	return _size;
+}
+
+bool	BodyStorage::empty() const
+{
+	return _size == 0;
+}
+
+BodyStorage::Tier	BodyStorage::getTier() const
+{
+	return _tier;
+}
+
+size_t	BodyStorage::read(size_t offset, char* buffer, size_t len) const
+{
+	if (offset >= _size)
+		return 0;
+	len = std::min(len, _size - offset);
+	if (_tier == MEMORY)
+	{
+		std::memcpy(buffer, &_memory[offset], len);
+		return len;
+	}
+	size_t done = 0;
+	while (done < len)
+	{
+		ssize_t n = pread(_fd, buffer + done, len - done, offset + done);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			throw HTTPError(500, std::string("Failed to read request body: ") + strerror(errno));
+		done += n;
+	}
+	return done;
+}
+
+ssize_t	BodyStorage::sendTo(int fd, size_t& offset) const
+{
+	if (offset >= _size)
+		return 0;
+	ssize_t n;
+	if (_tier == MEMORY)
+		n = ::write(fd, &_memory[offset], _size - offset);
+	else
+	{
+		off_t pos = offset;
+		n = sendfile(fd, _fd, &pos, _size - offset);
+	}
+	if (n > 0)
+		offset += n;
+	return n;
+}
+
+int		BodyStorage::getFd() const
+{
+	return _fd;
+}
+
+std::string	BodyStorage::str() const
+{
+	if (_tier == MEMORY)
+		return std::string(_memory.begin(), _memory.begin() + _size);
+	std::string body(_size, '\0');
+	if (_size > 0)
+		read(0, &body[0], _size);
+	return body;
+}
+
+// Moves up to the tier that holds total bytes, never back down
+void	BodyStorage::_reserve(size_t total)
+{
+	total = std::max(total, _expected);
+	if (total > _memfdLimit && _tier != SPOOL)
+		_moveTo(SPOOL);
+	else if (total > _memoryLimit && _tier == MEMORY)
+		_moveTo(MEMFD);
+}
+
+void	BodyStorage::_moveTo(Tier tier)
+{
+	int fd = _open(tier);
+	int from = _fd;
+
+	_fd = fd;
+	LOG_DEBUG("Request body of " + toString(_size) + " bytes moves to "
+		+ (tier == MEMFD ? std::string("memfd") : _spoolDir));
+	try {
+		if (_tier == MEMORY)
+		{
+			if (_size > 0)
+				_write(tier, &_memory[0], _size, 0);
+			_memory.clear();
+		}
+		else
+			_writer.copy(_fd, 0, from, 0, _size);  // memfd to spool file
+	} catch (...) {
+		_fd = from;
+		_writer.closeFd(fd);
+		throw;
+	}
+	_writer.closeFd(from);
+	_tier = tier;
+}
+
+// Falls back to the spool directory when memfd is not available
+int		BodyStorage::_open(Tier& tier) const
+{
+	int fd = -1;
+	if (tier == MEMFD)
+	{
+		fd = memfd_create("webserv-body", MFD_CLOEXEC);
+		if (fd != -1)
+			return fd;
+		tier = SPOOL;
+	}
+	fd = open(_spoolDir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+	if (fd == -1 && (errno == EOPNOTSUPP || errno == EISDIR || errno == EINVAL))
+	{
+		// No O_TMPFILE on this filesystem: a named file, unlinked right away
+		std::string path = _spoolDir + "/.webserv-body-XXXXXX";
+		std::vector<char> name(path.begin(), path.end());
+		name.push_back('\0');
+		fd = mkostemp(&name[0], O_CLOEXEC);
+		if (fd != -1)
+			unlink(&name[0]);
+	}
+	if (fd == -1)
+		throw HTTPError(500, "Cannot spool request body to " + _spoolDir + ": " + strerror(errno));
+	return fd;
+}
+
+// pwrite() leaves the file offset alone, a child may read from it. The
+// memfd is RAM and written right here.
+void	BodyStorage::_write(Tier tier, const char* data, size_t len, size_t offset)
+{
+	if (tier == SPOOL)
+	{
+		_writer.write(_fd, offset, data, len);
+		return;
+	}
+	size_t done = 0;
+	while (done < len)
+	{
+		ssize_t n = pwrite(_fd, data + done, len - done, offset + done);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			throw HTTPError(500, std::string("Failed to write request body: ") + strerror(errno));
+		done += n;
+	}
+}
@@ -0,0 +1,112 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Buffer.cpp                                         :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: lwoiton <lwoiton@student.42prague.com>     +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/12/23 15:07:52 by lwoiton           #+#    #+#             */
+/*   Updated: 2024/12/23 15:07:52 by lwoiton          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "Buffer.hpp"
+#include "BufferPool.hpp"
+#include <cstring>
+#include <algorithm>
+
+Buffer::Buffer()
+	: _data(NULL)
+	, _capacity(0)
+	, _start(0)
+	, _end(0)
+{
+}
+
+Buffer::~Buffer()
+{
+	_release();
+}
+
+bool	Buffer::append(const char* data, size_t len, bool overBudget)
+{
+	if (len == 0)
+		return true;
+	char* dst = prepare(len, overBudget);
+	if (!dst)
+		return false;
+	std::memcpy(dst, data, len);
+	commit(len);
+	return true;
+}
+
+bool	Buffer::append(const std::vector<char>& data)
+{
+	return data.empty() || append(&data[0], data.size());
+}
+
+char*	Buffer::prepare(size_t len, bool overBudget)
+{
+	if (_capacity - _end >= len)
+		return _data + _end;
+
+	size_t used = size();
+	// Compact once the consumed prefix is at least as big as what is left
+	if (_start > 0 && _start >= used && _capacity - used >= len)
+	{
+		std::memmove(_data, _data + _start, used);
+		_start = 0;
+		_end = used;
+		return _data + _end;
+	}
+
+	BufferPool&	pool = BufferPool::local();
+	size_t		capacity = std::max(std::max(_capacity * 2, used + len), BufferPool::BLOCK_BYTES);
+	char*		data = (capacity == BufferPool::BLOCK_BYTES)
+		? pool.acquire(overBudget) : pool.allocate(capacity, overBudget);
+	if (!data)
+		return NULL;
+	if (used > 0)
+		std::memcpy(data, _data + _start, used);
+	_release();
+	_data = data;
+	_capacity = capacity;
+	_start = 0;
+	_end = used;
+	return _data + _end;
+}
+
+void	Buffer::commit(size_t len)
+{
+	_end += len;
+}
+
+void	Buffer::consume(size_t len)
+{
+	if (len >= size())
+	{
+		clear();
+		return;
+	}
+	_start += len;
+}
+
+// Drops the data and hands the storage back to the pool
+void	Buffer::clear()
+{
+	_release();
+	_start = 0;
+	_end = 0;
+}
+
+void	Buffer::_release()
+{
+	if (!_data)
+		return;
+	if (_capacity == BufferPool::BLOCK_BYTES)
+		BufferPool::local().release(_data);
+	else
+		BufferPool::local().deallocate(_data, _capacity);
+	_data = NULL;
+	_capacity = 0;
+}
@@ -0,0 +1,195 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   BufferPool.cpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: lwoiton <lwoiton@student.42prague.com>     +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/12/24 11:18:45 by lwoiton           #+#    #+#             */
+/*   Updated: 2024/12/24 11:18:45 by lwoiton          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "BufferPool.hpp"
+#include <cstdlib>
+#include <stdint.h>
+
+const size_t			BufferPool::BLOCK_BYTES;	// Taken by reference by std::min()
+const size_t			BufferPool::SLAB_BLOCKS;
+const size_t			BufferPool::SLAB_BYTES;
+__thread BufferPool*	BufferPool::_local = NULL;
+size_t					BufferPool::_budget = 0;
+volatile size_t			BufferPool::_charged = 0;
+
+BufferPool::BufferPool()
+	: _emptySlabs(0)
+	, _denied(0)
+{
+}
+
+// Every block of this thread has to be back by now
+BufferPool::~BufferPool()
+{
+	for (size_t i = 0; i < _slabs.size(); i++)
+		std::free(_slabs[i]);
+	_uncharge(_slabs.size() * SLAB_BYTES);
+}
+
+BufferPool&	BufferPool::local()
+{
+	if (!_local)
+		_local = new BufferPool();
+	return *_local;
+}
+
+void	BufferPool::destroyLocal()
+{
+	delete _local;
+	_local = NULL;
+}
+
+// Set once at startup, before the reactors run
+void	BufferPool::setBudget(size_t bytes)
+{
+	_budget = bytes;
+}
+
+size_t	BufferPool::getBudget()
+{
+	return _budget;
+}
+
+size_t	BufferPool::getCharged()
+{
+	return __sync_fetch_and_add(&_charged, 0);
+}
+
+bool	BufferPool::hasRoom()
+{
+	return _budget == 0 || getCharged() + SLAB_BYTES <= _budget;
+}
+
+char*	BufferPool::acquire(bool overBudget)
+{
+	if (_free.empty() && !_newSlab(overBudget))
+	{
+		_denied++;
+		return NULL;
+	}
+	char* block = _free.back();
+	_free.pop_back();
+	Slab* slab = _slabOf(block);
+	if (slab->freeBlocks-- == SLAB_BLOCKS - 1)
+		_emptySlabs--;
+	return block;
+}
+
+// A slab that runs empty is kept as the spare, unless there is one already
+// or the other reactors are short of budget; those are uncharged right away
+void	BufferPool::release(char* block)
+{
+	if (!block)
+		return;
+	_free.push_back(block);
+	Slab* slab = _slabOf(block);
+	if (++slab->freeBlocks < SLAB_BLOCKS - 1)
+		return;
+	if (_emptySlabs > 0 || !hasRoom())
+		_freeSlab(slab);
+	else
+		_emptySlabs++;
+}
+
+char*	BufferPool::allocate(size_t size, bool overBudget)
+{
+	if (!_charge(size, overBudget))
+	{
+		_denied++;
+		return NULL;
+	}
+	char* data = static_cast<char*>(std::malloc(size));
+	if (!data)
+	{
+		_uncharge(size);
+		_denied++;
+	}
+	return data;
+}
+
+void	BufferPool::deallocate(char* data, size_t size)
+{
+	if (!data)
+		return;
+	std::free(data);
+	_uncharge(size);
+}
+
+size_t	BufferPool::getFreeBlocks() const
+{
+	return _free.size();
+}
+
+size_t	BufferPool::getDenied() const
+{
+	return _denied;
+}
+
+bool	BufferPool::_charge(size_t bytes, bool overBudget)
+{
+	size_t charged = __sync_add_and_fetch(&_charged, bytes);
+	if (_budget == 0 || charged <= _budget || overBudget)
+		return true;
+	__sync_sub_and_fetch(&_charged, bytes);
+	return false;
+}
+
+void	BufferPool::_uncharge(size_t bytes)
+{
+	__sync_sub_and_fetch(&_charged, bytes);
+}
+
+BufferPool::Slab*	BufferPool::_slabOf(const char* block)
+{
+	return reinterpret_cast<Slab*>(reinterpret_cast<uintptr_t>(block) & ~(SLAB_BYTES - 1));
+}
+
+// Puts the blocks of a new slab on the free list, the first one keeps the
+// header. The slab counts as empty until acquire() takes a block.
+bool	BufferPool::_newSlab(bool overBudget)
+{
+	void* data;
+
+	if (!_charge(SLAB_BYTES, overBudget))
+		return false;
+	if (posix_memalign(&data, SLAB_BYTES, SLAB_BYTES) != 0)
+	{
+		_uncharge(SLAB_BYTES);
+		return false;
+	}
+	Slab* slab = static_cast<Slab*>(data);
+	slab->freeBlocks = SLAB_BLOCKS - 1;
+	slab->index = _slabs.size();
+	_slabs.push_back(slab);
+	_emptySlabs++;
+	char* blocks = static_cast<char*>(data);
+	for (size_t i = SLAB_BLOCKS - 1; i > 0; i--)
+		_free.push_back(blocks + i * BLOCK_BYTES);
+	return true;
+}
+
+// Rare, so the free list is simply filtered
+void	BufferPool::_freeSlab(Slab* slab)
+{
+	size_t kept = 0;
+	for (size_t i = 0; i < _free.size(); i++)
+	{
+		if (_slabOf(_free[i]) != slab)
+			_free[kept++] = _free[i];
+	}
+	_free.resize(kept);
+	_slabs[slab->index] = _slabs.back();
+	_slabs[slab->index]->index = slab->index;
+	_slabs.pop_back();
+	std::free(slab);
+	_uncharge(SLAB_BYTES);
+}
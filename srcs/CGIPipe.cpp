@@ -83,24 +83,11 @@ bool CGIPipe::handleWrite() //Writing into the child process
         return true;
 
     // Get data from parent's request body at current offset
-    const std::vector<char>& body = _parent.getRequest().getBody();
-    size_t offset = _parent.getCGI().writeOffset;
-    size_t remaining = body.size() - offset;
+    const BodyStorage& body = _parent.getRequest().getBody();
+    size_t& offset = _parent.getCGI().writeOffset;
 
-    if (remaining > 0)
-	{
-        ssize_t written = write(_fd, body.data() + offset, remaining);
-        if (written > 0)
-		{
-            _parent.getCGI().writeOffset += written;
-            if (offset + written == body.size())
-			{
-                // Done writing - close pipe
-                closePipe();
-                
-            }
-        }
-    }
+    if (body.sendTo(_fd, offset) > 0 && offset == body.size())
+        closePipe();  // Done writing
 
     return true;
 }
@@ -116,8 +103,7 @@ bool CGIPipe::wantsToWrite() const
 {
     if (_isReadEnd || _closed)
         return false;
-    const std::vector<char>& body = _parent.getRequest().getBody();
-    return _parent.getCGI().writeOffset < body.size();
+    return _parent.getCGI().writeOffset < _parent.getRequest().getBody().size();
 }
 
 int CGIPipe::getFd() const
@@ -129,6 +115,9 @@ void	CGIPipe::closePipe()
 {
 	if (!_closed && _fd != -1)
 	{
+		// While still registered, the loop must let go of _fd before the
+		// number can be handed out again
+		EventLoop::getInstance()->detachHandler(this);
 		close(_fd);
 		_fd = -1;
 		_closed = true;
@@ -13,10 +13,11 @@
 #include "CSocket.hpp"
 
 // Constructor takes ownership of file descriptor and extracts client info
-CSocket::CSocket(int clientFd, const struct sockaddr_in& clientAddr)
+CSocket::CSocket(int clientFd, const struct sockaddr_in& clientAddr, bool isNonBlocking)
     : Socket()  // Initialize base class
     , _ip()     // Empty string initialization
     , _port(0)  // Initialize port to 0
+    , _addr(clientAddr.sin_addr.s_addr)
 {
     if (clientFd < 0)
         throw std::runtime_error("Invalid client socket descriptor");
@@ -37,6 +38,8 @@ CSocket::CSocket(int clientFd, const struct sockaddr_in& clientAddr)
     _ip = ipBuffer;
     _port = ntohs(clientAddr.sin_port);
     
+    if (isNonBlocking)
+        return;
     try {
         setNonBlocking(true);  // Inherited from Socket
     }
@@ -61,6 +64,11 @@ uint16_t CSocket::getPort() const
 	return _port;
 }
 
+uint32_t CSocket::getAddr() const
+{
+	return _addr;
+}
+
 // Returns a string representation of the socket for logging/debugging
 std::string CSocket::toString() const
 {
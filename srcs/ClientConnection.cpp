@@ -12,62 +12,247 @@
 
 // ClientConnection.cpp
 #include "ClientConnection.hpp"
+#include "RequestProcessor.hpp"
+#include "CGIPipe.hpp"
+#include "ConnectionLimiter.hpp"
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <cstring>
 
-ClientConnection::ClientConnection(int fd, const std::string& ip, uint16_t port)
-    : IOHandler(fd)
+const size_t	ClientConnection::BODY_READ_SIZE;
+
+ClientConnection::ClientConnection(int fd, const struct sockaddr_in& addr,
+	const Config::ServerConfig& config, RequestProcessor& processor,
+	ConnectionLimiter& limiter)
+    : IOHandler(fd, true)  // Accepted with SOCK_NONBLOCK
     , _fd(fd)
-    , _clientIP(ip)
-    , _clientPort(port)
+    , _clientIP()
+    , _clientPort(ntohs(addr.sin_port))
+    , _clientAddr(addr.sin_addr.s_addr)
+    , _limiter(limiter)
     , _state(READING_REQUEST)
     , _keepAlive(true)
+    , _idle(false)
+    , _config(config)
+    , _timeoutPhase(NO_TIMEOUT)
+    , _queued(0)
     , _contentLength(0)
     , _bytesRead(0)
     , _chunkedTransfer(false)
+    , _processor(processor)
+    , _bytesWritten(0)
 {
+	_cgi.inputPipe = NULL;
+	_cgi.outputPipe = NULL;
+	_cgi.childPid = -1;
+	_cgi.writeOffset = 0;
+	_output.setCork(config.tcpNopush);
+	_output.setNodelay(config.tcpNodelay);
+
+	char ip[INET_ADDRSTRLEN];
+	if (inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip)))
+		_clientIP = ip;
+	updateTimeout(false);
 }
 
 ClientConnection::~ClientConnection()
 {
     if (_fd != -1)
         close(_fd);
+    _limiter.release(_clientAddr);
 }
 
 bool ClientConnection::handleRead()
 {
-	char buffer[4096];
+	EventLoop*	loop = EventLoop::getInstance();
+	bool		drain = loop->isEdgeTriggered();
+	size_t		received = 0;
 
-	ssize_t bytesRead = read(_fd, buffer, sizeof(buffer));
-	if (bytesRead > 0)
+	// Level-triggered: one read per wakeup. Edge-triggered: read until EAGAIN
+	// or a short read, or until the budget is used up and the loop has to
+	// come back to us.
+	setPendingIO(false);
+	setStarved(false);
+	while (true)
 	{
-		_readBuffer.insert(_readBuffer.end(), buffer, buffer + bytesRead);
-		try
+		// A Content-Length body with nothing buffered in front of it is
+		// read straight into the request instead of through _readBuffer
+		size_t	bodyLeft = _readBuffer.empty() ? _request.getBodyRemaining() : 0;
+		size_t	asked = 0;	// 0 when a short result says nothing (splice)
+		ssize_t	bytesRead;
+		if (bodyLeft > 0)
+			bytesRead = readBody(bodyLeft, asked);
+		else
 		{
-			_request.parse(_readBuffer);
-			if (_request.getState() == HTTPRequest::COMPLETE)
+			char* space = _readBuffer.prepare(READ_SIZE);
+			if (!space)
+			{
+				// Buffer budget used up: the loop stops polling us for input
+				// and wakes us up again once memory was returned
+				setStarved(true);
+				break;
+			}
+			asked = READ_SIZE;
+			bytesRead = read(_fd, space, READ_SIZE);
+			if (bytesRead > 0)
+				_readBuffer.commit(bytesRead);
+		}
+		loop->getStats().readCalls++;
+		if (bytesRead > 0)
+		{
+			received += bytesRead;
+			if (_request.isBodyBacklogged())
+				break;	// No more body until the pool caught up
+			// A short read() emptied the socket; whatever arrives next
+			// raises a new edge, so the read that would see EAGAIN is saved
+			if (!drain || static_cast<size_t>(bytesRead) < asked)
+				break;
+			if (received >= EventLoop::DRAIN_BUDGET)
 			{
-				if (!_request.shouldKeepAlive())
-					_keepAlive = false;
-				if (_request.isCGI())
-					setupCGI();
-				else
-				{
-					//Process request
-					_state = SENDING_RESPONSE;
-				}
+				setPendingIO(true);
+				break;
 			}
 		}
-		catch(const std::exception& e)
+		else if (bytesRead == 0)
 		{
-			std::cerr << e.what() << '\n';
+			// Client closed connection -> EventLoop will handle removal of the epoll instance and the client instance through IOHnadler by returning false here.
+			return false;
 		}
-		
+		else if (errno == EAGAIN || errno == EWOULDBLOCK)
+			break;
+		else if (errno != EINTR)
+			return false;
+	}
+	if (received == 0)
+		return true;
+	_idle = false;
+	serveRequests();
+	updateTimeout(true);
+	return true;	
+}
+
+Poller::Completion ClientConnection::getCompletion() const
+{
+	return Poller::RECV_COMPLETION;
+}
+
+// Bytes the io_uring backend received for us, the handleRead() of the
+// completion path. The buffer goes back to the kernel after this call,
+// so everything is taken: past the memory budget the bytes are appended
+// anyway, and the loop stops receiving for us until memory comes back.
+bool ClientConnection::handleReceived(const char* data, size_t len)
+{
+	size_t	bodyLeft = _readBuffer.empty() ? _request.getBodyRemaining() : 0;
+
+	setStarved(false);
+	if (bodyLeft > 0)
+	{
+		size_t n = std::min(bodyLeft, len);
+		if (UploadSink* sink = _request.getBodySink())
+			sink->write(data, n);
+		else
+			std::memcpy(_request.prepareBody(n), data, n);
+		_request.commitBody(n);
+		data += n;
+		len -= n;
 	}
-	else if (bytesRead == 0)
+	if (len > 0 && !_readBuffer.append(data, len))
 	{
-		// Client closed connection -> EventLoop will handle removal of the epoll instance and the client instance through IOHnadler by returning false here.
-		return false;
+		setStarved(true);
+		_readBuffer.append(data, len, true);
 	}
-	return true;	
+	_idle = false;
+	serveRequests();
+	updateTimeout(true);
+	return true;
+}
+
+// Answers the complete requests in _readBuffer in the order they arrived.
+// Their responses line up in _output behind the ones still being sent,
+// up to pipelineDepth of them; the rest waits until handleWrite() has
+// emptied the queue. Nothing is parsed after a response that closes.
+void	ClientConnection::serveRequests()
+{
+	try
+	{
+		while (_state == READING_REQUEST && _keepAlive && _queued < _config.pipelineDepth)
+		{
+			_request.parse(_readBuffer);
+			// Raw uploads are spliced to their file from here on
+			if (_request.wantsBodySink())
+				_request.setBodySink(_processor.openBodySink(_request));
+			if (_request.getState() != HTTPRequest::COMPLETE || _request.getDiskWait())
+				break;
+			if (!_request.shouldKeepAlive())
+				_keepAlive = false;
+			if (_request.isCGI())
+				setupCGI();
+			else
+				processRequest();
+		}
+	}
+	catch (const HTTPError& e)
+	{
+		rejectRequest(e);
+	}
+	catch(const std::exception& e)
+	{
+		std::cerr << e.what() << '\n';
+	}
+}
+
+// Malformed request, or its body could not be stored: answer with the
+// error and close afterwards
+void	ClientConnection::rejectRequest(const HTTPError& error)
+{
+	_keepAlive = false;
+	_response = error.createErrorResponse("");
+	_response.setHeader("Connection", "close");
+	queueResponse();
+	_state = SENDING_RESPONSE;
+}
+
+// Reads up to left body bytes into the request: BODY_READ_SIZE, or more
+// when FIONREAD reports more already queued. A raw upload goes through
+// its sink instead and never reaches user space. Same result as read().
+// asked is set to the size of the read(); it stays 0 for a splice(), which
+// may also stop short when the pipe runs out of slots.
+ssize_t	ClientConnection::readBody(size_t left, size_t& asked)
+{
+	size_t	len = std::min(left, BODY_READ_SIZE);
+	int		queued = 0;
+
+	if (UploadSink* sink = _request.getBodySink())
+	{
+		ssize_t bytesRead = sink->receive(_fd, left);
+		_request.commitBody(0);
+		return bytesRead;
+	}
+
+	if (len < left && ioctl(_fd, FIONREAD, &queued) == 0 && static_cast<size_t>(queued) > len)
+		len = std::min(left, static_cast<size_t>(queued));
+	asked = len;
+	ssize_t bytesRead = read(_fd, _request.prepareBody(len), len);
+	_request.commitBody(bytesRead > 0 ? bytesRead : 0);
+	return bytesRead;
+}
+
+void	ClientConnection::processRequest()
+{
+	EventLoop::getInstance()->getStats().requests++;
+	HTTPResponse response = _processor.processRequest(_request);
+	_response.swap(response);  // No copy of the body
+	_response.setHeader("Connection", _keepAlive ? "keep-alive" : "close");
+	queueResponse();
+	if (!_keepAlive)
+	{
+		_state = SENDING_RESPONSE;
+		return;
+	}
+	// The response is in _output now, the next request may be buffered already
+	_request.reset();
+	_response.reset();
 }
 
 void	ClientConnection::setupCGI()
@@ -77,6 +262,8 @@ void	ClientConnection::setupCGI()
 	// Create pipes for CGI process
 	_cgi.inputPipe = new CGIPipe(*this, false);
 	_cgi.outputPipe = new CGIPipe(*this, true);
+	EventLoop::getInstance()->registerHandler(_cgi.inputPipe);
+	EventLoop::getInstance()->registerHandler(_cgi.outputPipe);
 
 	// Process CGI request through new CGIProcessor
 	_cgi.childPid = fork();
@@ -104,39 +291,88 @@ void	ClientConnection::setupCGI()
 
 bool ClientConnection::handleWrite()
 {
-    if (_writeBuffer.empty())
-        return true;
-        
-    ssize_t bytesWritten = write(_fd, 
-                                _writeBuffer.data(), 
-                                _writeBuffer.size());
-    
-    if (bytesWritten > 0)
-	{
-        _writeBuffer.erase(_writeBuffer.begin(), 
-                          _writeBuffer.begin() + bytesWritten);
+	EventLoop*	loop = EventLoop::getInstance();
+	bool		drain = loop->isEdgeTriggered();
+	size_t		sent = 0;
+
+	setPendingIO(false);
+    while (!_output.empty())
+	{
+        ssize_t bytesWritten = _output.writeTo(_fd);
+		loop->getStats().writeCalls++;
+        if (bytesWritten == -1)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return true;
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		sent += bytesWritten;
         
-        if (_writeBuffer.empty())
+        if (_output.empty())
 		{
-            if (_keepAlive)
+            if (!_keepAlive)
+				return false;  // Close connection
+			_queued = 0;
+			if (_state != READING_REQUEST)
+				reset();
+			_idle = _readBuffer.empty() && _request.getState() == HTTPRequest::REQUEST_LINE;
+			// Requests that waited for room in the queue
+			serveRequests();
+			if (_output.empty())
 			{
-                reset();
-                return true;
-            }
-            return false;  // Close connection
+				updateTimeout(true);
+				return true;
+			}
         }
+		if (!drain)
+			break;
+		if (sent >= EventLoop::DRAIN_BUDGET)
+		{
+			setPendingIO(true);
+			break;
+		}
     }
+	if (sent > 0)
+		updateTimeout(true);
     return true;
 }
 
 bool ClientConnection::wantsToRead() const
 {
-    return _state == READING_REQUEST && _request.getState() != HTTPRequest::COMPLETE;
+    return _state == READING_REQUEST && _keepAlive && _queued < _config.pipelineDepth
+        && _request.getState() != HTTPRequest::COMPLETE && !_request.isBodyBacklogged();
 }
 
+// Not while a pool thread reads the next part of the file
 bool ClientConnection::wantsToWrite() const
 {
-    return _state == SENDING_RESPONSE && _response.getState() != HTTPResponse::COMPLETE;
+    return !_output.empty() && !_output.getDiskWait();
+}
+
+DiskTask* ClientConnection::getDiskWait() const
+{
+    if (DiskTask* task = _output.getDiskWait())
+        return task;
+    return _request.getDiskWait();
+}
+
+// A written part of the request body lets the connection read on, the
+// last one completes the request
+void ClientConnection::onDiskDone(DiskTask* task)
+{
+    _output.diskDone(task);
+    try {
+        if (!_request.diskDone(task))
+            return;
+    }
+    catch (const HTTPError& e) {
+        rejectRequest(e);
+        return;
+    }
+    serveRequests();
+    updateTimeout(true);
 }
 
 HTTPRequest& ClientConnection::getRequest()
@@ -150,8 +386,9 @@ HTTPResponse& ClientConnection::getResponse()
 }
 
 void ClientConnection::queueResponse() {
-    std::vector<char> serialized = _response.serialize();
-    _writeBuffer = serialized;  // Replace existing write buffer with new data
+    _response.queueTo(_output);
+    if (++_queued > 1)
+        _output.setPipelined();
 }
 
 int ClientConnection::getFd() const
@@ -181,22 +418,81 @@ ClientConnection::CGI& ClientConnection::getCGI()
 	return _cgi;
 }
 
+// Header and keep-alive timers run from the start of their phase, body and
+// send timers are pushed back whenever bytes move. Re-arming only relinks
+// the embedded Timer, so this is called on every read and write.
+void ClientConnection::updateTimeout(bool progress)
+{
+	TimeoutPhase	phase = HEADER_TIMEOUT;
+	size_t			delay = _config.clientHeaderTimeout;
+
+	if (_state == PROCESSING_CGI)
+		phase = NO_TIMEOUT;
+	else if (_state == SENDING_RESPONSE || !_output.empty())
+	{
+		phase = SEND_TIMEOUT;
+		delay = _config.sendTimeout;
+	}
+	else if (_idle)
+	{
+		phase = KEEPALIVE_TIMEOUT;
+		delay = _config.keepaliveTimeout;
+	}
+	else if (_request.getState() == HTTPRequest::BODY_INIT
+		|| _request.getState() == HTTPRequest::BODY)
+	{
+		phase = BODY_TIMEOUT;
+		delay = _config.clientBodyTimeout;
+	}
+
+	bool restart = progress && (phase == BODY_TIMEOUT || phase == SEND_TIMEOUT);
+	if (phase == _timeoutPhase && !restart)
+		return;
+	_timeoutPhase = phase;
+	if (phase == NO_TIMEOUT || delay == 0)
+		EventLoop::getInstance()->getTimers().cancel(*this);
+	else
+		EventLoop::getInstance()->getTimers().schedule(*this, delay);
+}
+
+// Nothing of a request read yet: close now. Otherwise finish the current
+// response and close after it.
+void ClientConnection::onDrain()
+{
+	_keepAlive = false;
+	if (_state == READING_REQUEST && _readBuffer.empty() && _output.empty()
+		&& _request.getState() == HTTPRequest::REQUEST_LINE)
+		EventLoop::getInstance()->removeHandler(this);
+}
+
+void ClientConnection::onTimeout()
+{
+	static const char* names[] = { "", "client_header", "client_body", "send", "keepalive" };
+
+	LOG_INFO("Closing " + getInfo() + ": " + names[_timeoutPhase] + "_timeout expired");
+	EventLoop::getInstance()->removeHandler(this);  // Deletes this
+}
+
+// Pipelined bytes in _readBuffer are kept for the next request
 void ClientConnection::reset()
 {
     _state = READING_REQUEST;
+    _idle = _readBuffer.empty();
     _contentLength = 0;
     _bytesRead = 0;
     _chunkedTransfer = false;
-    _readBuffer.clear();
-    _writeBuffer.clear();
+    _output.clear();
+    _queued = 0;
+    _request.reset();
+    _response.reset();
 	if (_cgi.inputPipe)
 	{
-		delete _cgi.inputPipe;
+		EventLoop::getInstance()->removeHandler(_cgi.inputPipe);
 		_cgi.inputPipe = NULL;
 	}
 	if (_cgi.outputPipe)
 	{
-		delete _cgi.outputPipe;
+		EventLoop::getInstance()->removeHandler(_cgi.outputPipe);
 		_cgi.outputPipe = NULL;
 	}
 }
\ No newline at end of file
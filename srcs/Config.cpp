@@ -12,8 +12,20 @@
 
 #include "Config.hpp"
 #include "Utils.hpp"
+#include <unistd.h>
 
 Config::Config(const std::string &configPath)
+    : _workerThreads(0)
+    , _edgeTriggered(false)
+    , _ioUring(false)
+    , _shutdownTimeout(30000)
+    , _maxConnections(0)
+    , _maxConnectionsPerIp(0)
+    , _ioBufferBudget(256 * 1024 * 1024)
+    , _clientBodyBufferSize(16 * 1024)
+    , _clientBodyMemfdSize(1024 * 1024)
+    , _clientBodyTempPath("/tmp")
+    , _diskThreads(4)
 {
     _parseConfig(configPath);
 }
@@ -53,6 +65,94 @@ void Config::_parseConfig(const std::string &configPath)
             else
                 throw std::runtime_error("Invalid log level: " + level);
         }
+        else if (token == "worker_threads")
+        {
+            std::string count = _getNextToken(file);
+            _expectToken(file, ";");
+            if (count == "auto")
+            {
+                long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+                _workerThreads = cpus > 0 ? static_cast<size_t>(cpus) : 1;
+            }
+            else
+            {
+                int n = 0;
+                std::istringstream(count) >> n;
+                if (n < 1 || n > 256)
+                    throw std::runtime_error("Invalid worker_threads: " + count);
+                _workerThreads = static_cast<size_t>(n);
+            }
+        }
+        else if (token == "epoll_mode")
+        {
+            std::string mode = _getNextToken(file);
+            _expectToken(file, ";");
+            if (mode == "edge")
+                _edgeTriggered = true;
+            else if (mode == "level")
+                _edgeTriggered = false;
+            else
+                throw std::runtime_error("Invalid epoll_mode: " + mode);
+        }
+        else if (token == "event_backend")
+        {
+            std::string backend = _getNextToken(file);
+            _expectToken(file, ";");
+            if (backend == "io_uring")
+                _ioUring = true;
+            else if (backend == "epoll")
+                _ioUring = false;
+            else
+                throw std::runtime_error("Invalid event_backend: " + backend);
+        }
+        else if (token == "shutdown_timeout")
+        {
+            _shutdownTimeout = _parseDuration(_getNextToken(file));
+            _expectToken(file, ";");
+        }
+        else if (token == "max_connections" || token == "max_connections_per_ip")
+        {
+            std::string count = _getNextToken(file);
+            long n = -1;
+            std::istringstream(count) >> n;
+            if (n < 0 || n > 10000000)
+                throw std::runtime_error("Invalid " + token + ": " + count);
+            _expectToken(file, ";");
+            if (token == "max_connections")
+                _maxConnections = static_cast<size_t>(n);
+            else
+                _maxConnectionsPerIp = static_cast<size_t>(n);
+        }
+        else if (token == "io_buffer_budget")
+        {
+            _ioBufferBudget = _parseSize(_getNextToken(file));
+            _expectToken(file, ";");
+        }
+        else if (token == "disk_threads")
+        {
+            std::string count = _getNextToken(file);
+            long n = -1;
+            std::istringstream(count) >> n;
+            if (n < 0 || n > 512)
+                throw std::runtime_error("Invalid disk_threads: " + count);
+            _expectToken(file, ";");
+            _diskThreads = static_cast<size_t>(n);
+        }
+        else if (token == "client_body_buffer_size")
+        {
+            _clientBodyBufferSize = _parseSize(_getNextToken(file));
+            _expectToken(file, ";");
+        }
+        else if (token == "client_body_memfd_size")
+        {
+            _clientBodyMemfdSize = _parseSize(_getNextToken(file));
+            _expectToken(file, ";");
+        }
+        else if (token == "client_body_temp_path")
+        {
+            _clientBodyTempPath = _getNextToken(file);
+            _expectToken(file, ";");
+        }
         else if (token == "http")
         {
             if (inHttpContext)
@@ -80,7 +180,10 @@ void Config::_parseConfig(const std::string &configPath)
 	{
         throw std::runtime_error("No server configurations found");
 	}
-	LOG_INFO("Webserv config: " + configPath + " parsed successfully");
+    // The single reactor has no Poller; io_uring brings up one worker
+    if (_ioUring && _workerThreads == 0)
+        _workerThreads = 1;
+    LOG_INFO("Webserv config: " + configPath + " parsed successfully");
 }
 
 void Config::_parseServer(std::ifstream &file)
@@ -110,8 +213,19 @@ void Config::_parseServer(std::ifstream &file)
             if (!_isValidHost(server.host) || !_isValidPort(server.port))
                 throw std::runtime_error("Invalid host:port configuration");
             
-            _expectToken(file, ";");
+            // Optional parameters: deferred backlog=N fastopen=N sndbuf=SIZE rcvbuf=SIZE
+            std::string param;
+            while ((param = _getNextToken(file)) != ";")
+            {
+                if (param.empty())
+                    throw std::runtime_error("Unexpected end of file in listen");
+                _parseListenParam(param, server);
+            }
         }
+        else if (token == "tcp_nodelay")
+            server.tcpNodelay = _parseSwitch(file, token);
+        else if (token == "tcp_nopush")
+            server.tcpNopush = _parseSwitch(file, token);
         else if (token == "server_name")
         {
             while (file.good())
@@ -142,6 +256,46 @@ void Config::_parseServer(std::ifstream &file)
             server.errorPages[code] = page;
             _expectToken(file, ";");
         }
+        else if (token == "keepalive_timeout")
+        {
+            server.keepaliveTimeout = _parseDuration(_getNextToken(file));
+            _expectToken(file, ";");
+        }
+        else if (token == "client_header_timeout")
+        {
+            server.clientHeaderTimeout = _parseDuration(_getNextToken(file));
+            _expectToken(file, ";");
+        }
+        else if (token == "client_body_timeout")
+        {
+            server.clientBodyTimeout = _parseDuration(_getNextToken(file));
+            _expectToken(file, ";");
+        }
+        else if (token == "send_timeout")
+        {
+            server.sendTimeout = _parseDuration(_getNextToken(file));
+            _expectToken(file, ";");
+        }
+        else if (token == "accept_batch")
+        {
+            std::string count = _getNextToken(file);
+            int n = 0;
+            std::istringstream(count) >> n;
+            if (n < 1 || n > 1024)
+                throw std::runtime_error("Invalid accept_batch: " + count);
+            server.acceptBatch = static_cast<size_t>(n);
+            _expectToken(file, ";");
+        }
+        else if (token == "pipeline_depth")
+        {
+            std::string count = _getNextToken(file);
+            int n = 0;
+            std::istringstream(count) >> n;
+            if (n < 1 || n > 1024)
+                throw std::runtime_error("Invalid pipeline_depth: " + count);
+            server.pipelineDepth = static_cast<size_t>(n);
+            _expectToken(file, ";");
+        }
         else if (token == "location")
             _parseRoute(file, server);
         else
@@ -267,6 +421,93 @@ void Config::_expectToken(std::ifstream &file, const std::string &expected)
         throw std::runtime_error("Expected '" + expected + "', got '" + token + "'");
 }
 
+// nginx style durations: "30" and "30s" are seconds, "500ms" and "2m" work too
+size_t Config::_parseDuration(const std::string &value) const
+{
+    std::istringstream  iss(value);
+    long                amount = -1;
+    std::string         unit;
+
+    iss >> amount;
+    if (iss.fail() || amount < 0)
+        throw std::runtime_error("Invalid duration: " + value);
+    iss >> unit;
+    if (unit.empty() || unit == "s")
+        return amount * 1000;
+    if (unit == "ms")
+        return amount;
+    if (unit == "m")
+        return amount * 60 * 1000;
+    throw std::runtime_error("Invalid duration unit: " + value);
+}
+
+void Config::_parseListenParam(const std::string &param, ServerConfig &server) const
+{
+    size_t      eq = param.find('=');
+    std::string name = param.substr(0, eq);
+    std::string value = (eq == std::string::npos) ? "" : param.substr(eq + 1);
+
+    if (param == "deferred")
+    {
+        server.deferAccept = true;
+        return;
+    }
+    if (value.empty())
+        throw std::runtime_error("Invalid listen parameter: " + param);
+    if (name == "sndbuf" || name == "rcvbuf")
+    {
+        size_t size = _parseSize(value);
+        if (size > 1024 * 1024 * 1024)
+            throw std::runtime_error("Invalid listen parameter: " + param);
+        (name == "sndbuf" ? server.sndBuf : server.rcvBuf) = size;
+        return;
+    }
+    if (name != "backlog" && name != "fastopen")
+        throw std::runtime_error("Invalid listen parameter: " + param);
+    long n = -1;
+    std::istringstream(value) >> n;
+    if (n < 0 || n > 65535 || (name == "backlog" && n == 0))
+        throw std::runtime_error("Invalid listen parameter: " + param);
+    if (name == "backlog")
+        server.backlog = static_cast<int>(n);
+    else
+        server.fastOpen = static_cast<int>(n);
+}
+
+// "on" or "off" followed by ';'
+bool Config::_parseSwitch(std::ifstream &file, const std::string &directive)
+{
+    std::string value = _getNextToken(file);
+    _expectToken(file, ";");
+    if (value == "on")
+        return true;
+    if (value == "off")
+        return false;
+    throw std::runtime_error("Invalid " + directive + ": " + value);
+}
+
+// "4096", "512k", "256m", "1g"; bytes without a suffix
+size_t Config::_parseSize(const std::string &value) const
+{
+    std::istringstream  iss(value);
+    long                amount = -1;
+    std::string         unit;
+
+    iss >> amount;
+    if (iss.fail() || amount < 0)
+        throw std::runtime_error("Invalid size: " + value);
+    iss >> unit;
+    if (unit.empty())
+        return amount;
+    if (unit == "k" || unit == "K")
+        return static_cast<size_t>(amount) * 1024;
+    if (unit == "m" || unit == "M")
+        return static_cast<size_t>(amount) * 1024 * 1024;
+    if (unit == "g" || unit == "G")
+        return static_cast<size_t>(amount) * 1024 * 1024 * 1024;
+    throw std::runtime_error("Invalid size unit: " + value);
+}
+
 bool Config::_isValidHost(const std::string &host) const
 {
     if (host == "localhost" || host == "0.0.0.0")
@@ -286,6 +527,69 @@ const std::vector<Config::ServerConfig>& Config::getServers() const
     return _servers;
 }
 
+// 0 when the directive is absent: the legacy single loop in Server is used
+size_t Config::getWorkerThreads() const
+{
+    return _workerThreads;
+}
+
+bool Config::isEdgeTriggered() const
+{
+    return _edgeTriggered;
+}
+
+// Only honoured by the worker reactors (worker_threads >= 1)
+bool Config::useIoUring() const
+{
+    return _ioUring;
+}
+
+// Milliseconds a draining server waits for open connections before it quits
+size_t Config::getShutdownTimeout() const
+{
+    return _shutdownTimeout;
+}
+
+// Open client connections over all reactors, 0 means no limit
+size_t Config::getMaxConnections() const
+{
+    return _maxConnections;
+}
+
+// Open client connections from one IPv4 address, 0 means no limit
+size_t Config::getMaxConnectionsPerIp() const
+{
+    return _maxConnectionsPerIp;
+}
+
+size_t Config::getIoBufferBudget() const
+{
+    return _ioBufferBudget;
+}
+
+// Request bodies up to this size stay in memory
+size_t Config::getClientBodyBufferSize() const
+{
+    return _clientBodyBufferSize;
+}
+
+// Larger bodies up to this size go to a memfd, beyond it to the temp path
+size_t Config::getClientBodyMemfdSize() const
+{
+    return _clientBodyMemfdSize;
+}
+
+const std::string &Config::getClientBodyTempPath() const
+{
+    return _clientBodyTempPath;
+}
+
+// Threads for blocking file reads, 0 keeps them on the reactors
+size_t Config::getDiskThreads() const
+{
+    return _diskThreads;
+}
+
 /* std::ostream&   operator<<(std::ostream& out, const Config& src)
 {
      
@@ -15,20 +15,34 @@
 #include "HTTPError.hpp"
 #include <unistd.h>
 #include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <algorithm>
 #include <errno.h>
 #include <string.h>
 #include "Utils.hpp"
 
-Connection::Connection(CSocket *socket) 
-    : _socket(socket)
+const size_t	Connection::BODY_READ_SIZE;
+
+Connection::Connection(CSocket *socket, const Config::ServerConfig& config) 
+    : IOHandler(socket ? socket->getFd() : -1, true)  // CSocket is non-blocking already
+    , _socket(socket)
+    , _state(PENDING_REQUEST)
     , _readBuffer() // Initialize empty
-    , _writeBuffer() // Initialize empty
+    , _output() // Initialize empty
+    , _queued(0)
+    , _closing(false)
+    , _config(config)
+    , _timeoutPhase(NO_TIMEOUT)
+    , _idle(false)
+    , _progress(false)
 {
 	if (!_socket)
 	{
 		LOG_DEBUG("Socket is NULL");
 		throw HTTPError(500, "Internal Server Error");
 	}
+	_output.setCork(config.tcpNopush);
+	_output.setNodelay(config.tcpNodelay);
 }
 
 Connection::~Connection()
@@ -38,15 +52,43 @@ Connection::~Connection()
 
 bool Connection::handleRead()
 {
-	char buffer[BUFFER_SIZE];
-	ssize_t bytesRead = ::recv(getFd(), buffer, BUFFER_SIZE, 0);
+	size_t	bodyLeft = _readBuffer.empty() ? _currentRequest.getBodyRemaining() : 0;
+	ssize_t	bytesRead;
+
+	if (bodyLeft > 0 && _currentRequest.getBodySink())
+	{
+		// Raw upload: spliced from the socket to its file
+		bytesRead = _currentRequest.getBodySink()->receive(getFd(), bodyLeft);
+		_currentRequest.commitBody(0);
+	}
+	else if (bodyLeft > 0)
+	{
+		// Content-Length body with nothing buffered: straight into the request
+		size_t len = std::min(bodyLeft, BODY_READ_SIZE);
+		int queued = 0;
+		if (len < bodyLeft && ioctl(getFd(), FIONREAD, &queued) == 0 && static_cast<size_t>(queued) > len)
+			len = std::min(bodyLeft, static_cast<size_t>(queued));
+		bytesRead = ::recv(getFd(), _currentRequest.prepareBody(len), len, 0);
+		_currentRequest.commitBody(bytesRead > 0 ? bytesRead : 0);
+	}
+	else
+	{
+		char* space = _readBuffer.prepare(BUFFER_SIZE);
+		setStarved(space == NULL);
+		if (!space)
+			return true;	// Server pauses our EPOLLIN until buffer memory is returned
+		bytesRead = ::recv(getFd(), space, BUFFER_SIZE, 0);
+		if (bytesRead > 0)
+			_readBuffer.commit(bytesRead);
+	}
     if (bytesRead < 0)
 		return true;
 	if (bytesRead == 0)
 		return false;
+	_progress = true;
+	_idle = false;
     try
     {
-		_readBuffer.insert(_readBuffer.end(), buffer, buffer + bytesRead);
         _currentRequest.parse(_readBuffer);
 		return true;
     }
@@ -58,58 +100,47 @@ bool Connection::handleRead()
     return true;
 }
 
-bool Connection::handleWrite() {
-    if (_state == WRITING_HEADERS) {
-        // Send headers first
-        if (!_writeBuffer.empty()) {
-            ssize_t bytesWritten = ::send(getFd(), &_writeBuffer[0], 
-                                        _writeBuffer.size(), MSG_NOSIGNAL);
-            if (bytesWritten > 0) {
-                _writeBuffer.erase(_writeBuffer.begin(), 
-                                _writeBuffer.begin() + bytesWritten);
-                if (_writeBuffer.empty()) {
-                    _state = WRITING_BODY;
-                }
-            }
-        }
-        return true;
-    }
-    
-    if (_state == WRITING_BODY) {
-        // If buffer is empty, get next chunk
-        if (_writeBuffer.empty()) {
-            std::vector<char> chunk = _currentResponse.getNextChunk();
-            if (chunk.empty()) {
-                _state = WRITING_COMPLETE;
-                return true;
-            }
-            _writeBuffer = chunk;
-        }
-        
-        // Write current buffer
-        ssize_t bytesWritten = ::send(getFd(), &_writeBuffer[0], 
-                                    _writeBuffer.size(), MSG_NOSIGNAL);
-        if (bytesWritten > 0) {
-            _writeBuffer.erase(_writeBuffer.begin(), 
-                            _writeBuffer.begin() + bytesWritten);
-        }
-    }
-    
-    return true;
+bool Connection::handleWrite()
+{
+	ssize_t bytesWritten = _output.writeTo(getFd());
+	if (bytesWritten > 0)
+		_progress = true;
+	else if (bytesWritten == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+		return false;
+	if (_output.empty())
+		_state = WRITING_COMPLETE;
+	return true;
+}
+
+int	Connection::getWaitFd() const
+{
+	return _output.getWaitFd();
+}
+
+DiskTask*	Connection::getDiskWait() const
+{
+	if (DiskTask* task = _output.getDiskWait())
+		return task;
+	return _currentRequest.getDiskWait();
+}
+
+// Throws the HTTPError of a request body that could not be written
+void	Connection::onDiskDone(DiskTask* task)
+{
+	_output.diskDone(task);
+	_currentRequest.diskDone(task);
 }
 
 bool	Connection::wantsToRead() const {
-	// We want to read if we're in any reading state and haven't completed the request
-	return ((_state == PENDING_REQUEST
-			|| _state == READING_HEADERS
-			|| _state == READING_BODY)
-			&& !hasCompletedRequest());
+	// Not past a closing response, while the queue is full or while the
+	// pool is behind with the request body
+	return canQueueResponse() && !hasCompletedRequest() && !_currentRequest.isBodyBacklogged();
 }
 
 bool	Connection::wantsToWrite() const {
 	// We want to write if we have data in our write buffer
 	// or if we're in a writing state
-	return (!_writeBuffer.empty()
+	return (!_output.empty()
 			|| _state == WRITING_HEADERS
 			|| _state == WRITING_BODY);
 }
@@ -122,7 +153,7 @@ bool Connection::hasCompletedRequest() const
 	}
 	else
 		LOG_DEBUG("Request not complete!");
-    return _currentRequest.getState() == HTTPRequest::COMPLETE;
+    return _currentRequest.getState() == HTTPRequest::COMPLETE && !_currentRequest.getDiskWait();
 }
 
 bool Connection::shouldKeepAlive() const
@@ -130,25 +161,101 @@ bool Connection::shouldKeepAlive() const
 	return _currentRequest.shouldKeepAlive();
 }
 
+bool Connection::isIdle() const
+{
+	return _readBuffer.empty() && _output.empty()
+		&& _currentRequest.getState() == HTTPRequest::REQUEST_LINE;
+}
+
 bool Connection::hasCompletedResponse() const
 {
-    return _writeBuffer.empty();
+    return _output.empty();
+}
+
+void Connection::queueResponse(HTTPResponse& response, bool close)
+{
+    response.queueTo(_output);
+    if (++_queued > 1)
+        _output.setPipelined();
+    if (close)
+        _closing = true;
+}
+
+bool Connection::canQueueResponse() const
+{
+    return !_closing && _queued < _config.pipelineDepth;
 }
 
-void Connection::queueResponse(const HTTPResponse& response)
+bool Connection::isClosing() const
 {
-    std::string serialized = response.serialize();
-    _writeBuffer.insert(_writeBuffer.end(), 
-                       serialized.begin(), 
-                       serialized.end());
+    return _closing;
 }
 
-void Connection::reset()
+// A malformed pipelined request is not answered: the responses before it
+// are still sent, then the connection closes
+void Connection::nextRequest()
 {
-    _readBuffer.clear();
-    _writeBuffer.clear();
     _currentRequest.reset();
 	_currentResponse.reset();
+    if (_readBuffer.empty())
+        return;
+    try
+    {
+        _currentRequest.parse(_readBuffer);
+    }
+    catch (const std::exception& e)
+    {
+        LOG_ERROR("Parse error on fd " + TO_STRING(getFd()) + ": " + e.what());
+        _closing = true;
+    }
+}
+
+void Connection::responsesSent()
+{
+    _state = PENDING_REQUEST;
+    _queued = 0;
+    _idle = isIdle();
+}
+
+void Connection::updateTimeout(TimerWheel& timers)
+{
+	TimeoutPhase	phase = HEADER_TIMEOUT;
+	size_t			delay = _config.clientHeaderTimeout;
+	HTTPRequest::RequestState	reqState = _currentRequest.getState();
+
+	if (reqState == HTTPRequest::COMPLETE || !_output.empty())
+	{
+		phase = SEND_TIMEOUT;
+		delay = _config.sendTimeout;
+	}
+	else if (_idle)
+	{
+		phase = KEEPALIVE_TIMEOUT;
+		delay = _config.keepaliveTimeout;
+	}
+	else if (reqState == HTTPRequest::BODY_INIT || reqState == HTTPRequest::BODY)
+	{
+		phase = BODY_TIMEOUT;
+		delay = _config.clientBodyTimeout;
+	}
+
+	bool restart = _progress && (phase == BODY_TIMEOUT || phase == SEND_TIMEOUT);
+	_progress = false;
+	if (phase == _timeoutPhase && !restart)
+		return;
+	_timeoutPhase = phase;
+	if (delay == 0)
+		timers.cancel(*this);
+	else
+		timers.schedule(*this, delay);
+}
+
+// The legacy Server owns the connection, so expiry only shuts the socket
+// down; epoll then reports EPOLLHUP and the Server closes it as usual.
+void Connection::onTimeout()
+{
+	LOG_INFO("Connection " + getSocketInfoString() + " timed out");
+	::shutdown(getFd(), SHUT_RDWR);
 }
 
 Connection::State	Connection::getState() const
@@ -172,6 +279,11 @@ uint16_t Connection::getPort() const
 	return _socket->getPort();
 }
 
+uint32_t Connection::getAddr() const
+{
+	return _socket->getAddr();
+}
+
 std::string Connection::getSocketInfoString() const
 {
 	return _socket->toString();
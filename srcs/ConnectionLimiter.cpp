@@ -0,0 +1,193 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ConnectionLimiter.cpp                              :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: lwoiton <lwoiton@student.42prague.com>     +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/12/23 10:41:19 by lwoiton           #+#    #+#             */
+/*   Updated: 2024/12/23 10:41:19 by lwoiton          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "ConnectionLimiter.hpp"
+#include <sstream>
+#include <algorithm>
+
+ConnectionLimiter::ConnectionLimiter(size_t maxTotal, size_t maxPerIp)
+	: _maxTotal(maxTotal)
+	, _maxPerIp(maxPerIp)
+	, _slots(maxPerIp ? 1024 : 0)
+	, _used(0)
+	, _active(0)
+	, _admitted(0)
+	, _rejectedTotal(0)
+	, _rejectedPerIp(0)
+{
+	Slot empty;
+
+	empty.addr = 0;
+	empty.count = 0;
+	std::fill(_slots.begin(), _slots.end(), empty);
+	pthread_mutex_init(&_lock, NULL);
+}
+
+ConnectionLimiter::~ConnectionLimiter()
+{
+	pthread_mutex_destroy(&_lock);
+}
+
+bool	ConnectionLimiter::admit(uint32_t addr)
+{
+	bool admitted = false;
+
+	pthread_mutex_lock(&_lock);
+	if (_maxTotal && _active >= _maxTotal)
+		_rejectedTotal++;
+	else if (!_maxPerIp)
+		admitted = true;
+	else
+	{
+		Slot& slot = _find(addr);
+		if (slot.count >= _maxPerIp)
+			_rejectedPerIp++;
+		else
+		{
+			if (slot.count == 0)
+			{
+				slot.addr = addr;
+				_used++;
+			}
+			slot.count++;
+			admitted = true;
+			// Keep the load factor under 1/2 for short probe sequences
+			if (_used * 2 > _slots.size())
+				_grow();
+		}
+	}
+	if (admitted)
+	{
+		_active++;
+		_admitted++;
+	}
+	pthread_mutex_unlock(&_lock);
+	return admitted;
+}
+
+void	ConnectionLimiter::release(uint32_t addr)
+{
+	pthread_mutex_lock(&_lock);
+	if (_active > 0)
+		_active--;
+	if (_maxPerIp)
+	{
+		Slot& slot = _find(addr);
+		if (slot.count > 0 && --slot.count == 0)
+			_erase(&slot - &_slots[0]);
+	}
+	pthread_mutex_unlock(&_lock);
+}
+
+size_t	ConnectionLimiter::getActive()
+{
+	pthread_mutex_lock(&_lock);
+	size_t active = _active;
+	pthread_mutex_unlock(&_lock);
+	return active;
+}
+
+size_t	ConnectionLimiter::getAdmitted()
+{
+	pthread_mutex_lock(&_lock);
+	size_t admitted = _admitted;
+	pthread_mutex_unlock(&_lock);
+	return admitted;
+}
+
+size_t	ConnectionLimiter::getRejectedTotal()
+{
+	pthread_mutex_lock(&_lock);
+	size_t rejected = _rejectedTotal;
+	pthread_mutex_unlock(&_lock);
+	return rejected;
+}
+
+size_t	ConnectionLimiter::getRejectedPerIp()
+{
+	pthread_mutex_lock(&_lock);
+	size_t rejected = _rejectedPerIp;
+	pthread_mutex_unlock(&_lock);
+	return rejected;
+}
+
+// "active 12, admitted 3400, rejected 5 (max_connections) 40 (per ip), 3 addresses"
+std::string	ConnectionLimiter::toString()
+{
+	std::stringstream ss;
+
+	pthread_mutex_lock(&_lock);
+	ss << "active " << _active << ", admitted " << _admitted
+		<< ", rejected " << _rejectedTotal << " (max_connections) "
+		<< _rejectedPerIp << " (per ip), " << _used << " addresses";
+	pthread_mutex_unlock(&_lock);
+	return ss.str();
+}
+
+// Fibonacci hashing: consecutive addresses spread over the whole table
+size_t	ConnectionLimiter::_home(uint32_t addr) const
+{
+	return (static_cast<uint32_t>(addr * 2654435769u) >> 8) & (_slots.size() - 1);
+}
+
+// The slot holding addr, or the free slot where it would go
+ConnectionLimiter::Slot&	ConnectionLimiter::_find(uint32_t addr)
+{
+	size_t mask = _slots.size() - 1;
+	size_t i = _home(addr);
+
+	while (_slots[i].count != 0 && _slots[i].addr != addr)
+		i = (i + 1) & mask;
+	return _slots[i];
+}
+
+// Backward-shift deletion: pull later entries of the probe run into the
+// hole so that lookups can keep stopping at the first free slot
+void	ConnectionLimiter::_erase(size_t index)
+{
+	size_t mask = _slots.size() - 1;
+	size_t hole = index;
+	size_t i = index;
+
+	_used--;
+	while (true)
+	{
+		i = (i + 1) & mask;
+		if (_slots[i].count == 0)
+			break;
+		size_t home = _home(_slots[i].addr);
+		// Move the entry unless its home lies cyclically in (hole, i]
+		if ((i > hole && (home <= hole || home > i))
+			|| (i < hole && (home <= hole && home > i)))
+		{
+			_slots[hole] = _slots[i];
+			hole = i;
+		}
+	}
+	_slots[hole].count = 0;
+}
+
+void	ConnectionLimiter::_grow()
+{
+	std::vector<Slot> old;
+	Slot empty;
+
+	empty.addr = 0;
+	empty.count = 0;
+	old.swap(_slots);
+	_slots.assign(old.size() * 2, empty);
+	for (size_t i = 0; i < old.size(); i++)
+	{
+		if (old[i].count != 0)
+			_find(old[i].addr) = old[i];
+	}
+}
@@ -0,0 +1,219 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   DiskPool.cpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: lwoiton <lwoiton@student.42prague.com>     +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/12/24 19:21:47 by lwoiton           #+#    #+#             */
+/*   Updated: 2024/12/24 19:21:47 by lwoiton          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "DiskPool.hpp"
+#include "Logger.hpp"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+__thread DiskCompletions*	DiskCompletions::_local = NULL;
+std::vector<pthread_t>		DiskPool::_threads;
+std::deque<DiskTask*>		DiskPool::_queue;
+pthread_mutex_t				DiskPool::_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t				DiskPool::_ready = PTHREAD_COND_INITIALIZER;
+bool						DiskPool::_stopping = false;
+
+DiskTask::DiskTask()
+	: _next(NULL)
+	, _completions(NULL)
+	, _owner(0)
+{
+}
+
+DiskTask::~DiskTask()
+{
+}
+
+void	DiskTask::setOwner(uint64_t tag)
+{
+	_owner = tag;
+}
+
+uint64_t	DiskTask::getOwner() const
+{
+	return _owner;
+}
+
+DiskTask*	DiskTask::getNext() const
+{
+	return _next;
+}
+
+DiskCompletions::DiskCompletions()
+	: _fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+	, _head(NULL)
+	, _inFlight(0)
+	, _submitter(0)
+{
+	if (_fd == -1)
+		throw std::runtime_error(std::string("Failed to create completion eventfd: ") + strerror(errno));
+}
+
+DiskCompletions::~DiskCompletions()
+{
+	close(_fd);
+}
+
+DiskCompletions&	DiskCompletions::local()
+{
+	if (!_local)
+		_local = new DiskCompletions();
+	return *_local;
+}
+
+// A pool thread may still be working for the owners just destroyed
+void	DiskCompletions::destroyLocal()
+{
+	if (!_local)
+		return;
+	while (_local->_inFlight > 0)
+	{
+		struct pollfd pfd = { _local->_fd, POLLIN, 0 };
+		poll(&pfd, 1, -1);
+		for (DiskTask* task = _local->take(); task; )
+		{
+			DiskTask* next = task->getNext();
+			delete task;
+			task = next;
+		}
+	}
+	delete _local;
+	_local = NULL;
+}
+
+int		DiskCompletions::getFd() const
+{
+	return _fd;
+}
+
+void	DiskCompletions::post(DiskTask* task)
+{
+	DiskTask* head;
+
+	do {
+		head = _head;
+		task->_next = head;
+	} while (!__sync_bool_compare_and_swap(&_head, head, task));
+	if (head == NULL)
+	{
+		uint64_t one = 1;
+		if (::write(_fd, &one, sizeof(one)) == -1 && errno != EAGAIN)
+			LOG_ERROR("Failed to signal disk completion: " + std::string(strerror(errno)));
+	}
+}
+
+// The eventfd is cleared before the list is taken: a post() that finds
+// the list empty afterwards signals again, so no completion is missed
+DiskTask*	DiskCompletions::take()
+{
+	uint64_t value;
+	while (::read(_fd, &value, sizeof(value)) > 0)
+		;
+
+	DiskTask* list = __sync_lock_test_and_set(&_head, static_cast<DiskTask*>(NULL));
+	DiskTask* ordered = NULL;
+	while (list)
+	{
+		DiskTask* next = list->_next;
+		list->_next = ordered;
+		ordered = list;
+		list = next;
+		_inFlight--;
+	}
+	return ordered;
+}
+
+size_t	DiskCompletions::getInFlight() const
+{
+	return _inFlight;
+}
+
+void	DiskCompletions::setSubmitter(uint64_t tag)
+{
+	_submitter = tag;
+}
+
+// Before any reactor runs, from the main thread
+void	DiskPool::start(size_t threads)
+{
+	_stopping = false;
+	for (size_t i = 0; i < threads; i++)
+	{
+		pthread_t thread;
+		int err = pthread_create(&thread, NULL, &DiskPool::_threadMain, NULL);
+		if (err != 0)
+		{
+			LOG_WARNING("Disk pool started with " + TO_STRING(i) + " threads: " + strerror(err));
+			break;
+		}
+		_threads.push_back(thread);
+	}
+}
+
+void	DiskPool::stop()
+{
+	pthread_mutex_lock(&_lock);
+	_stopping = true;
+	pthread_cond_broadcast(&_ready);
+	pthread_mutex_unlock(&_lock);
+	for (size_t i = 0; i < _threads.size(); i++)
+		pthread_join(_threads[i], NULL);
+	_threads.clear();
+}
+
+bool	DiskPool::isRunning()
+{
+	return !_threads.empty();
+}
+
+void	DiskPool::submit(DiskTask* task)
+{
+	DiskCompletions& completions = DiskCompletions::local();
+
+	task->_completions = &completions;
+	completions._inFlight++;
+	task->_owner = completions._submitter;
+	if (_threads.empty())
+	{
+		task->run();
+		completions.post(task);
+		return;
+	}
+	pthread_mutex_lock(&_lock);
+	_queue.push_back(task);
+	pthread_cond_signal(&_ready);
+	pthread_mutex_unlock(&_lock);
+}
+
+void*	DiskPool::_threadMain(void*)
+{
+	pthread_mutex_lock(&_lock);
+	for (;;)
+	{
+		while (_queue.empty() && !_stopping)
+			pthread_cond_wait(&_ready, &_lock);
+		if (_queue.empty())
+			break;
+		DiskTask* task = _queue.front();
+		_queue.pop_front();
+		pthread_mutex_unlock(&_lock);
+		task->run();
+		task->_completions->post(task);
+		pthread_mutex_lock(&_lock);
+	}
+	pthread_mutex_unlock(&_lock);
+	return NULL;
+}
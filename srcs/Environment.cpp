@@ -43,7 +43,7 @@ std::string Environment::parseQueryString(std::string uri) {
     return "";
 }
 
-void Environment::createEnv(HTTPRequest &req, std::string _path_to_script) {
+void Environment::createEnv(const HTTPRequest &req, std::string _path_to_script) {
 	
 	AddEnvVar(0, "REQUEST_METHOD", req.getMethod().c_str());
 	AddEnvVar(1, "SCRIPT_FILENAME", _path_to_script.c_str());
@@ -55,9 +55,9 @@ void Environment::createEnv(HTTPRequest &req, std::string _path_to_script) {
 		AddEnvVar(5, "QUERY_STRING", parseQueryString(req.getUri()).c_str());
 	}
 	else if (req.getMethod() == "POST") {
-		AddEnvVar(5, "CONTENT_TYPE", req.getHeader("Content-Type").c_str());
-		AddEnvVar(6, "CONTENT_LENGTH", req.getHeader("Content-Length").c_str());
-        LOG_DEBUG("Content-Length: " + req.getHeader("Content-Length"));
+		AddEnvVar(5, "CONTENT_TYPE", req.getHeader(HTTPRequest::HDR_CONTENT_TYPE).c_str());
+		AddEnvVar(6, "CONTENT_LENGTH", req.getHeader(HTTPRequest::HDR_CONTENT_LENGTH).c_str());
+        LOG_DEBUG("Content-Length: " + req.getHeader(HTTPRequest::HDR_CONTENT_LENGTH));
 	}
 }
 
@@ -28,14 +28,14 @@ EpollManager::~EpollManager()
         ::close(_epollFd);
 }
 
-void EpollManager::addSocket(int fd, uint32_t events)
+void EpollManager::addSocket(int fd, uint32_t events, uint64_t tag)
 {
     if (_epollFd == -1)
         throw std::runtime_error("EpollManager not initialized");
 
     struct epoll_event ev;
     ev.events = events;
-    ev.data.fd = fd;
+    ev.data.u64 = tag;
 
     if (::epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &ev) == -1)
     {
@@ -45,14 +45,14 @@ void EpollManager::addSocket(int fd, uint32_t events)
     }
 }
 
-void EpollManager::modifySocket(int fd, uint32_t events)
+void EpollManager::modifySocket(int fd, uint32_t events, uint64_t tag)
 {
     if (_epollFd == -1)
         throw std::runtime_error("EpollManager not initialized");
 
     struct epoll_event ev;
     ev.events = events;
-    ev.data.fd = fd;
+    ev.data.u64 = tag;
 
     if (::epoll_ctl(_epollFd, EPOLL_CTL_MOD, fd, &ev) == -1)
     {
@@ -0,0 +1,80 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   EpollPoller.cpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: lwoiton <lwoiton@student.42prague.com>     +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/12/22 17:40:12 by lwoiton           #+#    #+#             */
+/*   Updated: 2024/12/22 17:40:12 by lwoiton          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "EpollPoller.hpp"
+#include <unistd.h>
+#include <stdexcept>
+
+EpollPoller::EpollPoller()
+	: _epollFd(epoll_create1(EPOLL_CLOEXEC))
+	, _syscalls(1)
+{
+	if (_epollFd == -1)
+		throw std::runtime_error("Failed to create epoll instance");
+}
+
+EpollPoller::~EpollPoller()
+{
+	close(_epollFd);
+}
+
+void	EpollPoller::control(int op, int fd, uint32_t events, uint64_t tag)
+{
+	struct epoll_event ev;
+	ev.events = events;
+	ev.data.u64 = tag;
+	epoll_ctl(_epollFd, op, fd, &ev);
+	_syscalls++;
+}
+
+void	EpollPoller::add(int fd, uint32_t events, uint64_t tag)
+{
+	control(EPOLL_CTL_ADD, fd, events, tag);
+}
+
+void	EpollPoller::modify(int fd, uint32_t events, uint64_t tag)
+{
+	control(EPOLL_CTL_MOD, fd, events, tag);
+}
+
+void	EpollPoller::remove(int fd)
+{
+	epoll_ctl(_epollFd, EPOLL_CTL_DEL, fd, NULL);
+	_syscalls++;
+}
+
+int	EpollPoller::wait(Event* events, int maxEvents, int timeoutMs)
+{
+	struct epoll_event	ready[MAX_EVENTS];
+
+	if (maxEvents > MAX_EVENTS)
+		maxEvents = MAX_EVENTS;
+	int nfds = epoll_wait(_epollFd, ready, maxEvents, timeoutMs);
+	_syscalls++;
+	for (int i = 0; i < nfds; i++)
+	{
+		events[i].tag = ready[i].data.u64;
+		events[i].events = ready[i].events;
+		events[i].kind = READY;
+	}
+	return nfds;
+}
+
+const char*	EpollPoller::getName() const
+{
+	return "epoll";
+}
+
+size_t	EpollPoller::getSyscalls() const
+{
+	return _syscalls;
+}
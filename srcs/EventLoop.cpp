@@ -11,28 +11,64 @@
 /* ************************************************************************** */
 
 #include "EventLoop.hpp"
+#include "IOHandler.hpp"
+#include "EpollPoller.hpp"
+#include "UringPoller.hpp"
+#include "BufferPool.hpp"
+#include "DiskPool.hpp"
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <sstream>
+#include <time.h>
 
-EventLoop*	EventLoop::_instance = NULL;
+__thread EventLoop*	EventLoop::_instance = NULL;
+
+static uint64_t	monotonicNs()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
 
 EventLoop::EventLoop()
-	: _epollFd(-1)
-	, _running(false)
+	: _poller(new EpollPoller())
+	, _wakeFd(-1)
+	, _diskFd(-1)
+	, _running(true) // Cleared by stop(), possibly before run() is entered
+	, _drainRequested(false)
+	, _draining(false)
+	, _edgeTriggered(false)
 {
-	_epollFd = epoll_create1(0);
-	if (_epollFd == -1)
-		throw std::runtime_error("Failed to create epoll instance");
+	// The wake fd lets stop() interrupt the wait from another thread.
+	// It is the only entry registered with WAKE_TAG.
+	_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (_wakeFd == -1)
+	{
+		delete _poller;
+		throw std::runtime_error("Failed to create wake eventfd");
+	}
+	_poller->add(_wakeFd, EPOLLIN, WAKE_TAG);
+	if (DiskPool::isRunning())
+	{
+		_diskFd = DiskCompletions::local().getFd();
+		_poller->add(_diskFd, EPOLLIN, DISK_TAG);
+	}
 }
 
 EventLoop::~EventLoop()
 {
-	if (_epollFd != -1)
-		close(_epollFd);
-	
-	std::map<int, IOHandler*>::iterator it;
-	for (it = _handlers.begin(); it != _handlers.end(); it++)
-		delete it->second;
+	flushClosed();
+	for (size_t fd = 0; fd < _handlers.capacity(); fd++)
+		delete _handlers.get(fd);
+
+	delete _poller;
+	if (_wakeFd != -1)
+		close(_wakeFd);
 }
 
+// Returns the loop owned by the calling thread
 EventLoop*	EventLoop::getInstance()
 {
 	if (!_instance)
@@ -40,14 +76,93 @@ EventLoop*	EventLoop::getInstance()
 	return _instance;
 }
 
+void	EventLoop::destroyInstance()
+{
+	delete _instance;
+	_instance = NULL;
+}
+
 void	EventLoop::removeHandler(IOHandler* handler)
 {
-	if (!handler)
+	if (!handler || handler->_closing)
+		return;
+	handler->_closing = true;
+	unhook(handler);
+	_closing.push_back(handler);
+}
+
+// For a handler that closes its own fd but stays alive until its owner
+// calls removeHandler(): the fd leaves the table and the poller first, so
+// neither keeps an entry that a reused fd number could run into
+void	EventLoop::detachHandler(IOHandler* handler)
+{
+	if (!handler || handler->_closing || _handlers.get(handler->getFd()) != handler)
+		return;
+	unhook(handler);
+	_poller->remove(handler->getFd());
+	_stats.ctlCalls++;
+}
+
+// Later events and retries for handler are dropped
+void	EventLoop::unhook(IOHandler* handler)
+{
+	if (_handlers.get(handler->getFd()) == handler)
+		_handlers.erase(handler->getFd());
+	std::replace(_pending.begin(), _pending.end(), handler, static_cast<IOHandler*>(NULL));
+	std::replace(_retrying.begin(), _retrying.end(), handler, static_cast<IOHandler*>(NULL));
+	std::replace(_starved.begin(), _starved.end(), handler, static_cast<IOHandler*>(NULL));
+}
+
+// Handlers are only destroyed here, once nothing from the current batch
+// can refer to them any more
+void	EventLoop::flushClosed()
+{
+	if (_closing.empty())
 		return;
-	epoll_ctl(_epollFd, EPOLL_CTL_DEL, handler->getFd(), NULL);
-	_handlers.erase(handler->getFd());
 
-	delete handler;
+	uint64_t	start = monotonicNs();
+	size_t		count = 0;
+	std::vector<IOHandler*> batch;
+	while (!_closing.empty())
+	{
+		batch.swap(_closing);  // Destructors may remove further handlers
+		for (size_t i = 0; i < batch.size(); i++)
+		{
+			if (batch[i]->getFd() != -1)  // -1: detached and closed already
+			{
+				_poller->remove(batch[i]->getFd());
+				_stats.ctlCalls++;
+			}
+			delete batch[i];
+		}
+		count += batch.size();
+		batch.clear();
+	}
+	_stats.closed += count;
+	_stats.closeBatches++;
+	if (count > _stats.maxCloseBatch)
+		_stats.maxCloseBatch = count;
+	_stats.teardownNs += monotonicNs() - start;
+}
+
+// Gives paused readers their EPOLLIN back once this thread has a free block
+// or a slab fits in the budget again; a reader that still finds no memory
+// parks itself once more
+void	EventLoop::resumeStarved()
+{
+	if (_starved.empty()
+		|| (BufferPool::local().getFreeBlocks() == 0 && !BufferPool::hasRoom()))
+		return;
+	std::vector<IOHandler*> batch;
+	batch.swap(_starved);
+	for (size_t i = 0; i < batch.size(); i++)
+	{
+		IOHandler* handler = batch[i];
+		if (!handler)
+			continue;
+		handler->_starved = false;
+		updateHandlerEvents(handler);
+	}
 }
 
 // Register a new I/O handler
@@ -55,77 +170,359 @@ void	EventLoop::registerHandler(IOHandler* handler)
 {
 	if (!handler)
 		return;
-	struct epoll_event ev;
-	ev.data.ptr = handler;  // Store pointer to handler instead of just fd
-	ev.events = 0;    // We need to use level-triggered mode because of the subject
-	
-	// Set events based on handler's needs
-	if (handler->wantsToRead())
-		ev.events |= EPOLLIN;
-	if (handler->wantsToWrite())
-		ev.events |= EPOLLOUT;
-		
-	epoll_ctl(_epollFd, EPOLL_CTL_ADD, handler->getFd(), &ev);
-	_handlers[handler->getFd()] = handler;
+	uint64_t tag = _handlers.insert(handler->getFd(), handler);  // fd + generation tag
+	uint32_t mask = interestMask(handler);
+	Poller::Completion completion = _poller->supportsCompletions()
+		? handler->getCompletion() : Poller::NO_COMPLETION;
+
+	try {
+		_poller->addCompletion(handler->getFd(), mask, tag, completion);
+	}
+	catch (...) {
+		_handlers.erase(handler->getFd());  // The caller still owns handler
+		throw;
+	}
+	_stats.ctlCalls++;
+	handler->_interest = mask;
+	handler->_completes = completion != Poller::NO_COMPLETION;
+}
+
+// Safe to call from any thread
+void	EventLoop::stop()
+{
+	uint64_t one = 1;
+
+	_running = false;
+	if (::write(_wakeFd, &one, sizeof(one)) == -1 && errno != EAGAIN)
+		LOG_ERROR("Failed to wake event loop: " + std::string(strerror(errno)));
+}
+
+// Safe to call from any thread
+void	EventLoop::drain()
+{
+	uint64_t one = 1;
+
+	_drainRequested = true;
+	if (::write(_wakeFd, &one, sizeof(one)) == -1 && errno != EAGAIN)
+		LOG_ERROR("Failed to wake event loop: " + std::string(strerror(errno)));
+}
+
+// Listeners remove themselves, idle connections close, busy ones finish
+// their current response without keep-alive
+void	EventLoop::beginDrain()
+{
+	_draining = true;
+	for (size_t fd = 0; fd < _handlers.capacity(); fd++)
+	{
+		IOHandler* handler = _handlers.get(fd);
+		if (handler)
+			handler->onDrain();
+	}
+	flushClosed();
+}
+
+void	EventLoop::drainWakeFd()
+{
+	uint64_t value;
+	while (::read(_wakeFd, &value, sizeof(value)) > 0)
+		;
+}
+
+// Finished pool tasks go to their handler if it is still around; the
+// handler may want to write again now
+void	EventLoop::completeDiskTasks()
+{
+	for (DiskTask* task = DiskCompletions::local().take(); task; )
+	{
+		DiskTask* next = task->getNext();
+		IOHandler* handler = _handlers.lookup(task->getOwner());
+		if (handler && !handler->_closing)
+		{
+			setSubmitter(handler);
+			handler->onDiskDone(task);
+			updateHandlerEvents(handler);
+		}
+		delete task;
+		_stats.diskTasks++;
+		task = next;
+	}
+}
+
+void	EventLoop::setEdgeTriggered(bool enabled)
+{
+	_edgeTriggered = enabled;
+}
+
+bool	EventLoop::useIoUring()
+{
+	Poller* poller;
+
+	try
+	{
+		poller = new UringPoller();
+	}
+	catch (const std::exception& e)
+	{
+		LOG_WARNING(std::string("io_uring unavailable, staying on epoll: ") + e.what());
+		return false;
+	}
+	delete _poller;
+	_poller = poller;
+	_poller->add(_wakeFd, EPOLLIN, WAKE_TAG);
+	if (_diskFd != -1)
+		_poller->add(_diskFd, EPOLLIN, DISK_TAG);
+	return true;
+}
+
+bool	EventLoop::isEdgeTriggered() const
+{
+	return _edgeTriggered;
+}
+
+EventLoop::Stats&	EventLoop::getStats()
+{
+	return _stats;
+}
+
+TimerWheel&	EventLoop::getTimers()
+{
+	return _timers;
+}
+
+void	EventLoop::logStats() const
+{
+	std::stringstream ss;
+	ss << "EventLoop stats (" << _poller->getName() << ", "
+	   << (_edgeTriggered ? "edge" : "level") << "-triggered): "
+	   << _stats.requests << " requests, "
+	   << _stats.waitCalls << " waits, "
+	   << _stats.ctlCalls << " registration changes (" << _stats.ctlSkipped << " avoided), "
+	   << _poller->getSyscalls() << " " << _poller->getName() << " syscalls, "
+	   << _stats.readCalls << " read, "
+	   << _stats.writeCalls << " write, "
+	   << _stats.acceptCalls << " accept, "
+	   << _stats.completions << " completions, "
+	   << _stats.timeouts << " timeouts";
+	if (_stats.requests > 0)
+	{
+		size_t syscalls = _poller->getSyscalls() + _stats.readCalls + _stats.writeCalls
+			+ _stats.acceptCalls;
+		ss << " (" << static_cast<double>(syscalls) / _stats.requests << " syscalls/request)";
+	}
+	if (_stats.closed > 0)
+		ss << "; teardown: " << _stats.closed << " handlers in " << _stats.closeBatches
+		   << " batches (max " << _stats.maxCloseBatch << "), "
+		   << _stats.teardownNs / _stats.closed << " ns/handler";
+	if (_stats.starved > 0)
+		ss << "; " << _stats.starved << " reads paused on the buffer budget";
+	if (_stats.diskTasks > 0)
+		ss << "; " << _stats.diskTasks << " disk tasks";
+	if (_stats.accepts.getWakeups() > 0)
+		ss << "; accepts per wakeup: " << _stats.accepts.toString();
+	LOG_INFO(ss.str());
 }
     
 // Main event loop
 void	EventLoop::run()
 {
 	const int MAX_EVENTS = 64;
-	struct epoll_event events[MAX_EVENTS];
+	Poller::Event events[MAX_EVENTS];
 	
 	while (_running) {
-		int nfds = epoll_wait(_epollFd, events, MAX_EVENTS, -1);
+		if (_drainRequested && !_draining)
+			beginDrain();
+		if (_draining && _handlers.size() == 0)
+			break;
+
+		// Handlers left with unread or unsent data must not wait for an edge
+		_retrying.swap(_pending);
+		_pending.clear();
+		resumeStarved();
+		int timeout = _retrying.empty() ? _timers.nextTimeout(TimerWheel::now()) : 0;
+		if (!_starved.empty() && (timeout < 0 || timeout > STARVED_POLL_MS))
+			timeout = STARVED_POLL_MS;
+
+		int nfds = _poller->wait(events, MAX_EVENTS, timeout);
+		_stats.waitCalls++;
+		if (nfds == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			throw std::runtime_error(std::string(_poller->getName()) + " wait failed: " + strerror(errno));
+		}
 		
 		for (int i = 0; i < nfds; i++) {
-			IOHandler* handler = static_cast<IOHandler*>(events[i].data.ptr);
-			
+			if (events[i].tag == WAKE_TAG) {
+				drainWakeFd();
+				continue;
+			}
+			if (events[i].tag == DISK_TAG) {
+				completeDiskTasks();
+				continue;
+			}
+			IOHandler* handler = _handlers.lookup(events[i].tag);
+			if (!handler) {
+				// Removed earlier in this batch, or queued for an older use of the fd
+				_stats.staleEvents++;
+				dropCompletion(events[i]);
+				continue;
+			}
+			if (events[i].kind == Poller::READY)
+				dispatch(handler, events[i].events);
+			else
+				complete(handler, events[i]);
+		}
+
+		for (size_t i = 0; i < _retrying.size(); i++) {
+			IOHandler* handler = _retrying[i];
+			if (handler)
+				dispatch(handler, interestMask(handler) & (EPOLLIN | EPOLLOUT));
+		}
+		_retrying.clear();
+
+		// Expired handlers remove themselves from their onTimeout()
+		_stats.timeouts += _timers.advance(TimerWheel::now());
+		flushClosed();
+	}
+}
+
+void	EventLoop::dispatch(IOHandler* handler, uint32_t events)
+{
+	// The poller reads for completion handlers, a read() here would race it
+	if (handler->_completes)
+		events &= ~static_cast<uint32_t>(EPOLLIN);
+	setSubmitter(handler);
+	try {
+		if (events & (EPOLLERR | EPOLLHUP)) {
+			// Handle error events
+			removeHandler(handler);
+			return;
+		}
+		
+		// Handle read events
+		if (events & EPOLLIN) {
+			if (!handler->handleRead()) {
+				removeHandler(handler);
+				return;
+			}
+			updateHandlerEvents(handler);
+		}
+		
+		// Handle write events
+		if (events & EPOLLOUT) {
+			if (!handler->handleWrite()) {
+				removeHandler(handler);
+				return;
+			}
+			updateHandlerEvents(handler);
+		}
+
+		if (_edgeTriggered && handler->hasPendingIO() && !handler->_closing)
+			_pending.push_back(handler);
+		trackStarved(handler);
+	}
+	catch (const std::exception& e) {
+		// Log error and remove handler
+		LOG_ERROR("Error handling I/O event: " + std::string(e.what()));
+		removeHandler(handler);
+	}
+}
+
+// An accept or receive the poller did for handler. The receive buffer goes
+// back to the kernel as soon as the handler has copied from it.
+void	EventLoop::complete(IOHandler* handler, const Poller::Event& event)
+{
+	_stats.completions++;
+	setSubmitter(handler);
+	try {
+		if (event.kind == Poller::ACCEPTED)
+			handler->handleAccepted(event.result);
+		else if (event.result <= 0)
+		{
+			// EOF or a receive error
+			removeHandler(handler);
+			return;
+		}
+		else
+		{
+			bool keep;
 			try {
-				if (events[i].events & (EPOLLERR | EPOLLHUP)) {
-					// Handle error events
-					removeHandler(handler);
-					updateHandlerEvents(handler);
-					continue;
-				}
-				
-				// Handle read events
-				if (events[i].events & EPOLLIN) {
-					if (!handler->handleRead()) {
-						removeHandler(handler);
-						continue;
-					}
-					updateHandlerEvents(handler);
-				}
-				
-				// Handle write events
-				if (events[i].events & EPOLLOUT) {
-					if (!handler->handleWrite()) {
-						removeHandler(handler);
-						continue;
-					}
-					updateHandlerEvents(handler);
-				}
+				keep = handler->handleReceived(_poller->getBuffer(event.buffer), event.result);
+			}
+			catch (...) {
+				_poller->releaseBuffer(event.buffer);
+				throw;
 			}
-			catch (const std::exception& e) {
-				// Log error and remove handler
-				LOG_ERROR("Error handling I/O event: " << e.what());
+			_poller->releaseBuffer(event.buffer);
+			if (!keep)
+			{
 				removeHandler(handler);
+				return;
 			}
 		}
+		updateHandlerEvents(handler);
+		trackStarved(handler);
 	}
+	catch (const std::exception& e) {
+		LOG_ERROR("Error handling I/O completion: " + std::string(e.what()));
+		removeHandler(handler);
+	}
+}
+
+// A completion for a handler that is gone still owns its fd or buffer
+void	EventLoop::dropCompletion(const Poller::Event& event)
+{
+	if (event.kind == Poller::ACCEPTED && event.result >= 0)
+		close(event.result);
+	else if (event.kind == Poller::RECEIVED && event.result > 0)
+		_poller->releaseBuffer(event.buffer);
+}
+
+// Disk tasks submitted from here on come back to handler
+void	EventLoop::setSubmitter(IOHandler* handler)
+{
+	if (_diskFd != -1)
+		DiskCompletions::local().setSubmitter(_handlers.tagOf(handler->getFd()));
+}
+
+void	EventLoop::trackStarved(IOHandler* handler)
+{
+	if (handler->_starved && !handler->_closing
+		&& std::find(_starved.begin(), _starved.end(), handler) == _starved.end())
+	{
+		_starved.push_back(handler);
+		_stats.starved++;
+	}
+}
+
+uint32_t	EventLoop::interestMask(IOHandler* handler) const
+{
+	uint32_t events = 0;   // We need to use level-triggered mode because of the subject
+
+	if (_edgeTriggered)    // ...unless epoll_mode edge is configured
+		events |= EPOLLET;
+
+	if (handler->wantsToRead() && !handler->_starved) // Should be clearly handled by state management
+		events |= EPOLLIN;
+	if (handler->wantsToWrite()) // Should be clearly handled by state management
+		events |= EPOLLOUT;
+	return events;
 }
 	
+// Only talks to the kernel when wantsToRead()/wantsToWrite() changed since
+// the last registration change; under keep-alive most calls end here.
 void	EventLoop::updateHandlerEvents(IOHandler* handler)
 {
-	struct epoll_event ev;
-	ev.data.ptr = handler;
-	ev.events = 0;   // We need to use level-triggered mode because of the subject
-	
-	if (handler->wantsToRead()) // Should be clearly handled by state management
-		ev.events |= EPOLLIN;
-	if (handler->wantsToWrite()) // Should be clearly handled by state management
-		ev.events |= EPOLLOUT;
-		
-	epoll_ctl(_epollFd, EPOLL_CTL_MOD, handler->getFd(), &ev);
+	if (handler->_closing)
+		return;
+	uint32_t mask = interestMask(handler);
+	if (mask == handler->_interest)
+	{
+		_stats.ctlSkipped++;
+		return;
+	}
+
+	_poller->modify(handler->getFd(), mask, _handlers.tagOf(handler->getFd()));
+	_stats.ctlCalls++;
+	handler->_interest = mask;
 }
@@ -16,19 +16,26 @@
 #include <fcntl.h>
 
 FileHandler::FileHandler(ClientConnection& parent, const std::string& path)
-    : IOHandler(open(path.c_str(), O_RDONLY | O_NONBLOCK))
+    : IOHandler(-1)
+    , _fd(open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC))
     , _parent(parent)
     , _bytesRead(0)
 {
     struct stat st;
-    if (stat(path.c_str(), &st) == -1)
+    if (_fd == -1 || fstat(_fd, &st) == -1) {
+        if (_fd != -1)
+            close(_fd);
         throw HTTPError(404, "File not found");
+    }
     
     _fileSize = st.st_size;
     _parent.getResponse().setHeader("Content-Length", toString(_fileSize));
 }
 
-FileHandler::~FileHandler() {}
+FileHandler::~FileHandler() {
+    if (_fd != -1)
+        close(_fd);
+}
 
 bool FileHandler::handleRead()
 {
@@ -66,5 +73,5 @@ bool FileHandler::wantsToWrite() const {
 }
 
 int FileHandler::getFd() const {
-    return IOHandler::getFd();
+    return _fd;
 }
@@ -0,0 +1,211 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   FileWriter.cpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: lwoiton <lwoiton@student.42prague.com>     +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/12/24 16:05:12 by lwoiton           #+#    #+#             */
+/*   Updated: 2024/12/24 16:05:12 by lwoiton          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "FileWriter.hpp"
+#include "DiskPool.hpp"
+#include "HTTPError.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+
+// One write at an offset: bytes, or a copy from a pipe or a file. run()
+// only records errno, the owner reports it.
+class FileWrite : public DiskTask
+{
+	public:
+		// data must outlive run(); takeData() makes the task keep a copy
+		FileWrite(int fd, off_t offset, const char* data, size_t len)
+			: _fd(fd), _offset(offset), _data(data), _len(len), _srcFd(-1), _srcOffset(0), _error(0) {}
+		FileWrite(int fd, off_t offset, int srcFd, off_t srcOffset, size_t len)
+			: _fd(fd), _offset(offset), _data(NULL), _len(len), _srcFd(srcFd), _srcOffset(srcOffset), _error(0) {}
+		virtual ~FileWrite()
+		{
+			for (size_t i = 0; i < _owned.size(); i++)
+				close(_owned[i]);
+		}
+		virtual void	run()
+		{
+			size_t done = 0;
+
+			while (done < _len)
+			{
+				ssize_t n;
+				if (_data)
+					n = pwrite(_fd, _data + done, _len - done, _offset + done);
+				else if (_srcOffset < 0)
+				{
+					loff_t out = _offset + done;
+					n = splice(_srcFd, NULL, _fd, &out, _len - done, SPLICE_F_MOVE);
+				}
+				else
+				{
+					off_t in = _srcOffset + done;
+					lseek(_fd, _offset + done, SEEK_SET);
+					n = sendfile(_fd, _srcFd, &in, _len - done);
+				}
+				if (n == -1 && errno == EINTR)
+					continue;
+				if (n <= 0)
+				{
+					_error = n == 0 ? EIO : errno;
+					return;
+				}
+				done += n;
+			}
+		}
+		void			takeData(std::vector<char>& data)
+		{
+			_buffer.swap(data);
+			_data = &_buffer[0];
+		}
+		bool			uses(int fd) const { return fd == _fd || fd == _srcFd; }
+		bool			isCopy() const { return _data == NULL; }
+		void			adoptFd(int fd) { _owned.push_back(fd); }
+		int				getError() const { return _error; }
+
+	private:
+		int					_fd;
+		off_t				_offset;
+		const char*			_data;
+		size_t				_len;
+		std::vector<char>	_buffer;
+		int					_srcFd;
+		off_t				_srcOffset;
+		int					_error;
+		std::vector<int>	_owned;		// Closed by the destructor
+};
+
+const size_t FileWriter::STAGE_LIMIT;
+
+static void	throwWriteError(int error)
+{
+	throw HTTPError(500, std::string("Failed to write request body: ") + strerror(error));
+}
+
+FileWriter::FileWriter()
+	: _task(NULL)
+	, _stagedFd(-1)
+	, _stagedOffset(0)
+{
+}
+
+FileWriter::~FileWriter()
+{
+}
+
+void	FileWriter::write(int fd, off_t offset, const char* data, size_t len)
+{
+	if (len == 0)
+		return;
+	if (!DiskPool::isRunning())
+	{
+		FileWrite now(fd, offset, data, len);
+		now.run();
+		if (now.getError())
+			throwWriteError(now.getError());
+		return;
+	}
+	if (_task)
+	{
+		if (_staged.empty())
+		{
+			_stagedFd = fd;
+			_stagedOffset = offset;
+		}
+		if (fd == _stagedFd && offset == _stagedOffset + static_cast<off_t>(_staged.size()))
+		{
+			_staged.insert(_staged.end(), data, data + len);
+			return;
+		}
+	}
+	std::vector<char> copy(data, data + len);
+	FileWrite* task = new FileWrite(fd, offset, NULL, len);
+	task->takeData(copy);
+	_submit(task);
+}
+
+void	FileWriter::copy(int fd, off_t offset, int srcFd, off_t srcOffset, size_t len)
+{
+	if (len == 0)
+		return;
+	_submit(new FileWrite(fd, offset, srcFd, srcOffset, len));
+}
+
+// With one task in flight already, or without a DiskPool, the write
+// happens right here
+void	FileWriter::_submit(FileWrite* task)
+{
+	if (_task || !DiskPool::isRunning())
+	{
+		task->run();
+		int error = task->getError();
+		delete task;
+		if (error)
+			throwWriteError(error);
+		return;
+	}
+	_task = task;
+	DiskPool::submit(task);
+}
+
+void	FileWriter::closeFd(int fd)
+{
+	if (fd == -1)
+		return;
+	if (fd == _stagedFd)
+		_staged.clear();
+	if (_task && _task->uses(fd))
+		_task->adoptFd(fd);
+	else
+		close(fd);
+}
+
+void	FileWriter::reset()
+{
+	_task = NULL;
+	_staged.clear();
+	_stagedFd = -1;
+}
+
+DiskTask*	FileWriter::getDiskWait() const
+{
+	return _task;
+}
+
+bool	FileWriter::isBacklogged() const
+{
+	return _task && (_task->isCopy() || _staged.size() >= STAGE_LIMIT);
+}
+
+// Sends what was staged meanwhile as the next task
+bool	FileWriter::diskDone(DiskTask* task)
+{
+	if (!task || task != _task)
+		return false;
+	int error = _task->getError();
+	_task = NULL;
+	if (error)
+	{
+		_staged.clear();
+		throwWriteError(error);
+	}
+	if (!_staged.empty())
+	{
+		FileWrite* next = new FileWrite(_stagedFd, _stagedOffset, NULL, _staged.size());
+		next->takeData(_staged);
+		_staged.clear();
+		_submit(next);
+	}
+	return true;
+}
@@ -13,25 +13,35 @@
 #include "HTTPRequest.hpp"
 #include "Utils.hpp"
 #include <string.h>
+#include <strings.h>
 #include <algorithm>
 #include <cstdlib>
 
 HTTPRequest::HTTPRequest()
 	: _state(REQUEST_LINE)
+	, _bodyType(NO_BODY)
+	, _bodyLength(0)
+	, _chunkState(CHUNK_SIZE)
+	, _chunkRemaining(0)
+	, _chunkDigits(0)
 	, _url(NULL)
+	, _scanned(0)
+	, _bodySink(NULL)
+	, _bodySinkOffered(false)
 	, _multipartState(NULL)
 {
-	
+	clearKnownHeaders();
 }
 
 HTTPRequest::~HTTPRequest()
 {
+	delete _bodySink;
 	// delete _url;
 	// if (_multipartState)
 	// 	delete _multipartState;
 }
 
-void HTTPRequest::parse(std::vector<char> &data)
+void HTTPRequest::parse(Buffer &data)
 {
 	if(_state == REQUEST_LINE)
 		parseRequestLine(data);
@@ -45,15 +55,19 @@ void HTTPRequest::parse(std::vector<char> &data)
 }
 
 
-void HTTPRequest::parseRequestLine(std::vector<char> &data)
+void HTTPRequest::parseRequestLine(Buffer &data)
 {
     size_t index = 0;
     const size_t data_size = data.size();
 
-    // 1. Check if we have enough data for a complete request line
-    size_t eol = HTTPUtils::findEOL(data);
+    // 1. Check if we have enough data for a complete request line, the
+    //    bytes searched by earlier calls are not searched again
+    size_t eol = HTTPUtils::findEOL(data.data(), data_size, _scanned);
     if (eol == std::string::npos)
+    {
+        _scanned = data_size > 0 ? data_size - 1 : 0; // CR may be the last byte
         return; // Need more data
+    }
 
     // 2. Parse Method (token)
     while (index < data_size && HTTPUtils::isToken(static_cast<unsigned char>(data[index]))) {
@@ -64,7 +78,7 @@ void HTTPRequest::parseRequestLine(std::vector<char> &data)
     if (_method.empty())
         throw HTTPError(400, "Bad Request: No Method");
 	// Server only supports GET, POST and DELETE methods
-    if (_method != "GET" && _method != "POST" && _method != "DELETE" && _method != "HEAD")
+    if (_method != "GET" && _method != "POST" && _method != "DELETE" && _method != "HEAD" && _method != "PUT")
         throw HTTPError(405, "Method Not Allowed");
 
     // 3. Exactly one SP after method
@@ -103,7 +117,7 @@ void HTTPRequest::parseRequestLine(std::vector<char> &data)
         throw HTTPError(505, "HTTP Version Not Supported");
 
     // 7. Must end with CRLF
-	if (HTTPUtils::findEOL(data, index) != index)
+	if (HTTPUtils::findEOL(data.data(), data_size, index) != index)
 		throw HTTPError(400, "Bad Request: Invalid line ending");
     index += 2;
 
@@ -119,7 +133,8 @@ void HTTPRequest::parseRequestLine(std::vector<char> &data)
 	// Check Request Line 
 
     // Remove parsed data from buffer
-    data.erase(data.begin(), data.begin() + index);
+    data.consume(index);
+    _scanned = 0;
     _state = HEADERS;
 	LOG_DEBUG("Parse State change to 'HEADERS'");
 }
@@ -127,105 +142,252 @@ void HTTPRequest::parseRequestLine(std::vector<char> &data)
 /**
  * @brief Parses the HTTP headers from the provided data buffer.
  *
- * This function processes the HTTP headers from the given data buffer and stores them in the 
- * _headers map. It expects the headers to be in the format specified by RFC 7230, Section 3.2.
- * The function looks for the end of the header section, which is indicated by a double CRLF 
- * sequence (\r\n\r\n). Each header field is expected to have a field name followed by a colon 
- * and a field value. Optional whitespace (OWS) around the colon and at the end of the field 
- * value is ignored.
+ * This function waits for the end of the header section, which is indicated by a double CRLF
+ * sequence (\r\n\r\n). The search resumes where the previous call stopped, so a header section
+ * that arrives in many small reads is scanned once. The complete section is then copied into
+ * _headerBlock in one piece and parseFields() records every field as offsets into it; no
+ * string is built until getHeader() is called. The block keeps its capacity across reset().
  * 
- * @param data A vector of characters containing the raw HTTP request data.
+ * @param data Buffer holding the raw HTTP request data.
  *
  * @throws HTTPError If the header format is invalid (e.g., missing colon or invalid characters 
  *                   in the header name).
  *
- * @note This function modifies the input data buffer by removing the parsed headers.
+ * @return true once the whole section was parsed, false while more data is needed
+ *
+ * @note This function consumes the parsed headers from the input buffer.
  * 
  * @see RFC 7230, Section 3.2: https://tools.ietf.org/html/rfc7230#section-3.2
  */
-void HTTPRequest::parseHeaders(std::vector<char>& data, bool isTrailer)
+bool HTTPRequest::parseHeaders(Buffer& data, bool isTrailer)
 {
-    size_t index = 0;
-    
-    // Check for complete header section (ends with \r\n\r\n)
-    size_t header_end = HTTPUtils::findHeaderEnd(data);
-    if (header_end == std::string::npos)
-        return; // Need more data
-    
-        
-    while (index < header_end) {
+    size_t header_end;
+
+    // No fields at all: only the CRLF ending the section is left
+    if (data.size() >= 2 && data[0] == '\r' && data[1] == '\n')
+        header_end = 0;
+    else
+    {
+        // Check for complete header section (ends with \r\n\r\n)
+        header_end = HTTPUtils::findHeaderEnd(data.data(), data.size(), _scanned);
+        if (header_end == std::string::npos)
+        {
+            // The terminator may straddle the end of what we have
+            _scanned = data.size() > 3 ? data.size() - 3 : 0;
+            return false; // Need more data
+        }
+        header_end += 2; // Keep the CRLF of the last field
+    }
+
+    size_t base = _headerBlock.size();
+    _headerBlock.insert(_headerBlock.end(), data.data(), data.data() + header_end);
+    data.consume(header_end + 2); // +2 for the final \r\n
+    _scanned = 0;
+    parseFields(base, _headerBlock.size(), isTrailer);
+
+	if (!isTrailer)
+	{
+		LOG_DEBUG("Parse State change to 'BODY_INIT'");
+    	_state = BODY_INIT;
+	}
+	return true;
+}
+
+/**
+ * @brief Splits _headerBlock[index, end) into header fields
+ * @details Each field is "name: OWS value OWS CRLF". Line folding (obs-fold) is replaced
+ *          with spaces in place, as RFC 7230 Section 3.2.4 allows.
+ */
+void HTTPRequest::parseFields(size_t index, size_t end, bool isTrailer)
+{
+    if (index >= end)
+        return;
+    char* block = &_headerBlock[0];
+
+    while (index < end) {
         // Find the colon
-        size_t colon = HTTPUtils::findNextColon(data, index);
-        if (colon == std::string::npos) {
-            std::cout << "Header line: " << std::string(data[0], data[header_end]) << std::endl;
-            std::cout << "ERROR THROWS HERE 1" << std::endl;
+        size_t colon = HTTPUtils::findNextColon(block, end, index);
+        if (colon == std::string::npos || colon == index)
             throw HTTPError(400, "Invalid Header Format");
-        }
-            
-        // Extract field name (token)
-        std::string name;
-        while (index < colon) {
-            char c = static_cast<unsigned char>(data[index]);
-            if (!HTTPUtils::isToken(static_cast<unsigned char>(c))) {   
+
+        // Field name (token)
+        HeaderField field;
+        field.name = index;
+        field.nameLength = colon - index;
+        for (; index < colon; ++index) {
+            if (!HTTPUtils::isToken(static_cast<unsigned char>(block[index])))
                 throw HTTPError(400, "Invalid Header Name");
-            }
-            name += c;
-            index++;
         }
-        
-        // Skip colon and OWS (Optional WhiteSpace)
-        index++; // skip colon
-        while (index < header_end && HTTPUtils::isOWS(data[index]))
-            index++;
-            
-        // Extract field value
-        std::string value;
-        while (index < header_end)
-		{
-            // Handle line folding (obs-fold)
-            if (data[index] == '\r' && index + 1 < header_end && data[index + 1] == '\n')
-			{
-                if (index + 2 < header_end && (data[index + 2] == ' ' || data[index + 2] == '\t'))
-				{
-                    index += 2;
-                    continue;
-                }
-                break;
-            }
-            value += data[index++];
+
+        // Field value up to a CRLF that is not followed by SP or HTAB.
+        // The block ends with CRLF, so there always is one.
+        size_t eol = HTTPUtils::findEOL(block, end, colon + 1);
+        while (eol + 2 < end && (block[eol + 2] == ' ' || block[eol + 2] == '\t')) {
+            block[eol] = ' ';
+            block[eol + 1] = ' ';
+            eol = HTTPUtils::findEOL(block, end, eol + 2);
         }
-        
-        // Trim trailing OWS
-        value = HTTPUtils::trimOWS(value);
+
+        // Without OWS (Optional WhiteSpace) on either side
+        field.value = colon + 1;
+        while (field.value < eol && HTTPUtils::isOWS(block[field.value]))
+            field.value++;
+        size_t valueEnd = eol;
+        while (valueEnd > field.value && HTTPUtils::isOWS(block[valueEnd - 1]))
+            valueEnd--;
+        field.valueLength = valueEnd - field.value;
 
 		if (isTrailer)
 		{
 			// RFC 7230 Section 4.1.2: Trailer must not contain certain headers
-            if (name == "Transfer-Encoding" || 
-                name == "Content-Length" || 
-                name == "Host" || 
-                name == "Cache-Control" || 
-                name == "Max-Forwards" || 
-                name == "TE" || 
-                name == "Authorization")
-                throw HTTPError(400, "Bad Request: Invalid Trailer Field");
+			switch (classifyHeader(block + field.name, field.nameLength))
+			{
+			case HDR_TRANSFER_ENCODING:
+			case HDR_CONTENT_LENGTH:
+			case HDR_HOST:
+			case HDR_CACHE_CONTROL:
+			case HDR_MAX_FORWARDS:
+			case HDR_TE:
+			case HDR_AUTHORIZATION:
+				throw HTTPError(400, "Bad Request: Invalid Trailer Field");
+			default:
+				break;
+			}
 		}
-        
-        // Store header
-        _headers[name] = value;
-        
-        // Skip CRLF
-        index += 2;
+
+        storeField(field);
+        index = eol + 2; // Skip CRLF
     }
-    
-    // Remove parsed headers from buffer
-    data.erase(data.begin(), data.begin() + header_end + 4); // +4 for final \r\n\r\n
-    
-	if (!isTrailer)
+}
+
+namespace
+{
+	struct KnownHeader
 	{
-		LOG_DEBUG("Parse State change to 'BODY_INIT'");
-    	_state = BODY_INIT;
-	}
+		const char*				name;
+		size_t					length;
+		HTTPRequest::HeaderId	id;
+	};
+
+	// Indexed by (length + lowercase first byte) & 31, which has no
+	// collisions for these names. Keep it that way when adding one.
+	const KnownHeader	g_knownHeaders[32] = {
+		{ NULL, 0, HTTPRequest::HDR_OTHER },
+		{ NULL, 0, HTTPRequest::HDR_OTHER },
+		{ NULL, 0, HTTPRequest::HDR_OTHER },
+		{ NULL, 0, HTTPRequest::HDR_OTHER },
+		{ NULL, 0, HTTPRequest::HDR_OTHER },
+		{ "transfer-encoding", 17, HTTPRequest::HDR_TRANSFER_ENCODING },
+		{ NULL, 0, HTTPRequest::HDR_OTHER },
+		{ "accept", 6, HTTPRequest::HDR_ACCEPT },
+		{ NULL, 0, HTTPRequest::HDR_OTHER },
+		{ "cookie", 6, HTTPRequest::HDR_COOKIE },
+		{ NULL, 0, HTTPRequest::HDR_OTHER },
+		{ "expect", 6, HTTPRequest::HDR_EXPECT },
+		{ "host", 4, HTTPRequest::HDR_HOST },
+		{ "connection", 10, HTTPRequest::HDR_CONNECTION },
+		{ "authorization", 13, HTTPRequest::HDR_AUTHORIZATION },
+		{ "content-type", 12, HTTPRequest::HDR_CONTENT_TYPE },
+		{ "cache-control", 13, HTTPRequest::HDR_CACHE_CONTROL },
+		{ "content-length", 14, HTTPRequest::HDR_CONTENT_LENGTH },
+		{ NULL, 0, HTTPRequest::HDR_OTHER },
+		{ NULL, 0, HTTPRequest::HDR_OTHER },
+		{ NULL, 0, HTTPRequest::HDR_OTHER },
+		{ "keep-alive", 10, HTTPRequest::HDR_KEEP_ALIVE },
+		{ "te", 2, HTTPRequest::HDR_TE },
+		{ "range", 5, HTTPRequest::HDR_RANGE },
+		{ NULL, 0, HTTPRequest::HDR_OTHER },
+		{ "max-forwards", 12, HTTPRequest::HDR_MAX_FORWARDS },
+		{ NULL, 0, HTTPRequest::HDR_OTHER },
+		{ "trailer", 7, HTTPRequest::HDR_TRAILER },
+		{ NULL, 0, HTTPRequest::HDR_OTHER },
+		{ NULL, 0, HTTPRequest::HDR_OTHER },
+		{ NULL, 0, HTTPRequest::HDR_OTHER },
+		{ "user-agent", 10, HTTPRequest::HDR_USER_AGENT }
+	};
+}
+
+HTTPRequest::HeaderId HTTPRequest::classifyHeader(const char* name, size_t length)
+{
+    if (length == 0)
+        return HDR_OTHER;
+    const KnownHeader& known = g_knownHeaders[(length + std::tolower(static_cast<unsigned char>(name[0]))) & 31];
+    if (known.length != length || strncasecmp(known.name, name, length) != 0)
+        return HDR_OTHER;
+    return known.id;
+}
+
+// A repeated field replaces the earlier one
+void HTTPRequest::storeField(const HeaderField& field)
+{
+    HeaderId id = classifyHeader(&_headerBlock[field.name], field.nameLength);
+    // Two different lengths or hosts are a smuggling attempt, not something
+    // to settle by keeping the last one
+    if ((id == HDR_CONTENT_LENGTH || id == HDR_HOST) && _knownHeaders[id].nameLength
+        && fieldValue(_knownHeaders[id]) != fieldValue(field))
+        throw HTTPError(400, "Bad Request: Conflicting "
+            + std::string(&_headerBlock[field.name], field.nameLength) + " headers");
+    if (id != HDR_OTHER)
+        _knownHeaders[id] = field;
+    else
+        _headers.push_back(field);
+}
+
+std::string HTTPRequest::fieldValue(const HeaderField& field) const
+{
+    std::vector<char>::const_iterator value = _headerBlock.begin() + field.value;
+    return std::string(value, value + field.valueLength);
+}
+
+bool HTTPRequest::fieldIs(const HeaderField& field, const char* name, size_t length) const
+{
+    return field.nameLength == length && strncasecmp(&_headerBlock[field.name], name, length) == 0;
+}
+
+const HTTPRequest::HeaderField* HTTPRequest::findField(const char* name, size_t length) const
+{
+    HeaderId id = classifyHeader(name, length);
+    if (id != HDR_OTHER)
+        return _knownHeaders[id].nameLength ? &_knownHeaders[id] : NULL;
+    // The last of repeated fields wins
+    for (size_t i = _headers.size(); i > 0; --i) {
+        if (fieldIs(_headers[i - 1], name, length))
+            return &_headers[i - 1];
+    }
+    return NULL;
+}
+
+void HTTPRequest::setHeader(const std::string& name, const std::string& value)
+{
+    removeHeader(name);
+    HeaderField field;
+    field.name = _headerBlock.size();
+    field.nameLength = name.size();
+    field.value = field.name + name.size();
+    field.valueLength = value.size();
+    _headerBlock.insert(_headerBlock.end(), name.begin(), name.end());
+    _headerBlock.insert(_headerBlock.end(), value.begin(), value.end());
+    storeField(field);
+}
+
+void HTTPRequest::removeHeader(const std::string& name)
+{
+    HeaderId id = classifyHeader(name.data(), name.size());
+    if (id != HDR_OTHER)
+    {
+        _knownHeaders[id].nameLength = 0;
+        return;
+    }
+    for (size_t i = _headers.size(); i > 0; --i) {
+        if (fieldIs(_headers[i - 1], name.data(), name.size()))
+            _headers.erase(_headers.begin() + (i - 1));
+    }
+}
+
+void HTTPRequest::clearKnownHeaders()
+{
+    for (size_t i = 0; i < HDR_COUNT; ++i)
+        _knownHeaders[i].nameLength = 0;
 }
 
 /**
@@ -240,27 +402,26 @@ void HTTPRequest::determineBodyType(void)
     LOG_DEBUG("determineBodyType called");
     
     // First check Content-Type for multipart
-    if (_headers.find("Content-Type") != _headers.end() && 
-        _headers.at("Content-Type").find("multipart/form-data") != std::string::npos)
+    if (getHeader(HDR_CONTENT_TYPE).find("multipart/form-data") != std::string::npos)
     {
         LOG_DEBUG("Found multipart/form-data Content-Type - setting MULTIPART type");
         _bodyType = MULTIPART;
 		_state = BODY;
         // Still need Content-Length for multipart data
-        if (_headers.find("Content-Length") != _headers.end()) {
-            _bodyLength = ::atoi(_headers.at("Content-Length").c_str());
+        if (hasHeader(HDR_CONTENT_LENGTH)) {
+            _bodyLength = ::atoi(getHeader(HDR_CONTENT_LENGTH).c_str());
             LOG_DEBUG("Multipart content length: " + toString(_bodyLength));
         }
         return;
     }
     
     // Then check Transfer-Encoding
-    if (_headers.find("Transfer-Encoding") != _headers.end())
+    if (hasHeader(HDR_TRANSFER_ENCODING))
     {
         LOG_DEBUG("Found Transfer-Encoding header");
-        if (HTTPUtils::hasToken(_headers.at("Transfer-Encoding"), "chunked"))
+        if (HTTPUtils::hasToken(getHeader(HDR_TRANSFER_ENCODING), "chunked"))
         {
-            if (_headers.find("Content-Length") != _headers.end()) {
+            if (hasHeader(HDR_CONTENT_LENGTH)) {
                 LOG_ERROR("Both Transfer-Encoding and Content-Length present");
                 throw HTTPError(400, "Bad Request: Both Transfer-Encoding and Content-Length present");
             }
@@ -277,12 +438,12 @@ void HTTPRequest::determineBodyType(void)
     }
     
     // Finally check Content-Length for regular body
-    if (_headers.find("Content-Length") != _headers.end())
+    if (hasHeader(HDR_CONTENT_LENGTH))
     {
         LOG_DEBUG("Found Content-Length header");
         _bodyType = CONTENT_LENGTH;
 		_state = BODY;
-        _bodyLength = ::atoi(_headers.at("Content-Length").c_str());
+        _bodyLength = ::atoi(getHeader(HDR_CONTENT_LENGTH).c_str());
         LOG_DEBUG("Set body type to CONTENT_LENGTH with length: " + toString(_bodyLength));
         return;
     }
@@ -295,7 +456,7 @@ void HTTPRequest::determineBodyType(void)
 }
 
 
-void HTTPRequest::parseBody(std::vector<char> &data)
+void HTTPRequest::parseBody(Buffer &data)
 {
     LOG_DEBUG("parseBody called with data size: " + toString(data.size()));
     
@@ -313,8 +474,8 @@ void HTTPRequest::parseBody(std::vector<char> &data)
         
     case MULTIPART:
         LOG_DEBUG("MULTIPART case - calling parseMultipartBody");
-        LOG_DEBUG("Content-Type: " + _headers["Content-Type"]);
-        LOG_DEBUG("Boundary will be extracted from: " + _headers["Content-Type"]);
+        LOG_DEBUG("Content-Type: " + getHeader(HDR_CONTENT_TYPE));
+        LOG_DEBUG("Boundary will be extracted from: " + getHeader(HDR_CONTENT_TYPE));
         parseMultipartBody(data);
         break;
         
@@ -325,13 +486,20 @@ void HTTPRequest::parseBody(std::vector<char> &data)
     LOG_DEBUG("parseBody completed for current data chunk");
 }
 
-void HTTPRequest::parseContentLengthBody(std::vector<char> &data)
+void HTTPRequest::parseContentLengthBody(Buffer &data)
 {
-	size_t remaining = _bodyLength - _body.size();
+	size_t remaining = getBodyRemaining();
 	size_t processable = std::min(remaining, data.size());
 	
-	_body.insert(_body.end(), data.begin(), data.begin() + processable);
-	data.erase(data.begin(), data.begin() + processable);
+	if (_bodySink)
+	{
+		_bodySink->write(data.data(), processable);
+		data.consume(processable);
+		commitBody(0);
+		return;
+	}
+	_body.append(data.data(), processable);
+	data.consume(processable);
 	
 	LOG_DEBUG("Content-Length body: " + toString(_body.size()) + " / " + toString(_bodyLength));
 	if (_body.size() == _bodyLength)
@@ -339,6 +507,17 @@ void HTTPRequest::parseContentLengthBody(std::vector<char> &data)
 }
 
 
+static int	hexDigit(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
 /**
  * @brief Parse chunked transfer encoding according to RFC 7230 Section 4.1
  * 
@@ -349,107 +528,110 @@ void HTTPRequest::parseContentLengthBody(std::vector<char> &data)
  * 			chunk-data     = 1*OCTET
  * 			chunk-ext      = *( ";" chunk-ext-name [ "=" chunk-ext-val ] )
  * 
- * 			RFC 7230 Section 4.1.3: includes pusdo code for parsing chunked encoding
+ * 			The framing is decoded byte by byte in _chunkState, so a chunk may end
+ * 			anywhere in a read. Chunk data goes to the body as soon as it arrives and
+ * 			everything decoded is consumed, so data never holds more than one read
+ * 			whatever the chunk size; BodyStorage moves a large body out of memory.
  * @param data Raw input data buffer
  */
-void HTTPRequest::parseChunkedBody(std::vector<char> &data)
+void HTTPRequest::parseChunkedBody(Buffer &data)
 {
-	while (!data.empty())
+	const char*	p = data.data();
+	const char*	end = p + data.size();
+
+	while (p < end)
 	{
-		// State 1 - Parse chunk size (indicated by chunkLength == -1)
-		if (_chunkLength == -1)
+		switch (_chunkState)
 		{
-			size_t eol = HTTPUtils::findEOL(data);
-			if (eol == std::string::npos)
-            {
-				return; // Need more data (wait for epoll)
-            }
-			//Parse chunk size (ignore chunk extensions as per RFC 7230 Section 4.1.1)
-			std::string chunkSizeLine(data.begin(), data.begin() + eol);
-			size_t	semicolon = chunkSizeLine.find(';');
-			std::string chunkSize;
-			if (semicolon == std::string::npos)
-				chunkSize = chunkSizeLine;
-			else
-				chunkSize = chunkSizeLine.substr(0, semicolon);
-			
-			for(size_t i = 0; i < chunkSize.size(); i++)
+		case CHUNK_SIZE:
+		{
+			int digit = hexDigit(*p);
+			if (digit < 0)
 			{
-				if (!std::isxdigit(chunkSize[i]) && !HTTPUtils::isOWS(static_cast<unsigned char>(chunkSize[i])))
+				// Anything else after the digits would let a proxy in front
+				// of us frame the body differently
+				if (_chunkDigits == 0 || (*p != '\r' && *p != ';' && *p != ' ' && *p != '\t'))
 					throw HTTPError(400, "Bad Request: Invalid Chunk Size (non-hex characters)");
+				_chunkState = *p == '\r' ? CHUNK_SIZE_LF : *p == ';' ? CHUNK_EXT : CHUNK_SIZE_WS;
+				p++;
+				break;
 			}
-
-			// Convert chunk size string (in hex) to size
-			char *endptr;
-			_chunkLength = strtol(chunkSize.c_str(), &endptr, 16);
-			if ( *endptr != '\0' || _chunkLength < 0)
-				throw HTTPError(400, "Bad Request: Invalid Chunk Size");
-			// Remove chunk size line from data
-			data.erase(data.begin(), data.begin() + eol + 2); // +2 for CRLF
-            LOG_DEBUG("CHUNK LENGTH - new: " + toString(_chunkLength));   
+			if (_chunkRemaining > (static_cast<size_t>(-1) >> 4))
+				throw HTTPError(400, "Bad Request: Chunk Size too large");
+			_chunkRemaining = (_chunkRemaining << 4) | digit;
+			_chunkDigits++;
+			p++;
+			break;
 		}
-        LOG_DEBUG("CHUNK LENGTH - current:" + toString(_chunkLength));
-		// State 2: Reading Chunk Data (indicated by chunkLength > 0), Try to read everything in data
-		if (_chunkLength > 0)
+		case CHUNK_SIZE_WS:
+			// Whitespace is only allowed before an extension
+			if (*p == ';')
+				_chunkState = CHUNK_EXT;
+			else if (*p != ' ' && *p != '\t')
+				throw HTTPError(400, "Bad Request: Invalid Chunk Size (non-hex characters)");
+			p++;
+			break;
+		case CHUNK_EXT:
+			// Chunk extensions are ignored (RFC 7230 Section 4.1.1)
+			if (*p == '\n')
+				throw HTTPError(400, "Bad Request: Invalid chunk size line ending");
+			if (*p == '\r')
+				_chunkState = CHUNK_SIZE_LF;
+			p++;
+			break;
+		case CHUNK_SIZE_LF:
+			if (*p++ != '\n')
+				throw HTTPError(400, "Bad Request: Invalid chunk size line ending");
+			LOG_DEBUG("CHUNK LENGTH - new: " + toString(_chunkRemaining));
+			_bodyLength += _chunkRemaining;
+			_chunkState = _chunkRemaining > 0 ? CHUNK_DATA : CHUNK_TRAILER;
+			break;
+		case CHUNK_DATA:
 		{
-            size_t eol = HTTPUtils::findEOL(data);
-			if (eol == std::string::npos) {
-				return; // Need more data (wait for epoll)
-            }
-			// Calculate how much data we can process
-			// size_t processable = std::min(static_cast<size_t>(_chunkLength), data.size());
-            
-			// Must have at least 1 byte to process (wait for more data from epoll)
-			// if (processable == 0)
-			// 	return;
-			
-			// Append chunk data to body
-			_body.insert(_body.end(), data.begin(), data.begin() + _chunkLength);
-			_bodyLength += _chunkLength;
-			
-			data.erase(data.begin(), data.begin() + _chunkLength + 2); // Remove processed data
-			_chunkLength = -1; // Reset chunk length for next chunk
-			
+			size_t fragment = std::min(_chunkRemaining, static_cast<size_t>(end - p));
+			_body.append(p, fragment);
+			_chunkRemaining -= fragment;
+			p += fragment;
+			if (_chunkRemaining == 0)
+				_chunkState = CHUNK_DATA_CR;
+			break;
 		}
-		// State 3: Chunk complete, check for CRLF and optional trailer fields
-		if (_chunkLength == 0)
-		{
-			if (data.size() < 2) {
-                LOG_DEBUG("We are here");
-				return; // Need more data for CRLF from epoll
-            }
-			LOG_DEBUG("DATA SIZE: " + toString(data.size()));
-            LOG_DEBUG("DATA to HEx: " + stringToHex(std::string(data.begin() -2, data.begin() +2)));
-			if (data[0] != '\r' || data[1] != '\n')
-				throw HTTPError(400, "Bad Request: Missing chunk CRLF or invalid chunk size");
-			
-			// Remove CRLF
-			data.erase(data.begin(), data.begin() + 2);
-
-            if (data.size() == 0) {
-                
-                HTTPUtils::removeToken(_headers["Transfer-Encoding"], "chunked");
-                _headers.erase("Trailer");
-                _headers["Content-Length"] = toString(_body.size());
-                
-                _bodyType = CONTENT_LENGTH;
-                _state = COMPLETE;
-                _chunkLength = -1;
-                return;
-            }
-                
-			// Look for trailer fields (if any) ending with CRLF CRLF
-			size_t trailerEnd = HTTPUtils::findHeaderEnd(data);
-			if (data.size() > 0 && trailerEnd == std::string::npos)
-				return; // Need more data for trailers
-			
-            // Parse trailer fields
-			parseHeaders(data, true);
-			
-			// Update headers as per RFC 7230 Section 4.1.2
+		case CHUNK_DATA_CR:
+		case CHUNK_DATA_LF:
+			if (*p++ != (_chunkState == CHUNK_DATA_CR ? '\r' : '\n'))
+				throw HTTPError(400, "Bad Request: Missing chunk CRLF");
+			if (_chunkState == CHUNK_DATA_CR)
+				_chunkState = CHUNK_DATA_LF;
+			else
+			{
+				_chunkState = CHUNK_SIZE;
+				_chunkDigits = 0;
+			}
+			break;
+		case CHUNK_TRAILER:
+			// Trailer fields (if any) and the final CRLF, as one header section
+			data.consume(p - data.data());
+			if (parseHeaders(data, true))
+				finishChunkedBody();
 			return;
 		}
 	}
+	data.consume(p - data.data());
+}
+
+// Update headers as per RFC 7230 Section 4.1.3: the decoded body is
+// handled like one with a Content-Length from here on
+void HTTPRequest::finishChunkedBody()
+{
+	std::string encoding = getHeader(HDR_TRANSFER_ENCODING);
+	HTTPUtils::removeToken(encoding, "chunked");
+	setHeader("Transfer-Encoding", encoding);
+	removeHeader("Trailer");
+	setHeader("Content-Length", toString(_bodyLength));
+
+	LOG_DEBUG("Chunked body complete: " + toString(_bodyLength) + " bytes");
+	_bodyType = CONTENT_LENGTH;
+	_state = COMPLETE;
 }
 
 void HTTPRequest::parseMultipartHeaders(std::vector<char>& headerData, MultipartPart& part)
@@ -521,7 +703,7 @@ void HTTPRequest::parseMultipartHeaders(std::vector<char>& headerData, Multipart
 }
 
 
-void HTTPRequest::parseMultipartBody(std::vector<char>& data)
+void HTTPRequest::parseMultipartBody(Buffer& data)
 {
     LOG_DEBUG("=== Starting Multipart Parsing ===");
     LOG_DEBUG("Data size: " + toString(data.size()) + " bytes");
@@ -531,22 +713,22 @@ void HTTPRequest::parseMultipartBody(std::vector<char>& data)
         _multipartState = new MultipartState();
         
         // Extract boundary
-        std::string contentType = _headers["Content-Type"];
+        std::string contentType = getHeader(HDR_CONTENT_TYPE);
         _multipartState->boundary = "--" + contentType.substr(contentType.find("boundary=") + 9);
         LOG_DEBUG("Boundary: " + _multipartState->boundary);
         
         // Skip preamble
-        _multipartState->boundaryStart = HTTPUtils::findString(data, _multipartState->boundary);
+        _multipartState->boundaryStart = HTTPUtils::findString(data.data(), data.size(), _multipartState->boundary);
         if (_multipartState->boundaryStart == std::string::npos) {
             return;
         }
         
-        data.erase(data.begin(), data.begin() + _multipartState->boundaryStart);
+        data.consume(_multipartState->boundaryStart);
     }
     
     while (!data.empty()) {
         // Find next boundary
-        size_t boundaryPos = HTTPUtils::findString(data, _multipartState->boundary);
+        size_t boundaryPos = HTTPUtils::findString(data.data(), data.size(), _multipartState->boundary);
         if (boundaryPos == std::string::npos) {
             return;
         }
@@ -562,19 +744,20 @@ void HTTPRequest::parseMultipartBody(std::vector<char>& data)
         }
         
         // Parse headers
-        std::vector<char> partData(data.begin() + boundaryPos + _multipartState->boundary.length() + 2, data.end());
-        size_t headerEnd = HTTPUtils::findHeaderEnd(partData);
+        size_t partStart = boundaryPos + _multipartState->boundary.length() + 2;
+        size_t headerEnd = HTTPUtils::findHeaderEnd(data.data(), data.size(), partStart);
         if (headerEnd == std::string::npos) {
             return;
         }
+        headerEnd -= partStart;
         
         // Create and parse part
         MultipartPart part;
-        std::vector<char> headerData(partData.begin(), partData.begin() + headerEnd);
+        std::vector<char> headerData(data.data() + partStart, data.data() + partStart + headerEnd);
         parseMultipartHeaders(headerData, part);
         
         // Find body boundaries
-        size_t nextBoundary = HTTPUtils::findString(data, _multipartState->boundary, 
+        size_t nextBoundary = HTTPUtils::findString(data.data(), data.size(), _multipartState->boundary, 
                                                   boundaryPos + _multipartState->boundary.length() + headerEnd + 4);
         if (nextBoundary == std::string::npos) {
             return;
@@ -590,61 +773,19 @@ void HTTPRequest::parseMultipartBody(std::vector<char>& data)
         if (bodyEnd > bodyStart && bodyEnd <= data.size()) {
             part.data.reserve(bodyEnd - bodyStart);
             part.data.insert(part.data.begin(), 
-                           data.begin() + bodyStart, 
-                           data.begin() + bodyEnd);
+                           data.data() + bodyStart, 
+                           data.data() + bodyEnd);
         }
         
         _multipartState->parts.push_back(part);
-        data.erase(data.begin(), data.begin() + nextBoundary);
-    }
-}
-
-void HTTPRequest::handleWrite() {
-    if (_pendingWrite.empty())
-        return;
-    
-    try {
-        size_t written = _tempFile->write(
-            _pendingWrite.data() + _writeOffset, 
-            _pendingWrite.size() - _writeOffset
-        );
-        
-        _writeOffset += written;
-        
-        if (_writeOffset == _pendingWrite.size()) {
-            _pendingWrite.clear();
-            _writeOffset = 0;
-        }
-    } catch (const std::exception& e) {
-        throw HTTPError(500, "Failed to write to temporary file: " + std::string(e.what()));
+        data.consume(nextBoundary);
     }
 }
 
 void	HTTPRequest::appendToBody(const std::vector<char>& data)
 {
-    if (!_usingTempFile && (_body.size() + data.size()) > MEMORY_THRESHOLD)
-	{
-        _tempFile = new TempFile();
-        if (!_body.empty())
-		{
-            _pendingWrite = _body;
-            _writeOffset = 0;
-            _body.clear();
-        }
-        _usingTempFile = true;
-    }
-
-    if (_usingTempFile)
-	{
-        // Add new data to pending write buffer
-        _pendingWrite.insert(_pendingWrite.end(), data.begin(), data.end());
-        
-    }
-	else
-	{
-		// The actual write will be handled by epoll
-        _body.insert(_body.end(), data.begin(), data.end());
-    }
+	if (!data.empty())
+		_body.append(&data[0], data.size());
 }
 
 void	HTTPRequest::setRouteMatch(const Config::Route* route, const std::string& remaining)
@@ -678,12 +819,7 @@ bool HTTPRequest::isCGI(void) const
 
 bool	HTTPRequest::shouldKeepAlive() const
 {
-	if (_headers.find("Connection") != _headers.end())
-	{
-		if (_headers.at("Connection") == "close")
-			return false;
-	}
-	return true;
+	return getHeader(HDR_CONNECTION) != "close";
 }
 
 // Accessor methods
@@ -730,16 +866,30 @@ const std::string& HTTPRequest::getUri() const
 }
 
 
-const std::vector<char>& HTTPRequest::getBody() const
+const BodyStorage& HTTPRequest::getBody() const
 { 
     return _body; 
 }
 
-const std::string& HTTPRequest::getHeader(const std::string& key) const
+std::string HTTPRequest::getHeader(HeaderId id) const
+{
+    return _knownHeaders[id].nameLength ? fieldValue(_knownHeaders[id]) : std::string();
+}
+
+std::string HTTPRequest::getHeader(const std::string& key) const
 {
-    static const std::string empty;
-    std::map<std::string, std::string>::const_iterator it = _headers.find(key);
-    return it != _headers.end() ? it->second : empty;
+    const HeaderField* field = findField(key.data(), key.size());
+    return field ? fieldValue(*field) : std::string();
+}
+
+bool HTTPRequest::hasHeader(HeaderId id) const
+{
+    return _knownHeaders[id].nameLength != 0;
+}
+
+bool HTTPRequest::hasHeader(const std::string& key) const
+{
+    return findField(key.data(), key.size()) != NULL;
 }
 
 const Config::Route		*HTTPRequest::getMatchedRoute() const
@@ -767,16 +917,89 @@ bool	HTTPRequest::hasMatchedRoute() const
 	return _routeMatch.found;
 }
 
-int		HTTPRequest::getTempFileFd()
+size_t	HTTPRequest::getBodyRemaining() const
 {
-	if (_tempFile)
-		return _tempFile->getFd();
-	return -1;
+	if (_state != BODY || _bodyType != CONTENT_LENGTH)
+		return 0;
+	if (_bodySink)
+		return _bodySink->getRemaining();
+	return _bodyLength - _body.size();
+}
+
+char*	HTTPRequest::prepareBody(size_t len)
+{
+	return _body.prepare(len);
+}
+
+// Drops the prepared bytes that were not filled
+void	HTTPRequest::commitBody(size_t len)
+{
+	if (_bodySink)
+	{
+		if (_bodySink->getRemaining() == 0)
+			_state = COMPLETE;
+		return;
+	}
+	_body.commit(len);
+	if (_body.size() == _bodyLength)
+	{
+		LOG_DEBUG("Content-Length body received directly: " + toString(_bodyLength));
+		_state = COMPLETE;
+	}
+}
+
+bool	HTTPRequest::wantsBodySink() const
+{
+	return _state == BODY && _bodyType == CONTENT_LENGTH && !_bodySinkOffered;
+}
+
+void	HTTPRequest::setBodySink(UploadSink* sink)
+{
+	_bodySinkOffered = true;
+	if (!sink)
+	{
+		// Large bodies go straight to a file, see BodyStorage. Not before
+		// the sink was offered: what is read back here must not still be
+		// on its way to the disk.
+		_body.expect(_bodyLength);
+		return;
+	}
+	_bodySink = sink;
+	char chunk[8192];
+	for (size_t offset = 0; offset < _body.size(); )
+	{
+		size_t n = _body.read(offset, chunk, sizeof(chunk));
+		_bodySink->write(chunk, n);
+		offset += n;
+	}
+	_body.clear();
+	commitBody(0);
 }
 
-bool	HTTPRequest::hasFileOperationsPending() const
+UploadSink*	HTTPRequest::getBodySink() const
 {
-	return _tempFile != NULL;
+	return _bodySink;
+}
+
+DiskTask*	HTTPRequest::getDiskWait() const
+{
+	if (_bodySink)
+		return _bodySink->getDiskWait();
+	return _body.getDiskWait();
+}
+
+bool	HTTPRequest::isBodyBacklogged() const
+{
+	if (_bodySink)
+		return _bodySink->isBacklogged();
+	return _body.isBacklogged();
+}
+
+bool	HTTPRequest::diskDone(DiskTask* task)
+{
+	if (_bodySink)
+		return _bodySink->diskDone(task);
+	return _body.diskDone(task);
 }
 
 void HTTPRequest::reset()
@@ -785,7 +1008,10 @@ void HTTPRequest::reset()
     _state = REQUEST_LINE;
     _bodyType = NO_BODY;
     _bodyLength = 0;
-    _chunkLength = -1;
+    _chunkState = CHUNK_SIZE;
+    _chunkRemaining = 0;
+    _chunkDigits = 0;
+    _scanned = 0;
 
     // Clear strings
     _method.clear();
@@ -797,10 +1023,13 @@ void HTTPRequest::reset()
     _url = NULL;
     delete _multipartState;
     _multipartState = NULL;
-	delete _tempFile;
-	_tempFile = NULL;
+	delete _bodySink;
+	_bodySink = NULL;
+	_bodySinkOffered = false;
 
-    // Clear collections
+    // Clear collections, their capacity is reused by the next request
+    _headerBlock.clear();
+    clearKnownHeaders();
     _headers.clear();
     _body.clear();
 
@@ -819,9 +1048,14 @@ void HTTPRequest::print(bool includeBodies, bool allHeaders, const std::set<std:
     ss << "--- Headers ---\n";
     if (allHeaders) {
         // Print all headers
-        for (std::map<std::string, std::string>::const_iterator it = _headers.begin();
-             it != _headers.end(); ++it) {
-            ss << it->first << ": " << it->second << "\n";
+        for (size_t i = 0; i < HDR_COUNT + _headers.size(); ++i) {
+            const HeaderField& field = i < HDR_COUNT ? _knownHeaders[i] : _headers[i - HDR_COUNT];
+            if (field.nameLength == 0)
+                continue;
+            ss.write(&_headerBlock[field.name], field.nameLength);
+            ss << ": ";
+            ss.write(&_headerBlock[0] + field.value, field.valueLength);
+            ss << "\n";
         }
     } else {
         // Print only essential headers
@@ -829,10 +1063,8 @@ void HTTPRequest::print(bool includeBodies, bool allHeaders, const std::set<std:
             "Content-Type", "Content-Length", "Host", "Connection"
         };
         for (size_t i = 0; i < sizeof(essentialHeaders)/sizeof(essentialHeaders[0]); ++i) {
-            std::map<std::string, std::string>::const_iterator it = _headers.find(essentialHeaders[i]);
-            if (it != _headers.end()) {
-                ss << it->first << ": " << it->second << "\n";
-            }
+            if (hasHeader(essentialHeaders[i]))
+                ss << essentialHeaders[i] << ": " << getHeader(essentialHeaders[i]) << "\n";
         }
     }
 
@@ -861,14 +1093,14 @@ void HTTPRequest::print(bool includeBodies, bool allHeaders, const std::set<std:
     }
     // Handle regular body
     else if (includeBodies) {
-        std::string contentType = getHeader("Content-Type");
+        std::string contentType = getHeader(HDR_CONTENT_TYPE);
         
         // Check if content type is allowed when filtering is active
         if (allowedMimeTypes.empty() || 
             allowedMimeTypes.find(contentType) != allowedMimeTypes.end()) {
             ss << "\n--- Body ---\n";
             ss << "Size: " << _body.size() << " bytes\n";
-            ss << "Data: " << std::string(_body.begin(), _body.end()) << "\n";
+            ss << "Data: " << _body.str() << "\n";
         }
     }
     else {
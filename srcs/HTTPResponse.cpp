@@ -11,20 +11,58 @@
 /* ************************************************************************** */
 
 #include "HTTPResponse.hpp"
-
-const size_t HTTPResponse::CHUNK_SIZE = 8192;
+#include <unistd.h>
+#include <fcntl.h>
 
 HTTPResponse::HTTPResponse() 
-	: _tempFile(NULL)
-	, _usingTempFile(false)
-	, _readOffset(0)
+	: _state(CREATING)
+	, _statusCode(0)
+	, _bodyFd(-1)
 	, _bodySize(0)
+	, _bodySource(NULL)
 {
 	
 }
 
+HTTPResponse::HTTPResponse(const HTTPResponse& other)
+	: _state(other._state)
+	, _statusCode(other._statusCode)
+	, _headers(other._headers)
+	, _body(other._body)
+	, _bodyFd(other._bodyFd == -1 ? -1 : fcntl(other._bodyFd, F_DUPFD_CLOEXEC, 0))
+	, _bodySize(other._bodySize)
+	, _bodySource(other._bodySource)
+{
+	other._bodySource = NULL;
+}
+
+HTTPResponse& HTTPResponse::operator=(const HTTPResponse& other)
+{
+	if (this != &other)
+	{
+		HTTPResponse copy(other);
+		swap(copy);
+	}
+	return *this;
+}
+
 HTTPResponse::~HTTPResponse()
 {
+	dropBodyFile();
+	dropBodySource();
+}
+
+void HTTPResponse::dropBodyFile()
+{
+	if (_bodyFd != -1)
+		close(_bodyFd);
+	_bodyFd = -1;
+}
+
+void HTTPResponse::dropBodySource()
+{
+	delete _bodySource;
+	_bodySource = NULL;
 }
 
 HTTPResponse::ResponseState	HTTPResponse::getState() const
@@ -54,10 +92,58 @@ void HTTPResponse::deleteHeader(const std::string& key)
 
 void HTTPResponse::setBody(const std::vector<char>& body)
 {
+    dropBodyFile();
+    dropBodySource();
     _body = body;
     _bodySize = body.size();
 }
 
+void HTTPResponse::setBody(const std::string& body)
+{
+    dropBodyFile();
+    dropBodySource();
+    _body.assign(body.begin(), body.end());
+    _bodySize = body.size();
+}
+
+void HTTPResponse::swapBody(std::vector<char>& body)
+{
+    dropBodyFile();
+    dropBodySource();
+    _body.swap(body);
+    _bodySize = _body.size();
+}
+
+void HTTPResponse::setBodyFile(int fd, size_t size)
+{
+    dropBodyFile();
+    dropBodySource();
+    _body.clear();
+    _bodyFd = fd;
+    _bodySize = size;
+}
+
+bool HTTPResponse::hasBodyFile() const
+{
+    return _bodyFd != -1;
+}
+
+void HTTPResponse::setBodySource(BodySource* source)
+{
+    dropBodyFile();
+    dropBodySource();
+    _body.clear();
+    _bodySize = 0;
+    _bodySource = source;
+    deleteHeader("Content-Length");
+    setHeader("Transfer-Encoding", "chunked");
+}
+
+bool HTTPResponse::hasBodySource() const
+{
+    return _bodySource != NULL;
+}
+
 void	HTTPResponse::appendToBody(const char* data, size_t len)
 {
 	_body.insert(_body.end(), data, data + len);
@@ -71,15 +157,12 @@ size_t HTTPResponse::getBodySize() const
 
 void HTTPResponse::reset()
 {
-	if (_tempFile)
-		delete _tempFile;
-	_tempFile = NULL;
-	_usingTempFile = false;
-	_readOffset = 0;
-	_sendBuffer.clear();
+	_state = CREATING;
 	_statusCode = 0;
 	_headers.clear();
 	_body.clear();
+	dropBodyFile();
+	dropBodySource();
 	_bodySize = 0;
 }
 
@@ -134,9 +217,9 @@ void	HTTPResponse::setEssentialHeaders()
 	setHeader("Server", "webserv/1.0");
 }
 
-std::vector<char> HTTPResponse::serialize() const
+// Status line, headers and the empty line that ends them
+std::string HTTPResponse::serializeHeaders() const
 {
-    // First create the header string
     std::stringstream headerStream;
     
     // Status line
@@ -150,8 +233,12 @@ std::vector<char> HTTPResponse::serialize() const
     
     // Empty line separating headers and body
     headerStream << "\r\n";
-    
-    std::string headerString = headerStream.str();
+    return headerStream.str();
+}
+
+std::vector<char> HTTPResponse::serialize() const
+{
+    std::string headerString = serializeHeaders();
     
     // Create the final response vector
     std::vector<char> response;
@@ -168,6 +255,34 @@ std::vector<char> HTTPResponse::serialize() const
     return response;
 }
 
+void HTTPResponse::queueTo(OutputQueue& out)
+{
+    out.push(serializeHeaders());
+    if (_bodyFd != -1)
+    {
+        out.pushFile(_bodyFd, 0, _bodySize);
+        _bodyFd = -1;
+    }
+    else if (_bodySource)
+    {
+        out.pushSource(_bodySource, true);
+        _bodySource = NULL;
+    }
+    else
+        out.push(_body);
+}
+
+void HTTPResponse::swap(HTTPResponse& other)
+{
+    std::swap(_state, other._state);
+    std::swap(_statusCode, other._statusCode);
+    _headers.swap(other._headers);
+    _body.swap(other._body);
+    std::swap(_bodyFd, other._bodyFd);
+    std::swap(_bodySize, other._bodySize);
+    std::swap(_bodySource, other._bodySource);
+}
+
 void HTTPResponse::print() const 
 {
     std::stringstream ss;
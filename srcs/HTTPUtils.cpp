@@ -12,6 +12,167 @@
 
 #include "HTTPUtils.hpp"
 
+#if defined(__x86_64__) || defined(__i386__)
+# include <emmintrin.h>
+# include <immintrin.h>
+# define HTTPUTILS_X86 1
+#endif
+
+/*
+ * Delimiter scanning kernels. pair() finds the first i >= start with
+ * data[i] == a and data[i + gap] == b, any3() the first of three bytes.
+ * The x86 versions compare 16 (SSE2) or 32 (AVX2) positions per step and
+ * finish the tail byte by byte. They are compiled with target attributes,
+ * so the build needs no -m flags, and picked once at startup from CPUID.
+ * bench/scan checks every kernel the CPU has against the scalar one.
+ */
+namespace
+{
+	struct ScanKernels
+	{
+		size_t		(*pair)(const char*, size_t, size_t, char, char, size_t);
+		size_t		(*any3)(const char*, size_t, size_t, char, char, char);
+		const char*	name;
+	};
+
+	size_t	pairScalar(const char* data, size_t size, size_t i, char a, char b, size_t gap)
+	{
+		for (; i + gap < size; ++i) {
+			if (data[i] == a && data[i + gap] == b)
+				return i;
+		}
+		return std::string::npos;
+	}
+
+	size_t	any3Scalar(const char* data, size_t size, size_t i, char a, char b, char c)
+	{
+		for (; i < size; ++i) {
+			if (data[i] == a || data[i] == b || data[i] == c)
+				return i;
+		}
+		return std::string::npos;
+	}
+
+#ifdef HTTPUTILS_X86
+	__attribute__((target("sse2")))
+	size_t	pairSSE2(const char* data, size_t size, size_t i, char a, char b, size_t gap)
+	{
+		const __m128i	va = _mm_set1_epi8(a);
+		const __m128i	vb = _mm_set1_epi8(b);
+
+		for (; i + gap + 16 <= size; i += 16) {
+			__m128i	x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+			__m128i	y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + gap));
+			int		mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(x, va), _mm_cmpeq_epi8(y, vb)));
+			if (mask)
+				return i + __builtin_ctz(mask);
+		}
+		return pairScalar(data, size, i, a, b, gap);
+	}
+
+	__attribute__((target("sse2")))
+	size_t	any3SSE2(const char* data, size_t size, size_t i, char a, char b, char c)
+	{
+		const __m128i	va = _mm_set1_epi8(a);
+		const __m128i	vb = _mm_set1_epi8(b);
+		const __m128i	vc = _mm_set1_epi8(c);
+
+		for (; i + 16 <= size; i += 16) {
+			__m128i	x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+			__m128i	hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, va), _mm_cmpeq_epi8(x, vb)),
+							_mm_cmpeq_epi8(x, vc));
+			int		mask = _mm_movemask_epi8(hit);
+			if (mask)
+				return i + __builtin_ctz(mask);
+		}
+		return any3Scalar(data, size, i, a, b, c);
+	}
+
+	__attribute__((target("avx2")))
+	size_t	pairAVX2(const char* data, size_t size, size_t i, char a, char b, size_t gap)
+	{
+		const __m256i	va = _mm256_set1_epi8(a);
+		const __m256i	vb = _mm256_set1_epi8(b);
+
+		for (; i + gap + 32 <= size; i += 32) {
+			__m256i		x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+			__m256i		y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + gap));
+			unsigned	mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(x, va), _mm256_cmpeq_epi8(y, vb)));
+			if (mask)
+				return i + __builtin_ctz(mask);
+		}
+		return pairScalar(data, size, i, a, b, gap);
+	}
+
+	__attribute__((target("avx2")))
+	size_t	any3AVX2(const char* data, size_t size, size_t i, char a, char b, char c)
+	{
+		const __m256i	va = _mm256_set1_epi8(a);
+		const __m256i	vb = _mm256_set1_epi8(b);
+		const __m256i	vc = _mm256_set1_epi8(c);
+
+		for (; i + 32 <= size; i += 32) {
+			__m256i		x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+			__m256i		hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(x, va), _mm256_cmpeq_epi8(x, vb)),
+							_mm256_cmpeq_epi8(x, vc));
+			unsigned	mask = _mm256_movemask_epi8(hit);
+			if (mask)
+				return i + __builtin_ctz(mask);
+		}
+		return any3Scalar(data, size, i, a, b, c);
+	}
+#endif
+
+	ScanKernels	selectKernels()
+	{
+		ScanKernels	kernels = { &pairScalar, &any3Scalar, "scalar" };
+
+#ifdef HTTPUTILS_X86
+		__builtin_cpu_init();  // Runs before main(), from a static initializer
+		if (__builtin_cpu_supports("avx2")) {
+			kernels.pair = &pairAVX2;
+			kernels.any3 = &any3AVX2;
+			kernels.name = "avx2";
+		}
+		else if (__builtin_cpu_supports("sse2")) {
+			kernels.pair = &pairSSE2;
+			kernels.any3 = &any3SSE2;
+			kernels.name = "sse2";
+		}
+#endif
+		return kernels;
+	}
+
+	ScanKernels	g_scan = selectKernels();
+}
+
+const char* HTTPUtils::scanKernel()
+{
+	return g_scan.name;
+}
+
+bool HTTPUtils::useScanKernel(const std::string& name)
+{
+	ScanKernels	kernels = { &pairScalar, &any3Scalar, "scalar" };
+
+#ifdef HTTPUTILS_X86
+	if (name == "avx2" && __builtin_cpu_supports("avx2")) {
+		kernels.pair = &pairAVX2;
+		kernels.any3 = &any3AVX2;
+		kernels.name = "avx2";
+	}
+	else if (name == "sse2" && __builtin_cpu_supports("sse2")) {
+		kernels.pair = &pairSSE2;
+		kernels.any3 = &any3SSE2;
+		kernels.name = "sse2";
+	}
+#endif
+	if (name != kernels.name)
+		return false;
+	g_scan = kernels;
+	return true;
+}
+
 
 /**
  * @brief Finds the end of HTTP headers in a data buffer
@@ -22,41 +183,48 @@
  *                        CRLF
  *                        [ message-body ]
  * 
- * @param data Vector containing the HTTP message data
+ * @param data HTTP message data
+ * @param size Number of bytes in data
+ * @param start Optional starting position for the search
  * @return Position of the first CRLF in the double CRLF sequence, or std::string::npos if not found
  */
-size_t HTTPUtils::findHeaderEnd(const std::vector<char>& data)
+size_t HTTPUtils::findHeaderEnd(const char* data, size_t size, size_t start)
 {
-	for (size_t i = 0; i < data.size() - 3; ++i) {
-		if (static_cast<unsigned char>(data[i]) == '\r' && 
-			static_cast<unsigned char>(data[i + 1]) == '\n' && 
-			static_cast<unsigned char>(data[i + 2]) == '\r' && 
-			static_cast<unsigned char>(data[i + 3]) == '\n')
+	// CR three bytes before LF is rare outside the terminator itself
+	for (size_t i = start; (i = g_scan.pair(data, size, i, '\r', '\n', 3)) != std::string::npos; ++i) {
+		if (data[i + 1] == '\n' && data[i + 2] == '\r')
 			return i;
 	}
 	return std::string::npos;
 }
 
+size_t HTTPUtils::findHeaderEnd(const std::vector<char>& data)
+{
+	return data.empty() ? std::string::npos : findHeaderEnd(&data[0], data.size());
+}
+
 /**
  * @brief Finds the next colon in a header field
  * @details According to RFC 7230 section 3.2:
  *          header-field = field-name ":" OWS field-value OWS
  *          No whitespace is allowed between field-name and colon
  * 
- * @param data Vector containing the HTTP message data
+ * @param data HTTP message data
+ * @param size Number of bytes in data
  * @param start Starting position for the search
  * @return Position of the colon, or std::string::npos if not found or invalid
  */
 size_t HTTPUtils::findNextColon(const std::vector<char>& data, size_t start)
 {
-	for (size_t i = start; i < data.size(); ++i) {
-		unsigned char c = static_cast<unsigned char>(data[i]);
-		if (c == '\r' || c == '\n')
-			return std::string::npos;
-		if (c == ':')
-			return i;
-	}
-	return std::string::npos;
+	return data.empty() ? std::string::npos : findNextColon(&data[0], data.size(), start);
+}
+
+size_t HTTPUtils::findNextColon(const char* data, size_t size, size_t start)
+{
+	size_t i = g_scan.any3(data, size, start, ':', '\r', '\n');
+	if (i == std::string::npos || data[i] != ':')
+		return std::string::npos;
+	return i;
 }
 
 /**
@@ -88,18 +256,19 @@ std::string HTTPUtils::trimOWS(const std::string& value)
  *          CR = %x0D (carriage return)
  *          LF = %x0A (line feed)
  * 
- * @param data Vector containing the HTTP message data
+ * @param data HTTP message data
+ * @param size Number of bytes in data
  * @param start Optional starting position for the search
  * @return Position of CR in CRLF sequence, or std::string::npos if not found
  */
 size_t HTTPUtils::findEOL(const std::vector<char>& data, size_t start)
 {
-	for (size_t i = start; i < data.size() - 1; ++i) {
-		if (static_cast<unsigned char>(data[i]) == '\r' && 
-			static_cast<unsigned char>(data[i + 1]) == '\n')
-			return i;
-	}
-	return std::string::npos;
+	return data.empty() ? std::string::npos : findEOL(&data[0], data.size(), start);
+}
+
+size_t HTTPUtils::findEOL(const char* data, size_t size, size_t start)
+{
+	return g_scan.pair(data, size, start, '\r', '\n', 1);
 }
 
 /**
@@ -216,23 +385,27 @@ bool HTTPUtils::removeToken(std::string& field_value, const std::string& token)
 /**
  * @brief Find a string in a vector of chars
  * 
- * @param data Vector to search in
+ * @param data Bytes to search in
+ * @param size Number of bytes in data
  * @param str String to find
  * @param start Starting position
  * @return Position of found string or std::string::npos
  */
 size_t HTTPUtils::findString(const std::vector<char>& data, const std::string& str, size_t start)
 {
-	for (size_t i = start; i <= data.size() - str.length(); ++i) {
-		bool found = true;
-		for (size_t j = 0; j < str.length(); ++j) {
-			if (data[i + j] != str[j]) {
-				found = false;
-				break;
-			}
-		}
-		if (found)
+	return data.empty() ? std::string::npos : findString(&data[0], data.size(), str, start);
+}
+
+// Candidates match the first and the last byte of str, only those are compared
+size_t HTTPUtils::findString(const char* data, size_t size, const std::string& str, size_t start)
+{
+	size_t len = str.length();
+
+	if (len == 0)
+		return start <= size ? start : std::string::npos;
+	for (size_t i = start; (i = g_scan.pair(data, size, i, str[0], str[len - 1], len - 1)) != std::string::npos; ++i) {
+		if (std::memcmp(data + i, str.data(), len) == 0)
 			return i;
 	}
 	return std::string::npos;
-	}
+}
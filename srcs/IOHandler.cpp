@@ -12,15 +12,71 @@
 
 #include "IOHandler.hpp"
 
-explicit	IOHandler::IOHandler(int fd)
+// Registration is left to the creator: the handler is only usable by the
+// EventLoop once the derived object is fully constructed, and it must end up
+// in the loop of the thread that owns it.
+IOHandler::IOHandler(int fd, bool isNonBlocking)
+	: _pendingIO(false)
+	, _starved(false)
+	, _interest(0)
+	, _completes(false)
+	, _closing(false)
 {
-	setNonBlocking(fd);
-	EventLoop::getInstance()->registerHandler(this);
+	if (fd != -1 && !isNonBlocking)
+		setNonBlocking(fd);
 }
 
 IOHandler::~IOHandler()
 {
-	EventLoop::getInstance()->removeHandler(this);
+}
+
+void	IOHandler::onDrain()
+{
+}
+
+DiskTask*	IOHandler::getDiskWait() const
+{
+	return NULL;
+}
+
+void	IOHandler::onDiskDone(DiskTask*)
+{
+}
+
+Poller::Completion	IOHandler::getCompletion() const
+{
+	return Poller::NO_COMPLETION;
+}
+
+void	IOHandler::handleAccepted(int fd)
+{
+	if (fd >= 0)
+		close(fd);
+}
+
+bool	IOHandler::handleReceived(const char*, size_t)
+{
+	return true;
+}
+
+bool	IOHandler::hasPendingIO() const
+{
+	return _pendingIO;
+}
+
+void	IOHandler::setPendingIO(bool pending)
+{
+	_pendingIO = pending;
+}
+
+bool	IOHandler::isStarved() const
+{
+	return _starved;
+}
+
+void	IOHandler::setStarved(bool starved)
+{
+	_starved = starved;
 }
 
 void	IOHandler::setNonBlocking(int fd)
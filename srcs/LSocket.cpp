@@ -11,8 +11,9 @@
 /* ************************************************************************** */
 
 #include "LSocket.hpp"
+#include "Utils.hpp"
 
-LSocket::LSocket() : Socket()
+LSocket::LSocket() : Socket(), _reserveFd(openReserveFd())
 {
     ::memset(&_addr, 0, sizeof(_addr));
 }
@@ -20,6 +21,8 @@ LSocket::LSocket() : Socket()
 LSocket::~LSocket()
 {
     // Socket base class destructor will handle cleanup
+    if (_reserveFd != -1)
+        ::close(_reserveFd);
 }
 
 void LSocket::setup(const std::string &host, int port)
@@ -51,6 +54,14 @@ void LSocket::setup(const std::string &host, int port)
     setNonBlocking(true);
 }
 
+void LSocket::adopt(int fd)
+{
+    if (_fd != -1)
+        throw std::runtime_error("Socket already created");
+    _fd = fd;
+    setNonBlocking(true);
+}
+
 void LSocket::startListen(int backlog)
 {
     if (_fd == -1)
@@ -68,17 +79,24 @@ CSocket* LSocket::acceptClient()
     struct sockaddr_in clientAddr;
     socklen_t addrLen = sizeof(clientAddr);
 
-    int clientFd = ::accept(_fd, (struct sockaddr*)&clientAddr, &addrLen);
+    int clientFd = ::accept4(_fd, (struct sockaddr*)&clientAddr, &addrLen,
+                             SOCK_NONBLOCK | SOCK_CLOEXEC);
     
     if (clientFd < 0)
     {
         if (errno == EAGAIN || errno == EWOULDBLOCK)
             return NULL;  // No pending connections
+        if (errno == EMFILE || errno == ENFILE)
+        {
+            LOG_WARNING("Out of file descriptors, dropping a pending connection");
+            if (shedConnection(_fd, _reserveFd))
+                return NULL;
+        }
         throw std::runtime_error(std::string("Accept failed: ") + strerror(errno));
     }
 
     try {
-        return new CSocket(clientFd, clientAddr);
+        return new CSocket(clientFd, clientAddr, true);
     }
     catch (const std::exception& e) {
         ::close(clientFd);  // Clean up on error
@@ -11,97 +11,206 @@
 /* ************************************************************************** */
 
 #include "ListeningSocket.hpp"
-
-ListeningSocket::ListeningSocket(const std::string& host, int port)
-    : IOHandler(_fd)  // Note: _fd will be initialized in setupSocket()
-    , _host(host)
-    , _port(port)
-    , _fd(-1)
+#include "Utils.hpp"
+#include "ConnectionLimiter.hpp"
+#include <netinet/tcp.h>
+#include <cerrno>
+
+ListeningSocket::ListeningSocket(int fd, const Config::ServerConfig& config,
+    RequestProcessor& processor, ConnectionLimiter& limiter)
+    : IOHandler(fd, true)  // openSocket() made it non-blocking
+    , _config(config)
+    , _processor(processor)
+    , _limiter(limiter)
+    , _host(config.host)
+    , _port(config.port)
+    , _fd(fd)
+    , _reserveFd(openReserveFd())
 {
-    setupSocket();
 }
 
 ListeningSocket::~ListeningSocket()
 {
     if (_fd != -1)
         close(_fd);
+    if (_reserveFd != -1)
+        close(_reserveFd);
 }
 
-void ListeningSocket::setupSocket()
+int ListeningSocket::openSocket(const Config::ServerConfig& config, bool reusePort)
 {
-    // Create socket
-    _fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (_fd == -1)
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1)
         throw std::runtime_error("Failed to create socket");
 
     try {
-        setSocketOptions();
-        bindSocket();
-        startListening();
+        setSocketOptions(fd, reusePort);
+        bindSocket(fd, config);
+        setTcpOptions(fd, config);
+        startListening(fd, config.backlog);
     }
     catch (const std::exception& e) {
-        if (_fd != -1)
-            close(_fd);
+        close(fd);
         throw;
     }
+    return fd;
 }
 
-void ListeningSocket::setSocketOptions()
+void ListeningSocket::setSocketOptions(int fd, bool reusePort)
 {
     // Set socket options
     int opt = 1;
-    if (setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) == -1)
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) == -1)
         throw std::runtime_error("setsockopt failed");
-
-	// Set non-blocking should be done in IOHandler constructor
+    if (reusePort && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) == -1)
+        throw std::runtime_error("setsockopt SO_REUSEPORT failed");
 }
 
-void ListeningSocket::bindSocket()
+void ListeningSocket::bindSocket(int fd, const Config::ServerConfig& config)
 {
     struct sockaddr_in addr;
     memset(&addr, 0, sizeof(addr));
     addr.sin_family = AF_INET;
-    addr.sin_port = htons(_port);
+    addr.sin_port = htons(config.port);
     
-    if (_host.empty() || _host == "0.0.0.0")
+    if (config.host.empty() || config.host == "0.0.0.0")
         addr.sin_addr.s_addr = INADDR_ANY;
-    else if (inet_pton(AF_INET, _host.c_str(), &addr.sin_addr) <= 0)
+    else if (inet_pton(AF_INET, config.host.c_str(), &addr.sin_addr) <= 0)
         throw std::runtime_error("Invalid host address");
 
-    if (bind(_fd, (struct sockaddr*)&addr, sizeof(addr)) == -1)
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1)
         throw std::runtime_error("bind failed");
 }
 
-void ListeningSocket::startListening()
+static void setIntOption(int fd, int level, int option, int value, const char* name)
+{
+    if (setsockopt(fd, level, option, &value, sizeof(value)) == -1)
+        throw std::runtime_error(std::string("setsockopt ") + name + " failed: " + strerror(errno));
+}
+
+void ListeningSocket::setTcpOptions(int fd, const Config::ServerConfig& config)
 {
-    if (listen(_fd, SOMAXCONN) == -1)
+    // Fixed sizes turn off the kernel's buffer autotuning for the connection
+    if (config.sndBuf > 0)
+        setIntOption(fd, SOL_SOCKET, SO_SNDBUF, static_cast<int>(config.sndBuf), "SO_SNDBUF");
+    if (config.rcvBuf > 0)
+        setIntOption(fd, SOL_SOCKET, SO_RCVBUF, static_cast<int>(config.rcvBuf), "SO_RCVBUF");
+    if (config.tcpNodelay)
+        setIntOption(fd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+    // Only wake us once the request arrived; a client that sends nothing
+    // is dropped by the kernel after about the header timeout
+    if (config.deferAccept)
+    {
+        int seconds = static_cast<int>(config.clientHeaderTimeout / 1000);
+        setIntOption(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, seconds > 0 ? seconds : 1, "TCP_DEFER_ACCEPT");
+    }
+    if (config.fastOpen > 0)
+        setIntOption(fd, IPPROTO_TCP, TCP_FASTOPEN, config.fastOpen, "TCP_FASTOPEN");
+}
+
+void ListeningSocket::startListening(int fd, int backlog)
+{
+    if (listen(fd, backlog) == -1)
         throw std::runtime_error("listen failed");
 }
 
+// Accepts up to accept_batch connections per wakeup. In edge-triggered mode
+// a listener that stops on the batch limit marks itself pending, since no
+// new edge will arrive for the connections still in the backlog.
 bool ListeningSocket::handleRead()
 {
-    struct sockaddr_in clientAddr;
-    socklen_t addrLen = sizeof(clientAddr);
-    
-	int clientFd = accept(_fd, (struct sockaddr*)&clientAddr, &addrLen);
-	
-	if (clientFd == -1) {
-		return true;  // Accept failed, try again later
+	EventLoop*	loop = EventLoop::getInstance();
+	size_t		accepted = 0;
+	size_t		attempt;
+
+	for (attempt = 0; attempt < _config.acceptBatch; attempt++)
+	{
+		struct sockaddr_in clientAddr;
+		socklen_t addrLen = sizeof(clientAddr);
+
+		int clientFd = accept4(_fd, (struct sockaddr*)&clientAddr, &addrLen,
+							SOCK_NONBLOCK | SOCK_CLOEXEC);
+		loop->getStats().acceptCalls++;
+		if (clientFd == -1)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;  // Backlog drained
+			if (errno == EMFILE || errno == ENFILE)
+			{
+				// One client is turned away per wakeup, not the whole batch;
+				// the rest waits in the backlog for the next wakeup, when
+				// closed connections may have freed some fds
+				LOG_WARNING("Out of file descriptors on " + getInfo() + ", dropping a pending connection");
+				shedConnection(_fd, _reserveFd);
+				break;
+			}
+			continue;  // EINTR, ECONNABORTED, ...: try the next one
+		}
+		if (admit(clientFd, clientAddr))
+			accepted++;
+	}
+	setPendingIO(attempt == _config.acceptBatch && loop->isEdgeTriggered());
+	loop->getStats().accepts.record(accepted);
+	return true;
+}
+
+// A connection the io_uring backend accepted. Multishot accept reports no
+// peer address, so it is looked up here for the limiter.
+void ListeningSocket::handleAccepted(int clientFd)
+{
+	EventLoop*	loop = EventLoop::getInstance();
+
+	if (clientFd < 0)
+	{
+		if (clientFd == -EMFILE || clientFd == -ENFILE)
+		{
+			LOG_WARNING("Out of file descriptors on " + getInfo() + ", dropping a pending connection");
+			shedConnection(_fd, _reserveFd);
+		}
+		return;
+	}
+
+	struct sockaddr_in clientAddr;
+	socklen_t addrLen = sizeof(clientAddr);
+	loop->getStats().acceptCalls++;
+	if (getpeername(clientFd, (struct sockaddr*)&clientAddr, &addrLen) == -1)
+	{
+		close(clientFd);  // Already gone again
+		return;
+	}
+	loop->getStats().accepts.record(admit(clientFd, clientAddr) ? 1 : 0);
+}
+
+// Hands an accepted socket to a new ClientConnection; false if it was
+// turned away or failed, the fd is closed then
+bool ListeningSocket::admit(int clientFd, const struct sockaddr_in& clientAddr)
+{
+	// Over a limit: reset it before anything is allocated for it
+	if (!_limiter.admit(clientAddr.sin_addr.s_addr))
+	{
+		setAbortiveClose(clientFd);
+		close(clientFd);
+		return false;
 	}
 
+	ClientConnection* client = NULL;
 	try {
-		char clientIP[INET_ADDRSTRLEN];
-		inet_ntop(AF_INET, &clientAddr.sin_addr, clientIP, INET_ADDRSTRLEN);
-		uint16_t clientPort = ntohs(clientAddr.sin_port);
-		
-		ClientConnection* client = new ClientConnection(clientFd, clientIP, clientPort);
+		client = new ClientConnection(clientFd, clientAddr, _config, _processor, _limiter);
 		EventLoop::getInstance()->registerHandler(client);
 		return true;
 	}
 	catch (const std::exception& e) {
-		close(clientFd);
-		return false;
+		// A failed client must not take the listener down with it
+		LOG_ERROR("Failed to setup connection on " + getInfo() + ": " + e.what());
+		if (client)
+			delete client;  // Closes the fd and releases its place
+		else
+		{
+			_limiter.release(clientAddr.sin_addr.s_addr);
+			close(clientFd);
+		}
 	}
+	return false;
 }
 
 bool ListeningSocket::handleWrite()
@@ -124,6 +233,16 @@ int ListeningSocket::getFd() const
     return _fd;
 }
 
+void ListeningSocket::onDrain()
+{
+    EventLoop::getInstance()->removeHandler(this);
+}
+
+Poller::Completion ListeningSocket::getCompletion() const
+{
+    return Poller::ACCEPT_COMPLETION;
+}
+
 std::string ListeningSocket::getInfo() const
 {
     std::stringstream ss;
@@ -16,6 +16,7 @@ Logger* Logger::instance = NULL;
 
 Logger::Logger() : currentLevel(DEBUG)
 {
+    pthread_mutex_init(&mutex, NULL);
     openLogFile();
 }
 
@@ -42,9 +43,10 @@ std::string Logger::getLevelString(LogLevel level) {
 
 std::string Logger::getDate() {
     time_t now = time(0);
-    struct tm* timeinfo = localtime(&now);
+    struct tm timeinfo;
+    localtime_r(&now, &timeinfo);
     char buffer[11];
-    strftime(buffer, sizeof(buffer), "%Y-%m-%d", timeinfo);
+    strftime(buffer, sizeof(buffer), "%Y-%m-%d", &timeinfo);
     return std::string(buffer);
 }
 
@@ -59,9 +61,10 @@ void Logger::openLogFile() {
 
 std::string Logger::getTimestamp() {
     time_t now = time(0);
-    struct tm* timeinfo = localtime(&now);
+    struct tm timeinfo;
+    localtime_r(&now, &timeinfo);
     char buffer[9];
-    strftime(buffer, sizeof(buffer), "%H:%M:%S", timeinfo);
+    strftime(buffer, sizeof(buffer), "%H:%M:%S", &timeinfo);
     return std::string(buffer);
 }
 
@@ -135,6 +138,7 @@ void Logger::log(LogLevel level, const std::string& message,
         }
     }
     
+    pthread_mutex_lock(&mutex);
     if (logFile.is_open()) {
         logFile << plainOutput << std::endl;
     }
@@ -144,10 +148,12 @@ void Logger::log(LogLevel level, const std::string& message,
         std::cout << output << std::endl;
     else
         std::cerr << output << std::endl;
+    pthread_mutex_unlock(&mutex);
 }
 
 Logger::~Logger() {
     if (logFile.is_open()) {
         logFile.close();
     }
+    pthread_mutex_destroy(&mutex);
 }
\ No newline at end of file
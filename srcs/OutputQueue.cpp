@@ -0,0 +1,478 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   OutputQueue.cpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: lwoiton <lwoiton@student.42prague.com>     +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/12/23 19:26:04 by lwoiton           #+#    #+#             */
+/*   Updated: 2024/12/23 19:26:04 by lwoiton          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "OutputQueue.hpp"
+#include "BodySource.hpp"
+#include "DiskPool.hpp"
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+const size_t OutputQueue::SENDFILE_CHUNK;
+const size_t OutputQueue::STREAM_CHUNK;
+const size_t OutputQueue::STREAM_WINDOW;
+
+// Reads a file range in a pool thread and throws it away: the sendfile()
+// that follows finds it in the page cache instead of waiting for the disk.
+class FilePrefetch : public DiskTask
+{
+	public:
+		FilePrefetch(int fd, off_t offset, size_t length)
+			: _fd(fd), _offset(offset), _length(length), _ownsFd(false) {}
+		virtual ~FilePrefetch()
+		{
+			if (_ownsFd)
+				close(_fd);
+		}
+		virtual void	run()
+		{
+			char	scratch[64 * 1024];
+			size_t	done = 0;
+
+			while (done < _length)
+			{
+				ssize_t n = pread(_fd, scratch, std::min(sizeof(scratch), _length - done), _offset + done);
+				if (n == -1 && errno == EINTR)
+					continue;
+				if (n <= 0)
+					break;  // sendfile() runs into the same problem and reports it
+				done += n;
+			}
+		}
+		size_t			getLength() const { return _length; }
+		// The queue let go of the file while the read was running
+		void			adoptFd() { _ownsFd = true; }
+
+	private:
+		int				_fd;
+		off_t			_offset;
+		size_t			_length;
+		bool			_ownsFd;
+};
+
+// cachestat(2) arrived with Linux 6.5, older headers lack it
+#ifndef __NR_cachestat
+# define __NR_cachestat 451
+#endif
+
+struct CachestatRange
+{
+	uint64_t	off;
+	uint64_t	len;
+};
+
+struct Cachestat
+{
+	uint64_t	nrCache;
+	uint64_t	nrDirty;
+	uint64_t	nrWriteback;
+	uint64_t	nrEvicted;
+	uint64_t	nrRecentlyEvicted;
+};
+
+// RWF_NOWAIT fails with EAGAIN instead of going to the disk. Only both
+// ends are probed: readahead fills the page cache in whole windows.
+static bool	isCached(int fd, off_t offset, size_t length)
+{
+	char			byte;
+	struct iovec	iov = { &byte, 1 };
+
+	return preadv2(fd, &iov, 1, offset, RWF_NOWAIT) == 1
+		&& (length == 1 || preadv2(fd, &iov, 1, offset + length - 1, RWF_NOWAIT) == 1);
+}
+
+// Bytes from offset that are known to be in the page cache: the whole
+// range when cachestat() counts every page of it, otherwise 0. Without
+// cachestat() only the window is probed, at both ends.
+static size_t	cachedBytes(int fd, off_t offset, size_t length, size_t window)
+{
+	static bool		noCachestat = false;
+	const uint64_t	page = sysconf(_SC_PAGESIZE);
+
+	if (!noCachestat)
+	{
+		CachestatRange	range = { static_cast<uint64_t>(offset), length };
+		Cachestat		stat;
+		if (syscall(__NR_cachestat, fd, &range, &stat, 0) == 0)
+		{
+			uint64_t first = offset / page;
+			uint64_t pages = (offset + length + page - 1) / page - first;
+			return stat.nrCache >= pages ? length : 0;
+		}
+		if (errno != ENOSYS)
+			return 0;
+		noCachestat = true;
+	}
+	return isCached(fd, offset, window) ? window : 0;
+}
+
+OutputQueue::OutputQueue()
+	: _segments()
+	, _offset(0)
+	, _size(0)
+	, _cork(false)
+	, _corked(false)
+	, _pipelined(false)
+	, _nodelay(false)
+	, _waitFd(-1)
+	, _prefetch(NULL)
+{
+}
+
+OutputQueue::~OutputQueue()
+{
+	clear();
+}
+
+void	OutputQueue::push(const std::string& data)
+{
+	if (data.empty())
+		return;
+	_segments.push_back(Segment());
+	_segments.back().data.assign(data.begin(), data.end());
+	_size += data.size();
+}
+
+void	OutputQueue::push(std::vector<char>& data)
+{
+	if (data.empty())
+		return;
+	_segments.push_back(Segment());
+	_segments.back().data.swap(data);
+	_size += _segments.back().data.size();
+}
+
+void	OutputQueue::pushFile(int fd, off_t offset, size_t length)
+{
+	if (length == 0)
+	{
+		close(fd);
+		return;
+	}
+	_segments.push_back(Segment());
+	_segments.back().fd = fd;
+	_segments.back().offset = offset;
+	_segments.back().length = length;
+	_size += length;
+}
+
+void	OutputQueue::pushSource(BodySource* source, bool chunked)
+{
+	_segments.push_back(Segment());
+	_segments.back().source = source;
+	_segments.back().chunked = chunked;
+}
+
+// With cork set, a queue that will not go out in one call (a file behind
+// the headers, or more than MAX_IOV pieces) is sent under TCP_CORK and
+// uncorked when it runs empty, so only the last packet may be partial.
+// A pipelined batch is corked as well. Its packets can be short of the
+// MSS (a file page per fragment), and uncorking still leaves the last one
+// to Nagle, which holds it until the client ACKs. Without tcp_nodelay,
+// TCP_NODELAY is turned on and right off again: that pushes the tail out
+// and keeps Nagle for the rest of the connection.
+ssize_t	OutputQueue::writeTo(int fd)
+{
+	if (_segments.empty())
+		return 0;
+	if ((_cork || _pipelined) && !_corked && _needsCork())
+		_corked = _setCork(fd, true);
+
+	ssize_t written;
+	_waitFd = -1;
+	if (_segments.front().source)
+		written = _sendSource(fd);
+	else if (_segments.front().fd != -1)
+		written = _sendFile(fd);
+	else
+		written = _sendMemory(fd);
+
+	if (_segments.empty())
+	{
+		if (_corked)
+			_corked = !_setCork(fd, false);
+		if (_pipelined && !_nodelay)
+		{
+			int on = 1;
+			int off = 0;
+			::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+			::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &off, sizeof(off));
+		}
+		_pipelined = false;
+	}
+	return written;
+}
+
+void	OutputQueue::setCork(bool enabled)
+{
+	_cork = enabled;
+}
+
+void	OutputQueue::setNodelay(bool enabled)
+{
+	_nodelay = enabled;
+}
+
+void	OutputQueue::setPipelined()
+{
+	_pipelined = true;
+}
+
+// Headers and an in-memory body leave in one sendmsg() and need no cork
+bool	OutputQueue::_needsCork() const
+{
+	if (_segments.size() < 2)
+		return false;
+	if (_pipelined || _segments.size() > static_cast<size_t>(MAX_IOV))
+		return true;
+	for (size_t i = 1; i < _segments.size(); i++)
+	{
+		if (_segments[i].fd != -1 || _segments[i].source)
+			return true;
+	}
+	return false;
+}
+
+bool	OutputQueue::_setCork(int fd, bool on)
+{
+	int value = on ? 1 : 0;
+	return ::setsockopt(fd, IPPROTO_TCP, TCP_CORK, &value, sizeof(value)) == 0;
+}
+
+ssize_t	OutputQueue::_sendMemory(int fd)
+{
+	struct iovec	iov[MAX_IOV];
+	int				count = 0;
+	int				flags = MSG_NOSIGNAL;
+
+	for (size_t i = 0; i < _segments.size() && count < MAX_IOV; i++, count++)
+	{
+		if (_segments[i].fd != -1 || _segments[i].source)
+		{
+			flags |= MSG_MORE;  // The file or stream follows right away
+			break;
+		}
+		size_t skip = (i == 0) ? _offset : 0;
+		iov[count].iov_base = &_segments[i].data[skip];
+		iov[count].iov_len = _segments[i].data.size() - skip;
+	}
+
+	// writev() with MSG_NOSIGNAL: a closed peer is an EPIPE, not a SIGPIPE
+	struct msghdr	msg;
+	std::memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = count;
+	ssize_t written = ::sendmsg(fd, &msg, flags);
+	if (written <= 0)
+		return written;
+
+	size_t left = static_cast<size_t>(written);
+	_size -= left;
+	while (left > 0)
+	{
+		size_t front = _segments.front().data.size() - _offset;
+		if (left < front)
+		{
+			_offset += left;
+			break;
+		}
+		left -= front;
+		_popFront();
+	}
+	return written;
+}
+
+ssize_t	OutputQueue::_sendFile(int fd)
+{
+	Segment&	front = _segments.front();
+	size_t		chunk = std::min(front.length, SENDFILE_CHUNK);
+
+	if (DiskPool::isRunning())
+	{
+		if (front.cached == 0 && !_prefetchFile(front))
+			return -1;
+		chunk = std::min(chunk, front.cached);
+	}
+	ssize_t		sent = ::sendfile(fd, front.fd, &front.offset, chunk);
+
+	if (sent == 0)
+	{
+		errno = EIO;  // Truncated since Content-Length was computed
+		return -1;
+	}
+	if (sent < 0)
+		return sent;
+	front.length -= sent;
+	front.cached -= std::min(front.cached, static_cast<size_t>(sent));
+	_size -= sent;
+	if (front.length == 0)
+		_popFront();
+	return sent;
+}
+
+// True when the next window is in the page cache. Otherwise a pool
+// thread reads it and this fails with EAGAIN until diskDone(). A file
+// that is cached as a whole costs one probe, not one per window.
+bool	OutputQueue::_prefetchFile(Segment& segment)
+{
+	size_t window = std::min(segment.length, SENDFILE_CHUNK);
+
+	if (!_prefetch)
+		segment.cached = cachedBytes(segment.fd, segment.offset, segment.length, window);
+	if (segment.cached > 0)
+		return true;
+	if (!_prefetch)
+	{
+		_prefetch = new FilePrefetch(segment.fd, segment.offset, window);
+		DiskPool::submit(_prefetch);
+	}
+	errno = EAGAIN;
+	return false;
+}
+
+// Sends the current window of a streamed body. A new window is only
+// pulled from the source once the previous one went out completely, which
+// is what holds a producer back behind a slow client.
+ssize_t	OutputQueue::_sendSource(int fd)
+{
+	Segment&	front = _segments.front();
+
+	if (front.data.empty())
+	{
+		if (!_fillWindow(front))
+			return -1;
+		if (front.data.empty())
+		{
+			_popFront();  // Ended without a byte to send
+			return 0;
+		}
+	}
+
+	int flags = MSG_NOSIGNAL | (front.ended ? 0 : MSG_MORE);
+	ssize_t sent = ::send(fd, &front.data[_offset], front.data.size() - _offset, flags);
+	if (sent <= 0)
+		return sent;
+	_offset += sent;
+	if (_offset == front.data.size())
+	{
+		_offset = 0;
+		if (front.ended)
+			_popFront();
+		else
+			std::vector<char>().swap(front.data);	// Nothing held between windows
+	}
+	return sent;
+}
+
+// Reads up to STREAM_WINDOW bytes, framed as chunks when asked to. False
+// with errno set when nothing could be read: EAGAIN leaves getWaitFd() set,
+// anything else is fatal for the response.
+bool	OutputQueue::_fillWindow(Segment& segment)
+{
+	size_t	produced = 0;
+
+	while (produced < STREAM_WINDOW && !segment.ended)
+	{
+		size_t	used = segment.data.size();
+		segment.data.resize(used + STREAM_CHUNK);
+		ssize_t	n = segment.source->read(&segment.data[used], STREAM_CHUNK);
+		segment.data.resize(used + (n > 0 ? n : 0));
+		if (n > 0)
+		{
+			if (segment.chunked)
+			{
+				char line[24];
+				int len = std::snprintf(line, sizeof(line), "%zx\r\n", static_cast<size_t>(n));
+				segment.data.insert(segment.data.begin() + used, line, line + len);
+				segment.data.insert(segment.data.end(), "\r\n", "\r\n" + 2);
+			}
+			produced += n;
+		}
+		else if (n == 0)
+		{
+			static const char last[] = "0\r\n\r\n";
+			if (segment.chunked)
+				segment.data.insert(segment.data.end(), last, last + sizeof(last) - 1);
+			segment.ended = true;
+		}
+		else if (errno == EAGAIN || errno == EWOULDBLOCK)
+			break;
+		else
+			return false;
+	}
+	if (segment.data.empty() && !segment.ended)
+	{
+		_waitFd = segment.source->getFd();
+		errno = EAGAIN;
+		return false;
+	}
+	return true;
+}
+
+void	OutputQueue::_popFront()
+{
+	if (_segments.front().fd != -1 && _prefetch)
+	{
+		_prefetch->adoptFd();  // Closed with the task, after the read
+		_prefetch = NULL;
+	}
+	else if (_segments.front().fd != -1)
+		close(_segments.front().fd);
+	delete _segments.front().source;
+	_segments.pop_front();
+	_offset = 0;
+}
+
+bool	OutputQueue::empty() const
+{
+	return _segments.empty();
+}
+
+int		OutputQueue::getWaitFd() const
+{
+	return _waitFd;
+}
+
+DiskTask*	OutputQueue::getDiskWait() const
+{
+	return _prefetch;
+}
+
+// A task of a segment already dropped is not ours any more
+void	OutputQueue::diskDone(DiskTask* task)
+{
+	if (!_prefetch || task != _prefetch)
+		return;
+	_segments.front().cached = _prefetch->getLength();
+	_prefetch = NULL;
+}
+
+size_t	OutputQueue::size() const
+{
+	return _size;
+}
+
+void	OutputQueue::clear()
+{
+	while (!_segments.empty())
+		_popFront();
+	_size = 0;
+}
@@ -183,7 +183,7 @@ HTTPResponse RequestProcessor::handlePOSTRequest(HTTPRequest &req)
         // Handle file upload if configured
         if (!route->uploadDir.empty()) {
             // Verify content type
-            std::string contentType = req.getHeader("Content-Type");
+            std::string contentType = req.getHeader(HTTPRequest::HDR_CONTENT_TYPE);
             if (contentType.find("multipart/form-data") != std::string::npos)
 			{
 				if (route->uploadDir.empty())
@@ -196,7 +196,7 @@ HTTPResponse RequestProcessor::handlePOSTRequest(HTTPRequest &req)
             //return handleFileUpload(req, route);
         }
         // check if chunked request
-        if (req.getHeader("Content-Length") != "") {
+        if (req.hasHeader(HTTPRequest::HDR_CONTENT_LENGTH)) {
             response.setStatus(200);
             response.setHeader("Content-Type", "text/html");
             response.setBody("");
@@ -205,7 +205,7 @@ HTTPResponse RequestProcessor::handlePOSTRequest(HTTPRequest &req)
 
         // Handle other POST requests (database operations etc.)
         if (req.getURL().getPath() == "/user_create") {
-            std::string body(req.getBody().begin(), req.getBody().end());
+            std::string body = req.getBody().str();
             std::map<std::string, std::string> query = parseQueryParamsPOST(body);
             std::string res = _usersDB.addUserToDatabase(query);
             response.setStatus(200);
@@ -428,7 +428,7 @@ void	RequestProcessor::findAndSetBestRoute(HTTPRequest &req) const
 	if (req.getURL().isAbsoluteForm())
 		authority = req.getURL().getAuthority();
 	else
-		authority = req.getHeader("Host");
+		authority = req.getHeader(HTTPRequest::HDR_HOST);
 
 	// Search for longest matching prefix
 	std::string searchPath = path;
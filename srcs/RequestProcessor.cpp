@@ -1,4 +1,7 @@
 #include "RequestProcessor.hpp"
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
 
 /* Constructor */
 RequestProcessor::RequestProcessor(const std::vector<Config::ServerConfig> &servers)
@@ -44,6 +47,8 @@ HTTPResponse RequestProcessor::processRequest(HTTPRequest &req)
             return handlePOSTRequest(req);
         } else if (req.getMethod() == "DELETE") {
             return handleDELETERequest(req);
+        } else if (req.getMethod() == "PUT") {
+            return handleRawUpload(req);
         }
     }
     catch (const HTTPError& e) {
@@ -116,27 +121,27 @@ HTTPResponse RequestProcessor::handleGETRequest(HTTPRequest &req)
     return serveFile(fileInfo.path, fileInfo.mimeType);
 }
 
+// The body stays in the file: the connection sends it with sendfile()
 HTTPResponse RequestProcessor::serveFile(const std::string& filePath, const std::string& mimeType) const
 {
     HTTPResponse response;
-    std::ifstream file(filePath.c_str(), std::ios::binary);
+    int fd = open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
     
-    if (!file.is_open())
+    if (fd == -1)
         throw HTTPError(404, "Not Found");
 
     // Get file size
-    file.seekg(0, std::ios::end);
-    size_t size = file.tellg();
-    file.seekg(0, std::ios::beg);
-
-    // Read file content
-    std::vector<char> buffer(size);
-    if (size > 0)
-        file.read(&buffer[0], size);
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode))
+    {
+        close(fd);
+        throw HTTPError(404, "Not Found");
+    }
 
     response.setStatus(200);
     response.setHeader("Content-Type", mimeType);
-    response.setBody(std::string(buffer.begin(), buffer.end()));
+    response.setHeader("Content-Length", toString(static_cast<size_t>(st.st_size)));
+    response.setBodyFile(fd, st.st_size);
     return response;
 }
 
@@ -145,11 +150,15 @@ HTTPResponse RequestProcessor::handlePOSTRequest(HTTPRequest &req)
     HTTPResponse response;
     const Config::Route* route = req.getMatchedRoute();
     
+    // Spliced to the upload directory while it arrived, or small enough
+    // to have arrived with the headers, before a sink could be attached
+    if (req.getBodySink() || !rawUploadPath(req).empty())
+        return handleRawUpload(req);
     try {
         // Handle file upload if configured
         if (!route->uploadDir.empty()) {
             // Verify content type
-            std::string contentType = req.getHeader("Content-Type");
+            std::string contentType = req.getHeader(HTTPRequest::HDR_CONTENT_TYPE);
             if (contentType.find("multipart/form-data") != std::string::npos)
 			{
 				if (route->uploadDir.empty())
@@ -162,7 +171,7 @@ HTTPResponse RequestProcessor::handlePOSTRequest(HTTPRequest &req)
             //return handleFileUpload(req, route);
         }
         // check if chunked request
-        if (req.getHeader("Content-Length") != "") {
+        if (req.hasHeader(HTTPRequest::HDR_CONTENT_LENGTH)) {
             response.setStatus(200);
             response.setHeader("Content-Type", "text/html");
             response.setBody("");
@@ -171,7 +180,7 @@ HTTPResponse RequestProcessor::handlePOSTRequest(HTTPRequest &req)
 
         // Handle other POST requests (database operations etc.)
         if (req.getURL().getPath() == "/user_create") {
-            std::string body(req.getBody().begin(), req.getBody().end());
+            std::string body = req.getBody().str();
             std::map<std::string, std::string> query = parseQueryParamsPOST(body);
             std::string res = _usersDB.addUserToDatabase(query);
             response.setStatus(200);
@@ -246,6 +255,90 @@ HTTPResponse RequestProcessor::handleFileUpload(HTTPRequest &req, const Config::
     }
 }
 
+// Where a raw upload (PUT, or a POST that is not multipart) to an
+// upload_dir route is stored: the last segment of the request path in
+// upload_dir. Empty when the request is not such an upload.
+std::string RequestProcessor::rawUploadPath(const HTTPRequest &req) const
+{
+    const Config::Route* route = req.getMatchedRoute();
+    if (!route || route->uploadDir.empty())
+        return "";
+    if (route->allowedMethods.find(req.getMethod()) == route->allowedMethods.end())
+        return "";
+    if (req.getMethod() != "PUT" && (req.getMethod() != "POST"
+        || req.getHeader(HTTPRequest::HDR_CONTENT_TYPE).find("multipart/form-data") != std::string::npos))
+        return "";
+
+    const std::string& remaining = req.getRemainingPath();
+    std::string name = remaining.substr(remaining.find_last_of('/') + 1);
+    if (name.empty() || name == "." || name == "..")
+        return "";
+    std::string path = route->uploadDir;
+    if (path[path.length() - 1] != '/')
+        path += '/';
+    return path + name;
+}
+
+// Called once the headers of a Content-Length request are parsed. A raw
+// upload gets a sink that splices the body from the socket to its file;
+// everything else keeps its body in memory and is routed again later.
+UploadSink* RequestProcessor::openBodySink(HTTPRequest &req)
+{
+    if (!req.wantsBodySink())
+        return NULL;
+    try {
+        findAndSetBestRoute(req);
+        std::string path = rawUploadPath(req);
+        if (path.empty())
+            return NULL;
+        return new UploadSink(path, req.getBody().size() + req.getBodyRemaining());
+    }
+    catch (const std::exception& e) {
+        // processRequest() reports the same problem with the right status
+        LOG_DEBUG("No upload sink: " + std::string(e.what()));
+        return NULL;
+    }
+}
+
+HTTPResponse RequestProcessor::handleRawUpload(HTTPRequest &req)
+{
+    HTTPResponse response;
+    std::string path = rawUploadPath(req);
+    if (path.empty())
+        throw HTTPError(403, "Forbidden: File uploads not allowed");
+
+    UploadSink* sink = req.getBodySink();
+    if (sink)
+        sink->finish();
+    else
+    {
+        // Small or chunked bodies, from wherever BodyStorage keeps them
+        const BodyStorage& body = req.getBody();
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        size_t offset = 0;
+        while (fd != -1 && offset < body.size())
+        {
+            if (body.sendTo(fd, offset) < 0 && errno != EINTR)
+            {
+                close(fd);
+                fd = -1;
+            }
+        }
+        if (fd == -1 || close(fd) == -1)
+            throw HTTPError(500, "Failed to write file: " + path);
+    }
+    std::string name = path.substr(path.find_last_of('/') + 1);
+    LOG_DEBUG("Uploaded: " + name + (sink ? " (spliced)" : ""));
+
+    response.setStatus(201);
+    response.setHeader("Content-Type", "application/json");
+    response.setBody("{"
+        "\"status\": \"success\","
+        "\"message\": \"File uploaded successfully\","
+        "\"files\": [\"" + name + "\"]}");
+    return response;
+}
+
 std::string	RequestProcessor::decodeComponentPOST(const std::string& enocoded)
 {
 	std::string decoded;
@@ -393,7 +486,7 @@ void	RequestProcessor::findAndSetBestRoute(HTTPRequest &req) const
 	if (req.getURL().isAbsoluteForm())
 		authority = req.getURL().getAuthority();
 	else
-		authority = req.getHeader("Host");
+		authority = req.getHeader(HTTPRequest::HDR_HOST);
 
 	// Search for longest matching prefix
 	std::string searchPath = path;
@@ -11,35 +11,164 @@
 /* ************************************************************************** */
 
 #include "Server.hpp"
+#include "ListeningSocket.hpp"
+#include "Utils.hpp"
+#include "BufferPool.hpp"
+#include "BodyStorage.hpp"
+#include "DiskPool.hpp"
 #include <sstream>
+#include <cstdlib>
+#include <algorithm>
+#include <cerrno>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include <signal.h>
 
-Server::Server(const std::string &configPath) 
+extern char** environ;
+
+Server::Server(const std::string &configPath, char* const* argv) 
     : _config(new Config(configPath)) // Parsing config file
     , _epoll(new EpollManager()) // Init Epoll
+    , _listenSockets(1)
+    , _connections(2)
+    , _listenConfigs()
+    , _bodySources(3)
+    , _limiter(_config->getMaxConnections(), _config->getMaxConnectionsPerIp())
 	, _reqProc(RequestProcessor(_config->getServers()))
     , _isRunning(false)
+    , _argv(argv)
+    , _signalFd(-1)
+    , _upgradePid(0)
+    , _draining(false)
+    , _drainDeadline(0)
 {
 	try
     {
-        _setupListeners();
+        // Before any thread exists: workers inherit the blocked mask
+        _setupSignals();
+        _loadInheritedListeners();
+        BufferPool::setBudget(_config->getIoBufferBudget());
+        BodyStorage::configure(_config->getClientBodyBufferSize(),
+            _config->getClientBodyMemfdSize(), _config->getClientBodyTempPath());
+        DiskPool::start(_config->getDiskThreads());
+        // With several reactors every worker binds its own listeners
+        if (_config->getWorkerThreads() == 0)
+        {
+            if (_config->isEdgeTriggered())
+                LOG_WARNING("epoll_mode edge needs worker_threads, using level");
+            _setupListeners();
+            _epoll->addSocket(_signalFd, EPOLLIN, SIGNAL_TAG);
+            if (DiskPool::isRunning())
+                _epoll->addSocket(DiskCompletions::local().getFd(), EPOLLIN, DISK_TAG);
+        }
     }
     catch (const std::exception& e)
     {
         LOG_ERROR("Server initialization failed: " + std::string(e.what()));
+        DiskPool::stop();
         throw;
     }
 }
 
 Server::~Server()
 {
-    std::map<int, LSocket*>::iterator lit;
-    for (lit = _listenSockets.begin(); lit != _listenSockets.end(); ++lit)
-        delete lit->second;
+    for (size_t fd = 0; fd < _listenSockets.capacity(); ++fd)
+        delete _listenSockets.get(fd);
+
+    for (size_t fd = 0; fd < _connections.capacity(); ++fd)
+        delete _connections.get(fd);
+
+    for (size_t i = 0; i < _workers.size(); ++i)
+        delete _workers[i];
+    // The connections above gave their buffers back to this thread's pool
+    BufferPool::destroyLocal();
+    // Every reactor has collected its tasks, the queue is empty
+    DiskCompletions::destroyLocal();
+    DiskPool::stop();
+
+    for (std::multimap<std::string, int>::iterator it = _inherited.begin(); it != _inherited.end(); ++it)
+        close(it->second);
+    if (_signalFd != -1)
+        close(_signalFd);
+}
+
+void Server::_setupSignals()
+{
+    sigset_t handled;
+    sigset_t blocked;
+
+    sigemptyset(&handled);
+    sigaddset(&handled, SIGINT);
+    sigaddset(&handled, SIGTERM);
+    sigaddset(&handled, SIGQUIT);
+    sigaddset(&handled, SIGUSR2);
+    sigaddset(&handled, SIGCHLD);   // A failed upgrade
+    blocked = handled;
+    sigaddset(&blocked, SIGPIPE);   // Writes get EPIPE instead
+    if (pthread_sigmask(SIG_BLOCK, &blocked, NULL) != 0)
+        throw std::runtime_error("Failed to block signals");
+    _signalFd = signalfd(-1, &handled, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (_signalFd == -1)
+        throw std::runtime_error(std::string("signalfd failed: ") + strerror(errno));
+}
+
+// WEBSERV_LISTEN_FDS is set by the process we replace: "fd@host:port,..."
+void Server::_loadInheritedListeners()
+{
+    const char* list = getenv("WEBSERV_LISTEN_FDS");
+    if (!list)
+        return;
+
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        size_t at = item.find('@');
+        if (at == std::string::npos)
+            continue;
+        int fd = std::atoi(item.substr(0, at).c_str());
+        int listening = 0;
+        socklen_t len = sizeof(listening);
+        if (fd < 0 || getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &len) == -1 || !listening)
+        {
+            LOG_WARNING("Ignoring inherited listener " + item + ": not a listening socket");
+            continue;
+        }
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        _inherited.insert(std::make_pair(item.substr(at + 1), fd));
+    }
+    LOG_INFO("Inherited " + TO_STRING(_inherited.size()) + " listening sockets");
+}
+
+// Returns -1 when nothing (more) was inherited for address
+int Server::_takeInherited(const std::string& address)
+{
+    std::multimap<std::string, int>::iterator it = _inherited.find(address);
+    if (it == _inherited.end())
+        return -1;
+    int fd = it->second;
+    _inherited.erase(it);
+    return fd;
+}
 
-    std::map<int, Connection*>::iterator cit;
-    for (cit = _connections.begin(); cit != _connections.end(); ++cit)
-        delete cit->second;
+std::string Server::_addressOf(const Config::ServerConfig& server)
+{
+    return server.host + ":" + TO_STRING(server.port);
+}
+
+void Server::_addListener(LSocket* socket, const Config::ServerConfig& server)
+{
+    ListenFd listenFd;
+
+    _epoll->addSocket(socket->getFd(), EPOLLIN, _listenSockets.insert(socket->getFd(), socket));
+    _listenConfigs.insert(socket->getFd(), &server);
+    listenFd.fd = socket->getFd();
+    listenFd.address = _addressOf(server);
+    _listenFds.push_back(listenFd);
 }
 
 void Server::_setupListeners()
@@ -49,15 +178,39 @@ void Server::_setupListeners()
     
     for (it = servers.begin(); it != servers.end(); ++it)
     {
+        // Reuse every socket the old process had for this address
+        std::string address = _addressOf(*it);
+        bool inherited = false;
+        int fd;
+        while ((fd = _takeInherited(address)) != -1)
+        {
+            LSocket* socket = new LSocket();
+            try
+            {
+                socket->adopt(fd);
+                _addListener(socket, *it);
+                inherited = true;
+                LOG_INFO("Listening on " + address + " -> inherited socket " + TO_STRING(fd));
+            }
+            catch (const std::exception& e)
+            {
+                delete socket;
+                LOG_ERROR("Failed to adopt listener on " + address + " -> " + e.what());
+                throw;
+            }
+        }
+        if (inherited)
+            continue;
+
         LSocket* socket = new LSocket();
         try
         {
             socket->setup(it->host, it->port);
-            socket->startListen();
+            ListeningSocket::setTcpOptions(socket->getFd(), *it);
+            socket->startListen(it->backlog);
             socket->setNonBlocking(true);
-            _epoll->addSocket(socket->getFd(), EPOLLIN);
-            _listenSockets[socket->getFd()] = socket;
-            LOG_INFO("Listening on " + it->host + ":" + TO_STRING(it->port) + " -> socket " + TO_STRING(socket->getFd()) + " (O_NONBLOCK | backlog 4096)" );
+            _addListener(socket, *it);
+            LOG_INFO("Listening on " + it->host + ":" + TO_STRING(it->port) + " -> socket " + TO_STRING(socket->getFd()) + " (O_NONBLOCK | backlog " + TO_STRING(it->backlog) + ")" );
         }
         catch (const std::exception& e)
         {
@@ -66,12 +219,32 @@ void Server::_setupListeners()
             throw;
         }
     }
+    _closeUnusedInherited();
+}
+
+// Addresses dropped from the config: their pending connections are lost
+void Server::_closeUnusedInherited()
+{
+    std::multimap<std::string, int>::iterator it;
+
+    for (it = _inherited.begin(); it != _inherited.end(); ++it)
+    {
+        LOG_WARNING("No server listens on " + it->first + " any more, closing inherited socket");
+        close(it->second);
+    }
+    _inherited.clear();
 }
 
 void Server::run()
 {
     _isRunning = true;
+    if (_config->getWorkerThreads() > 0)
+    {
+        _runWorkers();
+        return;
+    }
     LOG_INFO("Server running...");
+    _notifyParent();
 
     while (_isRunning)
     {
@@ -85,74 +258,369 @@ void Server::run()
 			ss << "Error in event loop: " << e.what();
             LOG_ERROR(ss.str());
         }
+        if (_draining && _connections.size() == 0)
+            break;
+        if (_draining && TimerWheel::now() >= _drainDeadline)
+        {
+            LOG_WARNING("Shutdown timeout reached, closing " + TO_STRING(_connections.size()) + " connections");
+            break;
+        }
+    }
+    LOG_INFO("Accepts per wakeup: " + _acceptHistogram.toString());
+    LOG_INFO("Connection limits: " + _limiter.toString());
+    LOG_INFO("Buffer pool: " + TO_STRING(BufferPool::getCharged()) + " bytes charged, "
+        + TO_STRING(BufferPool::local().getDenied()) + " requests denied by the budget");
+}
+
+void Server::_runWorkers()
+{
+    size_t count = _config->getWorkerThreads();
+    const std::vector<Config::ServerConfig>& servers = _config->getServers();
+    std::vector<Config::ServerConfig>::const_iterator it;
+
+    try
+    {
+        for (size_t i = 0; i < count; ++i)
+            _workers.push_back(new Worker(i, *_config, _limiter));
+        for (it = servers.begin(); it != servers.end(); ++it)
+        {
+            std::string address = _addressOf(*it);
+            ListenFd listenFd;
+            int first = -1;
+
+            listenFd.address = address;
+            for (size_t i = 0; i < count; ++i)
+            {
+                int fd = _takeInherited(address);
+                if (fd == -1)
+                {
+                    try
+                    {
+                        fd = ListeningSocket::openSocket(*it, true);
+                    }
+                    catch (const std::exception& e)
+                    {
+                        // The old process bound without SO_REUSEPORT: share its socket
+                        if (first == -1)
+                            throw;
+                        fd = fcntl(first, F_DUPFD_CLOEXEC, 0);
+                        if (fd == -1)
+                            throw;
+                    }
+                }
+                if (first == -1)
+                    first = fd;
+                _workers[i]->addListener(fd, *it);
+                listenFd.fd = fd;
+                _listenFds.push_back(listenFd);
+            }
+            // More sockets inherited than we have workers: keep them all open
+            for (size_t i = 0; (listenFd.fd = _takeInherited(address)) != -1; ++i)
+            {
+                _workers[i % count]->addListener(listenFd.fd, *it);
+                _listenFds.push_back(listenFd);
+            }
+        }
+        _closeUnusedInherited();
+        for (size_t i = 0; i < count; ++i)
+            _workers[i]->start();
+    }
+    catch (const std::exception& e)
+    {
+        LOG_ERROR("Failed to start workers: " + std::string(e.what()));
+        stop();
+        throw;
+    }
+    LOG_INFO("Server running with " + TO_STRING(count) + " worker threads...");
+    _notifyParent();
+
+    // The main thread only waits for signals
+    while (_isRunning)
+    {
+        int timeout = -1;
+        if (_draining)
+        {
+            uint64_t now = TimerWheel::now();
+            if (now >= _drainDeadline)
+            {
+                LOG_WARNING("Shutdown timeout reached, closing remaining connections");
+                stop();
+                break;
+            }
+            timeout = std::min<uint64_t>(200, _drainDeadline - now);
+        }
+        struct pollfd pfd;
+        pfd.fd = _signalFd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, timeout) == -1 && errno != EINTR)
+        {
+            LOG_ERROR(std::string("poll failed: ") + strerror(errno));
+            stop();
+            break;
+        }
+        _handleSignals();
+
+        bool finished = _draining;
+        for (size_t i = 0; finished && i < _workers.size(); ++i)
+            finished = _workers[i]->isFinished();
+        if (finished)
+            break;
+    }
+    for (size_t i = 0; i < _workers.size(); ++i)
+        _workers[i]->join();
+    LOG_INFO("Connection limits: " + _limiter.toString());
+}
+
+void Server::_handleSignals()
+{
+    struct signalfd_siginfo info;
+
+    while (read(_signalFd, &info, sizeof(info)) == sizeof(info))
+    {
+        switch (info.ssi_signo)
+        {
+            case SIGINT:
+                stop();
+                break;
+            case SIGTERM:
+            case SIGQUIT:
+                _beginDrain();
+                break;
+            case SIGUSR2:
+                _upgrade();
+                break;
+            case SIGCHLD:
+                _reapUpgrade();
+                break;
+        }
+    }
+}
+
+// Stop accepting, close idle connections and let the others finish their
+// current request. Keep-alive is refused from here on.
+void Server::_beginDrain()
+{
+    if (_draining)
+        return;
+    _draining = true;
+    _drainDeadline = TimerWheel::now() + _config->getShutdownTimeout();
+    LOG_INFO("Draining, waiting up to " + TO_STRING(_config->getShutdownTimeout()) + " ms for open connections");
+    _listenFds.clear();
+
+    if (!_workers.empty())
+    {
+        for (size_t i = 0; i < _workers.size(); ++i)
+            _workers[i]->drain();
+        return;
+    }
+    for (size_t fd = 0; fd < _listenSockets.capacity(); ++fd)
+    {
+        LSocket* listener = _listenSockets.get(fd);
+        if (!listener)
+            continue;
+        _epoll->removeSocket(fd);
+        _listenSockets.erase(fd);
+        _listenConfigs.erase(fd);
+        delete listener;
+    }
+    for (size_t fd = 0; fd < _connections.capacity(); ++fd)
+    {
+        Connection* conn = _connections.get(fd);
+        if (conn && conn->isIdle())
+            _cleanupConnection(fd);
+    }
+}
+
+// fork + execve of argv[0] with the listening sockets left open. The child
+// only makes async-signal-safe calls: everything is prepared beforehand.
+void Server::_upgrade()
+{
+    if (_draining || _upgradePid > 0 || !_argv || !_argv[0])
+    {
+        LOG_WARNING("Ignoring SIGUSR2: draining, upgrade in progress or no binary to run");
+        return;
+    }
+
+    std::string fds;
+    for (size_t i = 0; i < _listenFds.size(); ++i)
+        fds += (i ? "," : "") + TO_STRING(_listenFds[i].fd) + "@" + _listenFds[i].address;
+
+    std::vector<std::string> vars;
+    for (char** env = environ; *env; ++env)
+        if (strncmp(*env, "WEBSERV_", 8) != 0)
+            vars.push_back(*env);
+    vars.push_back("WEBSERV_LISTEN_FDS=" + fds);
+    vars.push_back("WEBSERV_PARENT_PID=" + TO_STRING(getpid()));
+    std::vector<char*> envp;
+    for (size_t i = 0; i < vars.size(); ++i)
+        envp.push_back(const_cast<char*>(vars[i].c_str()));
+    envp.push_back(NULL);
+
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        LOG_ERROR(std::string("Upgrade failed, fork: ") + strerror(errno));
+        return;
+    }
+    if (pid == 0)
+    {
+        for (size_t i = 0; i < _listenFds.size(); ++i)
+            fcntl(_listenFds[i].fd, F_SETFD, 0);
+        resetSignalMask();
+        execve(_argv[0], _argv, &envp[0]);
+        _exit(127);
+    }
+    _upgradePid = pid;
+    LOG_INFO("Upgrade: started " + std::string(_argv[0]) + " as pid " + TO_STRING(pid) + " with " + TO_STRING(_listenFds.size()) + " listeners");
+}
+
+// The new binary died before it took over: keep serving
+void Server::_reapUpgrade()
+{
+    int status;
+
+    if (_upgradePid > 0 && waitpid(_upgradePid, &status, WNOHANG) == _upgradePid)
+    {
+        LOG_ERROR("Upgrade failed: pid " + TO_STRING(_upgradePid) + " exited with status " + TO_STRING(WEXITSTATUS(status)));
+        _upgradePid = 0;
+    }
+}
+
+// Once listening, a binary started by _upgrade() tells the old one to drain
+void Server::_notifyParent()
+{
+    const char* parent = getenv("WEBSERV_PARENT_PID");
+
+    if (parent && std::atoi(parent) == getppid())
+    {
+        LOG_INFO("Upgrade: listening, draining pid " + std::string(parent));
+        kill(getppid(), SIGTERM);
     }
+    // Not for CGI scripts nor the next upgrade
+    unsetenv("WEBSERV_LISTEN_FDS");
+    unsetenv("WEBSERV_PARENT_PID");
 }
 
 void Server::_handleEvents()
 {
-    std::vector<struct epoll_event> events = _epoll->waitEvents();
+    uint64_t now = TimerWheel::now();
+    _resumeStarved();
+    int timeout = _timers.nextTimeout(now);
+    if (_draining)
+    {
+        int left = _drainDeadline > now ? static_cast<int>(_drainDeadline - now) : 0;
+        if (timeout < 0 || timeout > left)
+            timeout = left;
+    }
+    // Returned buffer memory does not wake epoll up
+    if (!_starved.empty() && (timeout < 0 || timeout > EventLoop::STARVED_POLL_MS))
+        timeout = EventLoop::STARVED_POLL_MS;
+    std::vector<struct epoll_event> events = _epoll->waitEvents(timeout);
     std::vector<struct epoll_event>::iterator it;
     
     for (it = events.begin(); it != events.end(); ++it)
     {
+        if (it->data.u64 == SIGNAL_TAG)
+        {
+            _handleSignals();
+            continue;
+        }
+        if (it->data.u64 == DISK_TAG)
+        {
+            _completeDiskTasks();
+            continue;
+        }
         try
         {
-            if (_listenSockets.find(it->data.fd) != _listenSockets.end())
+            LSocket*    listener = _listenSockets.lookup(it->data.u64);
+            Connection* conn = listener ? NULL : _connections.lookup(it->data.u64);
+
+            if (!listener && !conn && _bodySources.lookup(it->data.u64))
+                _resumeBodySource(FdTable<Connection>::fdOf(it->data.u64));
+            else if (listener)
             {
                 if (it->events & EPOLLIN)
-                    _acceptConnection(_listenSockets[it->data.fd]);
+                    _acceptConnection(listener);
             }
-            else if (_connections.find(it->data.fd) != _connections.end())
+            else if (conn)
             {
-                _handleConnection(_connections[it->data.fd], it->events);
+                _handleConnection(conn, it->events);
             }
+            // Otherwise the fd was closed earlier in this batch: stale event
         }
         catch (const std::exception& e)
         {
             LOG_ERROR("Error handling event: " + std::string(e.what()));
-            _cleanupConnection(it->data.fd);
+            if (_connections.lookup(it->data.u64))
+                _cleanupConnection(FdTable<Connection>::fdOf(it->data.u64));
         }
     }
+    // Expired connections shut their socket down and are reaped on EPOLLHUP
+    _timers.advance(TimerWheel::now());
 }
 
+// Accepts up to accept_batch connections per wakeup. The listener is
+// level-triggered, so whatever is left in the backlog is reported again.
+// Connections turned away by the limiter count against the batch too.
 void Server::_acceptConnection(LSocket* socket)
 {
-    CSocket* clientSocket = NULL;
-	Connection* conn = NULL;
-	
-	try
-    {	
-		clientSocket = socket->acceptClient();
-    	if (!clientSocket)
-        	return;  // No pending connections
-        Connection* conn = new Connection(clientSocket);
-        _epoll->addSocket(clientSocket->getFd(), EPOLLIN);
-        _connections[clientSocket->getFd()] = conn;
-		LOG_INFO("Connection " + clientSocket->toString() + " accepted");
-    }
-    catch (const std::exception& e)
-    {
-		delete clientSocket;
-		delete conn;
-		std::stringstream ss;
-		ss << "Failed to setup connection: " << e.what();
-        LOG_ERROR(ss.str());
-    }
+	const Config::ServerConfig&	config = *_listenConfigs.get(socket->getFd());
+	size_t						accepted = 0;
+
+	for (size_t attempt = 0; attempt < config.acceptBatch; attempt++)
+	{
+		CSocket* clientSocket = NULL;
+		Connection* conn = NULL;
+		bool admitted = false;
+
+		try
+		{	
+			clientSocket = socket->acceptClient();
+			if (!clientSocket)
+				break;  // No pending connections
+			if (!_limiter.admit(clientSocket->getAddr()))
+			{
+				// Over a limit: reset it before anything is allocated for it
+				setAbortiveClose(clientSocket->getFd());
+				delete clientSocket;
+				continue;
+			}
+			admitted = true;
+			conn = new Connection(clientSocket, config);
+			clientSocket = NULL;  // Owned by conn from here on
+			_epoll->addSocket(conn->getFd(), EPOLLIN, _connections.insert(conn->getFd(), conn));
+			conn->updateTimeout(_timers);
+			accepted++;
+			LOG_INFO("Connection on fd " + TO_STRING(conn->getFd()) + " accepted");
+		}
+		catch (const std::exception& e)
+		{
+			if (admitted)
+				_limiter.release(conn ? conn->getAddr() : clientSocket->getAddr());
+			if (conn)
+				_connections.erase(conn->getFd());
+			delete clientSocket;
+			delete conn;
+			std::stringstream ss;
+			ss << "Failed to setup connection: " << e.what();
+			LOG_ERROR(ss.str());
+			break;
+		}
+	}
+	_acceptHistogram.record(accepted);
 }
 
 void Server::_handleConnection(Connection* conn, uint32_t events)
 {
+    if (DiskPool::isRunning())
+        DiskCompletions::local().setSubmitter(_connections.tagOf(conn->getFd()));
     try {
-		HTTPRequest& req = conn->getCurrentRequest();
-		// Handle temp file operations
-        if (req.hasFileOperationsPending() && (events & EPOLLOUT)) {
-            req.handleWrite();
-            
-            // If no more pending operations, modify epoll events
-            if (!req.hasFileOperationsPending()) {
-                _epoll->modifySocket(conn->getFd(), EPOLLIN);
-            }
-        }
+		if (events & (EPOLLERR | EPOLLHUP))
+		{
+			_cleanupConnection(conn->getFd());
+			return;
+		}
 		if (events & EPOLLOUT)
 		{
 			// Write response if we have data to write
@@ -163,18 +631,30 @@ void Server::_handleConnection(Connection* conn, uint32_t events)
 					_cleanupConnection(conn->getFd());
 					return;
 				}
-				// If write is complete, reset for next request
+				if (conn->getWaitFd() != -1)
+				{
+					_waitForBodySource(conn);
+					return;
+				}
+				if (conn->getDiskWait())
+				{
+					// A pool thread reads the file: no polling until it is done
+					_epoll->modifySocket(conn->getFd(), 0, _connections.tagOf(conn->getFd()));
+					conn->updateTimeout(_timers);
+					return;
+				}
+				// Everything queued is sent: close, or answer the requests
+				// that waited for room in the queue
 				if (conn->hasCompletedResponse())
 				{
-					if (conn->shouldKeepAlive())
-					{
-						conn->reset();
-						_epoll->modifySocket(conn->getFd(), EPOLLIN);
-					}
-					else
+					if (conn->isClosing() || _draining)
 					{
 						_cleanupConnection(conn->getFd());
+						return;
 					}
+					conn->responsesSent();
+					_serveRequests(conn);
+					_watchConnection(conn);
 				}
 			}
 		}
@@ -182,36 +662,29 @@ void Server::_handleConnection(Connection* conn, uint32_t events)
 		if (events & EPOLLIN)
 		{		
 			// Handle reading
-			if (!conn->hasCompletedRequest())
+			if (conn->wantsToRead())
 			{
 				if (!conn->handleRead())
 				{
 					_cleanupConnection(conn->getFd());
 					return;
 				}
+				// Raw uploads are spliced to their file from here on
+				HTTPRequest& request = conn->getCurrentRequest();
+				if (request.wantsBodySink())
+					request.setBodySink(_reqProc.openBodySink(request));
+				if (conn->isStarved())
+				{
+					// Out of buffer memory: stop polling for input until
+					// _resumeStarved() finds room in the pool again
+					_epoll->modifySocket(conn->getFd(), 0, _connections.tagOf(conn->getFd()));
+					_starved.push_back(_connections.tagOf(conn->getFd()));
+				}
 			}
-			// Process request if complete and response not yet queued
-			if (conn->hasCompletedRequest() && conn->hasCompletedResponse())
-			{
-                HTTPResponse response;                  
-				response = _reqProc.processRequest(conn->getCurrentRequest());
-
-				// Set some minimum headers
-				response.setHeader("Host", conn->getCurrentRequest().getHeader("Host"));
-				if (!conn->shouldKeepAlive())
-					response.setHeader("Connection", "close");
-				else
-					response.setHeader("Connection", "keep-alive");
-                
-                // print response in yellow
-                std::cout << "\033[1;33m" << "Response: " << "\033[0m" << std::endl;
-                response.print();
-                std::cout << "\033[1;33m" << "Response end " << "\033[0m" << std::endl;
-                    
-				conn->queueResponse(response);
-				_epoll->modifySocket(conn->getFd(), EPOLLOUT);
-			}
+			_serveRequests(conn);
+			_watchConnection(conn);
 		}
+		conn->updateTimeout(_timers);
     }
     catch (const std::exception& e)
     {
@@ -220,13 +693,127 @@ void Server::_handleConnection(Connection* conn, uint32_t events)
     }
 }
 
+// Answers the complete requests of conn in the order they arrived. Their
+// responses line up behind the ones still being sent, as many as the
+// connection takes; pipelined requests are parsed from its buffer.
+void Server::_serveRequests(Connection* conn)
+{
+	while (conn->hasCompletedRequest() && conn->canQueueResponse())
+	{
+		HTTPResponse response = _reqProc.processRequest(conn->getCurrentRequest());
+		bool close = !conn->shouldKeepAlive() || _draining;
+
+		// Set some minimum headers
+		response.setHeader("Host", conn->getCurrentRequest().getHeader(HTTPRequest::HDR_HOST));
+		response.setHeader("Connection", close ? "close" : "keep-alive");
+
+		conn->queueResponse(response, close);
+		if (close)
+			break;
+		conn->nextRequest();
+		HTTPRequest& request = conn->getCurrentRequest();
+		if (request.wantsBodySink())
+			request.setBodySink(_reqProc.openBodySink(request));
+	}
+}
+
+// EPOLLIN while the connection takes another request, EPOLLOUT while
+// anything is queued
+void Server::_watchConnection(Connection* conn)
+{
+	uint32_t events = 0;
+
+	if (conn->wantsToRead() && !conn->isStarved())
+		events |= EPOLLIN;
+	if (!conn->hasCompletedResponse())
+		events |= EPOLLOUT;
+	_epoll->modifySocket(conn->getFd(), events, _connections.tagOf(conn->getFd()));
+}
+
+// Gives the connections paused in _handleConnection() their EPOLLIN back
+// once this thread has a free block or a slab fits in the buffer budget
+// again. Tags of connections that were closed in the meantime no longer
+// resolve.
+void Server::_resumeStarved()
+{
+    if (_starved.empty()
+        || (BufferPool::local().getFreeBlocks() == 0 && !BufferPool::hasRoom()))
+        return;
+    for (size_t i = 0; i < _starved.size(); ++i)
+    {
+        Connection* conn = _connections.lookup(_starved[i]);
+        if (conn && conn->wantsToRead())
+        {
+            uint32_t events = EPOLLIN;
+            if (!conn->hasCompletedResponse())
+                events |= EPOLLOUT;
+            _epoll->modifySocket(conn->getFd(), events, _starved[i]);
+        }
+    }
+    _starved.clear();
+}
+
+// The streamed body has nothing ready: stop polling the socket for
+// writability and poll the source instead, until it has data or ends
+void Server::_waitForBodySource(Connection* conn)
+{
+    int sourceFd = conn->getWaitFd();
+    _epoll->modifySocket(conn->getFd(), 0, _connections.tagOf(conn->getFd()));
+    _epoll->addSocket(sourceFd, EPOLLIN, _bodySources.insert(sourceFd, conn));
+    conn->updateTimeout(_timers);
+}
+
+void Server::_resumeBodySource(int sourceFd)
+{
+    Connection* conn = _bodySources.get(sourceFd);
+    _epoll->removeSocket(sourceFd);
+    _bodySources.erase(sourceFd);
+    _epoll->modifySocket(conn->getFd(), EPOLLOUT, _connections.tagOf(conn->getFd()));
+}
+
+// Connections closed in the meantime have a stale tag and never see theirs.
+// A written request body may complete the request.
+void Server::_completeDiskTasks()
+{
+    for (DiskTask* task = DiskCompletions::local().take(); task; )
+    {
+        DiskTask* next = task->getNext();
+        Connection* conn = _connections.lookup(task->getOwner());
+        if (conn)
+        {
+            DiskCompletions::local().setSubmitter(task->getOwner());
+            try {
+                conn->onDiskDone(task);
+                _serveRequests(conn);
+                _watchConnection(conn);
+            }
+            catch (const std::exception& e)
+            {
+                LOG_ERROR("Disk task error for fd " + TO_STRING(conn->getFd()) + ": " + e.what());
+                _cleanupConnection(conn->getFd());
+            }
+        }
+        delete task;
+        task = next;
+    }
+}
+
 void Server::_cleanupConnection(int fd)
 {
-    if (_connections.find(fd) != _connections.end())
+    Connection* conn = _connections.get(fd);
+    if (conn)
     {
+        // Its source fd is closed with it and must leave the table first
+        int sourceFd = conn->getWaitFd();
+        if (sourceFd != -1 && _bodySources.get(sourceFd) == conn)
+        {
+            _epoll->removeSocket(sourceFd);
+            _bodySources.erase(sourceFd);
+        }
         _epoll->removeSocket(fd);
-        delete _connections[fd];
         _connections.erase(fd);
+        _limiter.release(conn->getAddr());
+        delete conn;
 		std::stringstream ss;
 		ss << "Connection cleaned up: " << fd;
         LOG_INFO(ss.str());
@@ -236,5 +823,7 @@ void Server::_cleanupConnection(int fd)
 void Server::stop()
 {
     _isRunning = false;
+    for (size_t i = 0; i < _workers.size(); ++i)
+        _workers[i]->stop();
     LOG_INFO("Server stopping...");
 }
\ No newline at end of file
@@ -26,7 +26,7 @@ void Socket::create()
 {
     if (_fd != -1)
         throw std::runtime_error("Socket already created");
-    _fd = socket(AF_INET, SOCK_STREAM, 0);
+    _fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);  // Only passed on to an upgrade on purpose
     if (_fd == -1)
         throw std::runtime_error(std::string("Failed to create socket: ") + strerror(errno));
 }
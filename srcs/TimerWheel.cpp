@@ -0,0 +1,195 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   TimerWheel.cpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: lwoiton <lwoiton@student.42prague.com>     +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/12/22 10:14:05 by lwoiton           #+#    #+#             */
+/*   Updated: 2024/12/22 10:14:05 by lwoiton          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "TimerWheel.hpp"
+#include <time.h>
+
+Timer::Timer()
+	: _prev(NULL)
+	, _next(NULL)
+	, _bucket(NULL)
+	, _expires(0)
+	, _wheel(NULL)
+{
+}
+
+Timer::~Timer()
+{
+	if (_wheel)
+		_wheel->cancel(*this);
+}
+
+bool	Timer::isArmed() const
+{
+	return _wheel != NULL;
+}
+
+TimerWheel::TimerWheel()
+	: _tick(now() / TICK_MS)
+	, _count(0)
+{
+	for (int level = 0; level < LEVELS; level++)
+		for (int slot = 0; slot < SLOTS; slot++)
+			_slots[level][slot] = NULL;
+}
+
+// Armed timers are only detached; they belong to their owners
+TimerWheel::~TimerWheel()
+{
+	for (int level = 0; level < LEVELS; level++)
+		for (int slot = 0; slot < SLOTS; slot++)
+			while (_slots[level][slot])
+				unlink(*_slots[level][slot]);
+}
+
+uint64_t	TimerWheel::now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Re-arming an armed timer just moves it, so this is cheap enough to call
+// on every read or write.
+void	TimerWheel::schedule(Timer& timer, uint64_t delayMs)
+{
+	uint64_t ticks = (delayMs + TICK_MS - 1) / TICK_MS;
+
+	if (timer._wheel)
+		timer._wheel->unlink(timer);
+	// _tick has already partly elapsed, count from the end of it
+	timer._expires = _tick + 1 + ticks;
+	link(timer);
+}
+
+void	TimerWheel::cancel(Timer& timer)
+{
+	if (timer._wheel == this)
+		unlink(timer);
+}
+
+size_t	TimerWheel::size() const
+{
+	return _count;
+}
+
+void	TimerWheel::link(Timer& timer)
+{
+	const uint64_t	range = static_cast<uint64_t>(1) << (SLOT_BITS * LEVELS);
+	uint64_t		delta = timer._expires > _tick ? timer._expires - _tick : 0;
+	int				level = 0;
+
+	if (delta >= range)
+	{
+		timer._expires = _tick + range - 1;
+		delta = range - 1;
+	}
+	while (level < LEVELS - 1 && delta >= (static_cast<uint64_t>(1) << (SLOT_BITS * (level + 1))))
+		level++;
+
+	Timer** bucket = &_slots[level][(timer._expires >> (SLOT_BITS * level)) & SLOT_MASK];
+	timer._prev = NULL;
+	timer._next = *bucket;
+	if (*bucket)
+		(*bucket)->_prev = &timer;
+	*bucket = &timer;
+	timer._bucket = bucket;
+	timer._wheel = this;
+	_count++;
+}
+
+void	TimerWheel::unlink(Timer& timer)
+{
+	if (timer._prev)
+		timer._prev->_next = timer._next;
+	else
+		*timer._bucket = timer._next;
+	if (timer._next)
+		timer._next->_prev = timer._prev;
+	timer._prev = NULL;
+	timer._next = NULL;
+	timer._bucket = NULL;
+	timer._wheel = NULL;
+	_count--;
+}
+
+// Moves one slot of a higher level down, now that its range is coming up
+void	TimerWheel::cascade(int level)
+{
+	Timer** bucket = &_slots[level][(_tick >> (SLOT_BITS * level)) & SLOT_MASK];
+	Timer*	timer = *bucket;
+
+	*bucket = NULL;
+	while (timer)
+	{
+		Timer* next = timer->_next;
+		_count--;
+		link(*timer);
+		timer = next;
+	}
+}
+
+int	TimerWheel::nextTimeout(uint64_t nowMs) const
+{
+	if (_count == 0)
+		return -1;
+
+	// The first non-empty level 0 slot, or the next wrap where a higher
+	// level has to be cascaded, whichever comes first
+	uint64_t tick = _tick + 1;
+	while ((tick & SLOT_MASK) != 0 && !_slots[0][tick & SLOT_MASK])
+		tick++;
+
+	uint64_t deadline = tick * TICK_MS;
+	if (deadline <= nowMs)
+		return 0;
+	return static_cast<int>(deadline - nowMs);
+}
+
+size_t	TimerWheel::advance(uint64_t nowMs)
+{
+	uint64_t	target = nowMs / TICK_MS;
+	size_t		fired = 0;
+
+	if (_count == 0)
+	{
+		if (target > _tick)
+			_tick = target;
+		return 0;
+	}
+	while (_tick < target)
+	{
+		_tick++;
+		if ((_tick & SLOT_MASK) == 0)
+		{
+			for (int level = 1; level < LEVELS; level++)
+			{
+				cascade(level);
+				if (((_tick >> (SLOT_BITS * level)) & SLOT_MASK) != 0)
+					break;
+			}
+		}
+
+		// Timers armed from a callback land at least one tick ahead,
+		// so this list only shrinks
+		Timer** bucket = &_slots[0][_tick & SLOT_MASK];
+		while (*bucket)
+		{
+			Timer* timer = *bucket;
+			unlink(*timer);
+			fired++;
+			timer->onTimeout();
+		}
+	}
+	return fired;
+}
@@ -0,0 +1,133 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   UploadSink.cpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: lwoiton <lwoiton@student.42prague.com>     +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/12/24 16:12:40 by lwoiton           #+#    #+#             */
+/*   Updated: 2024/12/24 16:12:40 by lwoiton          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "UploadSink.hpp"
+#include "HTTPError.hpp"
+#include "Utils.hpp"
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+
+size_t	UploadSink::_counter = 0;
+
+UploadSink::UploadSink(const std::string& path, size_t length)
+	: _path(path)
+	, _fd(-1)
+	, _pipeSize(0)
+	, _length(length)
+	, _received(0)
+	, _finished(false)
+{
+	_pipe[0] = -1;
+	_pipe[1] = -1;
+
+	size_t slash = path.find_last_of('/');
+	std::string dir = (slash == std::string::npos) ? "" : path.substr(0, slash + 1);
+	std::string name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+	_tmpPath = dir + "." + name + ".part-" + toString(static_cast<size_t>(getpid()))
+		+ "-" + toString(__sync_fetch_and_add(&_counter, 1));
+
+	_fd = open(_tmpPath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if (_fd == -1)
+		throw std::runtime_error("Failed to create " + _tmpPath + ": " + strerror(errno));
+	if (pipe2(_pipe, O_NONBLOCK | O_CLOEXEC) == -1)
+	{
+		int err = errno;
+		close(_fd);
+		unlink(_tmpPath.c_str());
+		throw std::runtime_error(std::string("Failed to create upload pipe: ") + strerror(err));
+	}
+	// A bigger pipe moves more per splice(); the default is kept if refused
+	fcntl(_pipe[1], F_SETPIPE_SZ, 1024 * 1024);
+	int size = fcntl(_pipe[1], F_GETPIPE_SZ);
+	_pipeSize = size > 0 ? static_cast<size_t>(size) : 65536;
+}
+
+UploadSink::~UploadSink()
+{
+	_writer.closeFd(_pipe[0]);
+	if (_pipe[1] != -1)
+		close(_pipe[1]);
+	_writer.closeFd(_fd);
+	if (!_finished)
+		unlink(_tmpPath.c_str());
+}
+
+ssize_t	UploadSink::receive(int sockFd, size_t max)
+{
+	size_t len = std::min(std::min(max, getRemaining()), _pipeSize);
+	if (len == 0)
+		return 0;
+
+	ssize_t n = splice(sockFd, NULL, _pipe[1], NULL, len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	if (n <= 0)
+		return n;
+	_writer.copy(_fd, _received, _pipe[0], -1, n);
+	_received += n;
+	return n;
+}
+
+void	UploadSink::write(const char* data, size_t len)
+{
+	len = std::min(len, getRemaining());
+	_writer.write(_fd, _received, data, len);
+	_received += len;
+}
+
+DiskTask*	UploadSink::getDiskWait() const
+{
+	return _writer.getDiskWait();
+}
+
+bool	UploadSink::isBacklogged() const
+{
+	return _writer.isBacklogged();
+}
+
+bool	UploadSink::diskDone(DiskTask* task)
+{
+	return _writer.diskDone(task);
+}
+
+size_t	UploadSink::getReceived() const
+{
+	return _received;
+}
+
+size_t	UploadSink::getRemaining() const
+{
+	return _length - _received;
+}
+
+const std::string&	UploadSink::getPath() const
+{
+	return _path;
+}
+
+void	UploadSink::finish()
+{
+	if (_finished)
+		return;
+	if (_received != _length)
+		throw HTTPError(400, "Bad Request: Incomplete upload");
+	if (close(_fd) == -1 || rename(_tmpPath.c_str(), _path.c_str()) == -1)
+	{
+		_fd = -1;
+		throw HTTPError(500, "Failed to store upload: " + std::string(strerror(errno)));
+	}
+	_fd = -1;
+	_finished = true;
+}
@@ -0,0 +1,519 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   UringPoller.cpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: lwoiton <lwoiton@student.42prague.com>     +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/12/22 17:40:12 by lwoiton           #+#    #+#             */
+/*   Updated: 2024/12/22 17:40:12 by lwoiton          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "UringPoller.hpp"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <sys/utsname.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <signal.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+static unsigned	loadAcquire(const unsigned* p)
+{
+	return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static void	storeRelease(unsigned* p, unsigned value)
+{
+	__atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+
+static unsigned*	ringField(const void* base, uint32_t offset)
+{
+	return reinterpret_cast<unsigned*>(static_cast<char*>(const_cast<void*>(base)) + offset);
+}
+
+UringPoller::UringPoller(unsigned entries)
+	: _ringFd(-1)
+	, _toSubmit(0)
+	, _syscalls(0)
+	, _bufRing(NULL)
+	, _bufRingSize(0)
+	, _buffers(NULL)
+	, _bufTail(0)
+{
+	struct io_uring_params params;
+
+	_sqRing.base = _cqRing.base = _sqes.base = MAP_FAILED;
+	memset(&params, 0, sizeof(params));
+	_ringFd = syscall(__NR_io_uring_setup, entries, &params);
+	_syscalls++;
+	if (_ringFd == -1)
+		throw std::runtime_error(std::string("io_uring_setup failed: ") + strerror(errno));
+	if (!(params.features & IORING_FEAT_EXT_ARG))
+	{
+		close(_ringFd);
+		throw std::runtime_error("io_uring lacks IORING_FEAT_EXT_ARG (Linux 5.11+)");
+	}
+
+	_sqRing.size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	_cqRing.size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if (_cqRing.size > _sqRing.size)
+			_sqRing.size = _cqRing.size;
+		_cqRing.size = _sqRing.size;
+	}
+	_sqes.size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+	_sqRing.base = mmap(NULL, _sqRing.size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, _ringFd, IORING_OFF_SQ_RING);
+	if (_sqRing.base != MAP_FAILED && (params.features & IORING_FEAT_SINGLE_MMAP))
+		_cqRing.base = _sqRing.base;
+	else if (_sqRing.base != MAP_FAILED)
+		_cqRing.base = mmap(NULL, _cqRing.size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, _ringFd, IORING_OFF_CQ_RING);
+	if (_cqRing.base != MAP_FAILED)
+		_sqes.base = mmap(NULL, _sqes.size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, _ringFd, IORING_OFF_SQES);
+	if (_sqes.base == MAP_FAILED)
+	{
+		int err = errno;
+		unmap();
+		close(_ringFd);
+		throw std::runtime_error(std::string("io_uring mmap failed: ") + strerror(err));
+	}
+
+	_sqHead = ringField(_sqRing.base, params.sq_off.head);
+	_sqTail = ringField(_sqRing.base, params.sq_off.tail);
+	_sqMask = ringField(_sqRing.base, params.sq_off.ring_mask);
+	_sqArray = ringField(_sqRing.base, params.sq_off.array);
+	_sqEntries = params.sq_entries;
+	_sqeBase = static_cast<struct io_uring_sqe*>(_sqes.base);
+	_cqHead = ringField(_cqRing.base, params.cq_off.head);
+	_cqTail = ringField(_cqRing.base, params.cq_off.tail);
+	_cqMask = ringField(_cqRing.base, params.cq_off.ring_mask);
+	_cqes = reinterpret_cast<struct io_uring_cqe*>(
+		static_cast<char*>(_cqRing.base) + params.cq_off.cqes);
+	setupBuffers();
+}
+
+UringPoller::~UringPoller()
+{
+	unmap();
+	close(_ringFd);
+	if (_bufRing != NULL)
+		munmap(_bufRing, _bufRingSize);
+	free(_buffers);
+}
+
+// Registers the provided buffer ring that multishot recv picks from.
+// Without it (or before Linux 6.0) completions are simply not offered.
+void	UringPoller::setupBuffers()
+{
+	struct utsname	name;
+	int				major = 0;
+
+	if (uname(&name) == 0)
+		major = atoi(name.release);
+	if (major < 6)
+		return;
+	_bufRingSize = RECV_BUFFERS * sizeof(struct io_uring_buf);
+	void* ring = mmap(NULL, _bufRingSize, PROT_READ | PROT_WRITE,
+		MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	if (ring == MAP_FAILED)
+		return;
+	_buffers = static_cast<char*>(malloc(RECV_BUFFERS * RECV_BUFFER_SIZE));
+
+	struct io_uring_buf_reg	reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+	reg.ring_entries = RECV_BUFFERS;
+	reg.bgid = BUFFER_GROUP;
+	_syscalls++;
+	if (_buffers == NULL
+		|| syscall(__NR_io_uring_register, _ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0)
+	{
+		munmap(ring, _bufRingSize);
+		free(_buffers);
+		_buffers = NULL;
+		return;
+	}
+	_bufRing = static_cast<struct io_uring_buf_ring*>(ring);
+	for (unsigned id = 0; id < RECV_BUFFERS; id++)
+		releaseBuffer(id);
+}
+
+bool	UringPoller::supportsCompletions() const
+{
+	return _bufRing != NULL;
+}
+
+const char*	UringPoller::getBuffer(uint16_t id) const
+{
+	return _buffers + static_cast<size_t>(id) * RECV_BUFFER_SIZE;
+}
+
+// Hands the buffer back to the kernel at the tail of the ring. The ring is
+// indexed by hand: in C++ the bufs flexible array of the uapi header does
+// not start at offset 0, where the kernel expects the first entry.
+void	UringPoller::releaseBuffer(uint16_t id)
+{
+	struct io_uring_buf* bufs = reinterpret_cast<struct io_uring_buf*>(_bufRing);
+	struct io_uring_buf& buf = bufs[_bufTail & (RECV_BUFFERS - 1)];
+
+	buf.addr = reinterpret_cast<uint64_t>(_buffers + static_cast<size_t>(id) * RECV_BUFFER_SIZE);
+	buf.len = RECV_BUFFER_SIZE;
+	buf.bid = id;
+	_bufTail++;
+	__atomic_store_n(&_bufRing->tail, _bufTail, __ATOMIC_RELEASE);
+}
+
+void	UringPoller::unmap()
+{
+	if (_sqes.base != MAP_FAILED)
+		munmap(_sqes.base, _sqes.size);
+	if (_cqRing.base != MAP_FAILED && _cqRing.base != _sqRing.base)
+		munmap(_cqRing.base, _cqRing.size);
+	if (_sqRing.base != MAP_FAILED)
+		munmap(_sqRing.base, _sqRing.size);
+}
+
+UringPoller::FdState&	UringPoller::state(int fd)
+{
+	if (static_cast<size_t>(fd) >= _fds.size())
+		_fds.resize(fd + 1 + (fd >> 1));
+	return _fds[fd];
+}
+
+// Flushes the queue to the kernel when the submission ring is full
+struct io_uring_sqe*	UringPoller::nextSqe()
+{
+	unsigned tail = *_sqTail;
+
+	if (tail - loadAcquire(_sqHead) == _sqEntries)
+	{
+		enter(_toSubmit, 0, 0);
+		if (tail - loadAcquire(_sqHead) == _sqEntries)
+			throw std::runtime_error("io_uring submission queue full");
+	}
+	unsigned index = tail & *_sqMask;
+	struct io_uring_sqe* sqe = &_sqeBase[index];
+	memset(sqe, 0, sizeof(*sqe));
+	_sqArray[index] = index;
+	storeRelease(_sqTail, tail + 1);
+	_toSubmit++;
+	return sqe;
+}
+
+uint64_t	UringPoller::userData(Op op, uint32_t seq, int fd)
+{
+	return static_cast<uint64_t>(op) << 62
+		| static_cast<uint64_t>(seq & SEQ_MASK) << 32 | static_cast<uint32_t>(fd);
+}
+
+// What the poll waits for; EPOLLIN of a completion fd is its accept or recv
+uint32_t	UringPoller::pollMask(const FdState& fdState) const
+{
+	uint32_t mask = fdState.events & ~static_cast<uint32_t>(EPOLLET);
+
+	if (fdState.completion != NO_COMPLETION)
+		mask &= ~static_cast<uint32_t>(EPOLLIN | EPOLLRDHUP);
+	return mask;
+}
+
+void	UringPoller::armPoll(int fd)
+{
+	FdState&	fdState = _fds[fd];
+	uint32_t	mask = pollMask(fdState);
+
+	if (mask == 0)
+		return;
+	struct io_uring_sqe* sqe = nextSqe();
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+	sqe->poll32_events = mask;
+	if (fdState.events & EPOLLET)
+		sqe->len = IORING_POLL_ADD_MULTI;
+	sqe->user_data = userData(OP_POLL, fdState.seq, fd);
+	fdState.armed = true;
+}
+
+// Cancels the poll in flight and retires its sequence number, so nothing
+// it still completes with is reported
+void	UringPoller::cancelPoll(int fd)
+{
+	FdState& fdState = _fds[fd];
+
+	if (fdState.armed)
+	{
+		struct io_uring_sqe* sqe = nextSqe();
+		sqe->opcode = IORING_OP_POLL_REMOVE;
+		sqe->fd = -1;
+		sqe->addr = userData(OP_POLL, fdState.seq, fd);
+		sqe->user_data = CANCEL_DATA;
+		fdState.armed = false;
+	}
+	fdState.seq++;
+}
+
+void	UringPoller::armOp(int fd)
+{
+	FdState&				fdState = _fds[fd];
+	struct io_uring_sqe*	sqe = nextSqe();
+
+	sqe->fd = fd;
+	if (fdState.completion == ACCEPT_COMPLETION)
+	{
+		sqe->opcode = IORING_OP_ACCEPT;
+		sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+		sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+		sqe->user_data = userData(OP_ACCEPT, fdState.gen, fd);
+	}
+	else
+	{
+		sqe->opcode = IORING_OP_RECV;
+		sqe->ioprio = IORING_RECV_MULTISHOT;
+		sqe->flags = IOSQE_BUFFER_SELECT;
+		sqe->buf_group = BUFFER_GROUP;
+		sqe->user_data = userData(OP_RECV, fdState.gen, fd);
+	}
+	fdState.opArmed = true;
+}
+
+// The operation stays armed until its last completion comes back
+void	UringPoller::cancelOp(int fd)
+{
+	FdState&				fdState = _fds[fd];
+	struct io_uring_sqe*	sqe = nextSqe();
+
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = userData(fdState.completion == ACCEPT_COMPLETION ? OP_ACCEPT : OP_RECV,
+		fdState.gen, fd);
+	sqe->user_data = CANCEL_DATA;
+	fdState.opCancelling = true;
+}
+
+// Keeps the accept or recv in flight exactly while EPOLLIN is wanted
+void	UringPoller::updateOp(int fd)
+{
+	FdState& fdState = _fds[fd];
+
+	if (!fdState.active || fdState.completion == NO_COMPLETION)
+		return;
+	if (!(fdState.events & EPOLLIN))
+	{
+		if (fdState.opArmed && !fdState.opCancelling)
+			cancelOp(fd);
+	}
+	else if (!fdState.opArmed)
+		armOp(fd);
+}
+
+// Cancels the operation and retires its generation, so nothing it still
+// completes with is reported
+void	UringPoller::dropOp(int fd)
+{
+	FdState& fdState = _fds[fd];
+
+	if (fdState.opArmed && !fdState.opCancelling)
+		cancelOp(fd);
+	fdState.opArmed = false;
+	fdState.opCancelling = false;
+	fdState.gen++;
+}
+
+void	UringPoller::add(int fd, uint32_t events, uint64_t tag)
+{
+	addCompletion(fd, events, tag, NO_COMPLETION);
+}
+
+void	UringPoller::addCompletion(int fd, uint32_t events, uint64_t tag, Completion completion)
+{
+	FdState& fdState = state(fd);
+
+	cancelPoll(fd);  // In case the fd number was closed without remove()
+	dropOp(fd);
+	fdState.tag = tag;
+	fdState.events = events;
+	fdState.completion = _bufRing != NULL ? completion : NO_COMPLETION;
+	fdState.active = true;
+	armPoll(fd);
+	updateOp(fd);
+}
+
+void	UringPoller::modify(int fd, uint32_t events, uint64_t tag)
+{
+	FdState&	fdState = state(fd);
+	uint32_t	oldMask = pollMask(fdState);
+
+	fdState.tag = tag;
+	fdState.events = events;
+	fdState.active = true;
+	// A completion fd toggling EPOLLIN leaves its poll alone
+	if (!fdState.armed || pollMask(fdState) != oldMask)
+	{
+		cancelPoll(fd);
+		armPoll(fd);
+	}
+	updateOp(fd);
+}
+
+void	UringPoller::remove(int fd)
+{
+	if (fd < 0 || static_cast<size_t>(fd) >= _fds.size())
+		return;
+	cancelPoll(fd);
+	dropOp(fd);
+	_fds[fd].active = false;
+	_fds[fd].completion = NO_COMPLETION;
+}
+
+int	UringPoller::enter(unsigned toSubmit, unsigned minComplete, int timeoutMs)
+{
+	struct io_uring_getevents_arg	arg;
+	struct __kernel_timespec		ts;
+	unsigned						flags = 0;
+
+	memset(&arg, 0, sizeof(arg));
+	if (minComplete > 0)
+	{
+		flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+		if (timeoutMs >= 0)
+		{
+			ts.tv_sec = timeoutMs / 1000;
+			ts.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000000;
+			arg.ts = reinterpret_cast<uint64_t>(&ts);
+		}
+	}
+	int ret = syscall(__NR_io_uring_enter, _ringFd, toSubmit, minComplete, flags,
+		minComplete > 0 ? &arg : NULL, minComplete > 0 ? sizeof(arg) : 0);
+	_syscalls++;
+	if (ret >= 0)
+		_toSubmit -= static_cast<unsigned>(ret) < _toSubmit ? ret : _toSubmit;
+	return ret;
+}
+
+int	UringPoller::wait(Event* events, int maxEvents, int timeoutMs)
+{
+	// One-shot polls that fired last turn watch their fd again, and
+	// operations that ended are restarted if EPOLLIN is still wanted
+	for (size_t i = 0; i < _rearm.size(); i++)
+	{
+		int fd = _rearm[i];
+		if (_fds[fd].active && !_fds[fd].armed)
+			armPoll(fd);
+		updateOp(fd);
+	}
+	_rearm.clear();
+
+	bool ready = loadAcquire(_cqTail) != *_cqHead;
+	if (!ready && timeoutMs != 0)
+	{
+		if (enter(_toSubmit, 1, timeoutMs) == -1 && errno != ETIME)
+			return -1;
+	}
+	else if (_toSubmit > 0)
+	{
+		if (enter(_toSubmit, 0, 0) == -1 && errno != EBUSY && errno != EAGAIN)
+			return -1;
+	}
+
+	unsigned	head = *_cqHead;
+	unsigned	tail = loadAcquire(_cqTail);
+	int			count = 0;
+
+	// Stop on maxEvents, whatever is left is picked up by the next wait
+	for (; head != tail && count < maxEvents; head++)
+	{
+		const struct io_uring_cqe& cqe = _cqes[head & *_cqMask];
+		if (cqe.user_data == CANCEL_DATA)
+			continue;
+		if (static_cast<Op>(cqe.user_data >> 62) != OP_POLL)
+		{
+			if (takeCompletion(cqe, events[count]))
+				count++;
+			continue;
+		}
+
+		int			fd = static_cast<int>(static_cast<uint32_t>(cqe.user_data));
+		uint32_t	seq = static_cast<uint32_t>(cqe.user_data >> 32) & SEQ_MASK;
+		if (static_cast<size_t>(fd) >= _fds.size() || (_fds[fd].seq & SEQ_MASK) != seq)
+			continue;  // From a poll that was cancelled or replaced
+
+		FdState& fdState = _fds[fd];
+		if (!(cqe.flags & IORING_CQE_F_MORE))
+		{
+			fdState.armed = false;
+			_rearm.push_back(fd);
+		}
+		uint32_t mask;
+		if (cqe.res == -ECANCELED)
+			continue;
+		else if (cqe.res < 0)
+			mask = EPOLLERR;
+		else
+			mask = cqe.res & (fdState.events | EPOLLERR | EPOLLHUP);
+		if (mask == 0)
+			continue;
+		events[count].tag = fdState.tag;
+		events[count].events = mask;
+		events[count].kind = READY;
+		count++;
+	}
+	storeRelease(_cqHead, head);
+	return count;
+}
+
+// Turns an accept or recv completion into an event. Accepted fds and
+// buffers of a retired generation are given back here.
+bool	UringPoller::takeCompletion(const struct io_uring_cqe& cqe, Event& event)
+{
+	Op			op = static_cast<Op>(cqe.user_data >> 62);
+	int			fd = static_cast<int>(static_cast<uint32_t>(cqe.user_data));
+	uint32_t	gen = static_cast<uint32_t>(cqe.user_data >> 32) & SEQ_MASK;
+	uint16_t	buffer = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+
+	if (static_cast<size_t>(fd) >= _fds.size() || (_fds[fd].gen & SEQ_MASK) != gen)
+	{
+		if (op == OP_ACCEPT && cqe.res >= 0)
+			close(cqe.res);
+		else if (op == OP_RECV && (cqe.flags & IORING_CQE_F_BUFFER))
+			releaseBuffer(buffer);
+		return false;
+	}
+
+	FdState& fdState = _fds[fd];
+	if (!(cqe.flags & IORING_CQE_F_MORE))
+	{
+		fdState.opArmed = false;
+		fdState.opCancelling = false;
+		_rearm.push_back(fd);
+	}
+	// Out of buffers: restarted next turn, once the loop gave some back
+	if (cqe.res == -ECANCELED || cqe.res == -ENOBUFS)
+		return false;
+	event.tag = fdState.tag;
+	event.events = 0;
+	event.kind = op == OP_ACCEPT ? ACCEPTED : RECEIVED;
+	event.buffer = (cqe.flags & IORING_CQE_F_BUFFER) ? buffer : 0;
+	event.result = cqe.res;
+	return true;
+}
+
+const char*	UringPoller::getName() const
+{
+	return "io_uring";
+}
+
+size_t	UringPoller::getSyscalls() const
+{
+	return _syscalls;
+}
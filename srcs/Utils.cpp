@@ -11,6 +11,9 @@
 /* ************************************************************************** */
 
 #include "Utils.hpp"
+#include <unistd.h>
+#include <sys/socket.h>
+#include <signal.h>
 
 std::string toUpper(std::string str) {
     std::transform(str.begin(), str.end(), str.begin(), ::toupper);
@@ -78,4 +81,44 @@ void setPipeBufferSize(int pipefd) {
     if (fcntl(pipefd, F_SETPIPE_SZ, pipe_size) == -1) {
         throw std::runtime_error("Failed to increase pipe buffer size");
     }
-}
\ No newline at end of file
+}
+
+// A spare descriptor held by each listener so that hitting EMFILE does not
+// leave the pending connection in the backlog and epoll reporting it forever
+int openReserveFd() {
+    return open("/dev/null", O_RDONLY | O_CLOEXEC);
+}
+
+// Out of descriptors: free the reserve, accept the connection at the head
+// of the backlog and close it right away, then take the reserve back.
+// Returns false when there was no reserve to give up.
+bool shedConnection(int listenFd, int& reserveFd) {
+    if (reserveFd == -1)
+        return false;
+    close(reserveFd);
+    int fd = accept(listenFd, NULL, NULL);
+    if (fd != -1)
+        close(fd);
+    reserveFd = openReserveFd();
+    return true;
+}
+
+// The server blocks its signals and reads them from a signalfd. The mask
+// survives execve, so a forked child clears it before running anything else.
+// Only async-signal-safe calls: usable between fork() and execve().
+void resetSignalMask() {
+    sigset_t none;
+
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, NULL);
+}
+
+// The next close() sends an RST and frees the socket at once instead of
+// going through FIN and TIME_WAIT. For connections turned away on accept.
+void setAbortiveClose(int fd) {
+    struct linger lin;
+
+    lin.l_onoff = 1;
+    lin.l_linger = 0;
+    setsockopt(fd, SOL_SOCKET, SO_LINGER, &lin, sizeof(lin));
+}
@@ -0,0 +1,161 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Worker.cpp                                         :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: lwoiton <lwoiton@student.42prague.com>     +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/12/21 10:12:03 by lwoiton           #+#    #+#             */
+/*   Updated: 2024/12/21 10:12:03 by lwoiton          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+
+#include "Worker.hpp"
+#include "ListeningSocket.hpp"
+#include "RequestProcessor.hpp"
+#include "BufferPool.hpp"
+#include "DiskPool.hpp"
+#include <cstring>
+#include <unistd.h>
+
+Worker::Worker(size_t id, const Config& config, ConnectionLimiter& limiter)
+	: _id(id)
+	, _config(config)
+	, _limiter(limiter)
+	, _thread()
+	, _started(false)
+	, _stopRequested(false)
+	, _drainRequested(false)
+	, _finished(false)
+	, _loop(NULL)
+{
+	pthread_mutex_init(&_lock, NULL);
+}
+
+Worker::~Worker()
+{
+	if (_started)
+	{
+		stop();
+		join();
+	}
+	for (size_t i = 0; i < _listeners.size(); i++)
+		if (_listeners[i].fd != -1)
+			close(_listeners[i].fd);  // Never handed to a ListeningSocket
+	pthread_mutex_destroy(&_lock);
+}
+
+// The worker takes ownership of fd
+void	Worker::addListener(int fd, const Config::ServerConfig& server)
+{
+	Listener listener;
+
+	listener.fd = fd;
+	listener.server = &server;
+	_listeners.push_back(listener);
+}
+
+void	Worker::start()
+{
+	int err = pthread_create(&_thread, NULL, &Worker::_threadMain, this);
+	if (err != 0)
+		throw std::runtime_error(std::string("Failed to start worker thread: ") + strerror(err));
+	_started = true;
+}
+
+// Called from the main thread. Not async-signal-safe (takes _lock).
+void	Worker::stop()
+{
+	pthread_mutex_lock(&_lock);
+	_stopRequested = true;
+	if (_loop)
+		_loop->stop();
+	pthread_mutex_unlock(&_lock);
+}
+
+// Called from the main thread. Not async-signal-safe (takes _lock).
+void	Worker::drain()
+{
+	pthread_mutex_lock(&_lock);
+	_drainRequested = true;
+	if (_loop)
+		_loop->drain();
+	pthread_mutex_unlock(&_lock);
+}
+
+bool	Worker::isFinished()
+{
+	pthread_mutex_lock(&_lock);
+	bool finished = _finished;
+	pthread_mutex_unlock(&_lock);
+	return finished;
+}
+
+void	Worker::join()
+{
+	if (!_started)
+		return;
+	pthread_join(_thread, NULL);
+	_started = false;
+}
+
+size_t	Worker::getId() const
+{
+	return _id;
+}
+
+void*	Worker::_threadMain(void* arg)
+{
+	Worker* self = static_cast<Worker*>(arg);
+	try
+	{
+		self->_run();
+	}
+	catch (const std::exception& e)
+	{
+		LOG_ERROR("Worker " + TO_STRING(self->_id) + " terminated: " + e.what());
+	}
+	EventLoop::destroyInstance();
+	// After the handlers: their buffers go back to this thread's pool first
+	BufferPool::destroyLocal();
+	DiskCompletions::destroyLocal();
+	pthread_mutex_lock(&self->_lock);
+	self->_finished = true;
+	pthread_mutex_unlock(&self->_lock);
+	return NULL;
+}
+
+void	Worker::_run()
+{
+	EventLoop* loop = EventLoop::getInstance();
+	RequestProcessor processor(_config.getServers());
+
+	loop->setEdgeTriggered(_config.isEdgeTriggered());
+	if (_config.useIoUring() && loop->useIoUring())
+		LOG_INFO("Worker " + TO_STRING(_id) + " using io_uring");
+
+	for (size_t i = 0; i < _listeners.size(); i++)
+	{
+		ListeningSocket* listener = new ListeningSocket(_listeners[i].fd, *_listeners[i].server, processor, _limiter);
+		_listeners[i].fd = -1;
+		loop->registerHandler(listener);
+		LOG_INFO("Worker " + TO_STRING(_id) + " listening on " + listener->getInfo() + " (SO_REUSEPORT)");
+	}
+
+	pthread_mutex_lock(&_lock);
+	bool stopRequested = _stopRequested;
+	if (_drainRequested)
+		loop->drain();
+	_loop = loop;
+	pthread_mutex_unlock(&_lock);
+	if (!stopRequested)
+		loop->run();
+	loop->logStats();
+
+	pthread_mutex_lock(&_lock);
+	_loop = NULL;
+	pthread_mutex_unlock(&_lock);
+	// Handlers reference the processor, tear them down while it still exists
+	EventLoop::destroyInstance();
+}
@@ -12,26 +12,8 @@
 
 #include "Server.hpp"
 #include "Logger.hpp"
-#include <signal.h>
 #include <iostream>
 
-static IServer* g_server = NULL;
-
-void signalHandler(int signum)
-{
-    if (g_server != NULL)
-    {
-        LOG_INFO("Received signal " + signum);
-        g_server->stop();
-    }
-}
-
-void setupSignalHandlers()
-{
-    signal(SIGINT, signalHandler);   // Ctrl+C
-    signal(SIGTERM, signalHandler);  // termination request
-}
-
 int main(int argc, char* argv[])
 {
     try
@@ -50,12 +32,9 @@ int main(int argc, char* argv[])
             configPath = argv[1];
         }
 
-        // Setup signal handlers
-        //setupSignalHandlers();
-
-        // Initialize server
-        Server server(configPath);
-        g_server = &server;
+        // Initialize server. Signals are read from a signalfd by the
+        // server itself; argv is kept to re-exec the binary on SIGUSR2.
+        Server server(configPath, argv);
         
         // Run server
         server.run();